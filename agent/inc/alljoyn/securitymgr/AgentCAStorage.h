@@ -17,6 +17,7 @@
 #ifndef ALLJOYN_SECMGR_AGENTCASTORAGE_H_
 #define ALLJOYN_SECMGR_AGENTCASTORAGE_H_
 
+#include <string.h>
 #include <vector>
 
 #include <qcc/CryptoECC.h>
@@ -44,6 +45,56 @@ typedef vector<MembershipCertificate> MembershipCertificateChain;
  * */
 typedef vector<IdentityCertificate> IdentityCertificateChain;
 
+/**
+ * @brief Everything the agent needs to synchronize an application, read from
+ *        one consistent snapshot of storage.
+ * */
+struct SyncBundle {
+    ApplicationSyncState syncState;                  ///< The sync state of the application.
+    vector<MembershipCertificateChain> memberships;  ///< The membership certificate chains.
+    IdentityCertificateChain identityCertificates;   ///< The identity certificate chain.
+    Manifest manifest;                               ///< The manifest of the application.
+    PermissionPolicy policy;                         ///< The policy, only valid if hasPolicy is true.
+    bool hasPolicy;                                  ///< Whether a policy is stored for the application.
+    uint8_t syncDigest[Crypto_SHA256::DIGEST_SIZE];  ///< The last sync digest, only valid if hasSyncDigest is true.
+    bool hasSyncDigest;                              ///< Whether a sync digest is stored for the application.
+
+    SyncBundle() :
+        syncState(SYNC_UNKNOWN), hasPolicy(false), hasSyncDigest(false)
+    {
+    }
+};
+
+/**
+ * @brief A pending retry of a failed synchronization.
+ * */
+struct SyncRetry {
+    Application app;       ///< The application to synchronize.
+    uint32_t attempts;     ///< The number of failed attempts so far.
+    uint64_t nextAttempt;  ///< Epoch time (in ms) of the next attempt.
+
+    SyncRetry() :
+        attempts(0), nextAttempt(0)
+    {
+    }
+};
+
+/**
+ * @brief A remembered decision on a manifest, so applications requesting the
+ *        same manifest can be claimed without asking the ClaimListener.
+ * */
+struct ManifestApproval {
+    uint8_t digest[Crypto_SHA256::DIGEST_SIZE];          ///< The digest of the manifest (Manifest::GetDigest).
+    bool approved;                                       ///< Whether the manifest was approved.
+    PermissionConfigurator::ClaimCapabilities claimType; ///< The claim type selected for the manifest.
+
+    ManifestApproval() :
+        approved(false), claimType(0)
+    {
+        memset(digest, 0, Crypto_SHA256::DIGEST_SIZE);
+    }
+};
+
 /**
  * @brief StorageListener abstract class.
  *
@@ -266,6 +317,202 @@ class AgentCAStorage {
     virtual QStatus GetPolicy(const Application& app,
                               PermissionPolicy& policy) const = 0;
 
+    /**
+     * @brief Persist the digest of the state that was successfully synchronized
+     *        to a given application.
+     *
+     * The digest is opaque to storage. The agent uses it to detect whether the
+     * desired state of an application has changed since its last successful
+     * synchronization, so remote calls can be avoided if nothing changed.
+     * Storage implementations that do not support this should leave the default
+     * implementation in place.
+     *
+     * @param[in] app                         The application with a valid keyInfo set.
+     * @param[in] digest                      A byte array of Crypto_SHA256::DIGEST_SIZE bytes.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support sync digests.
+     * @return others              On failure.
+     */
+    virtual QStatus StoreSyncDigest(const Application& app,
+                                    const uint8_t* digest)
+    {
+        QCC_UNUSED(app);
+        QCC_UNUSED(digest);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Retrieve the digest of the state that was last successfully
+     *        synchronized to a given application.
+     *
+     * @param[in] app                         The application with a valid keyInfo set.
+     * @param[in,out] digest                  A previously allocated byte array of
+     *                                        Crypto_SHA256::DIGEST_SIZE bytes.
+     *
+     * @return ER_OK               On success.
+     * @return ER_END_OF_DATA      If no digest was stored for the application.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support sync digests.
+     * @return others              On failure.
+     */
+    virtual QStatus GetSyncDigest(const Application& app,
+                                  uint8_t* digest) const
+    {
+        QCC_UNUSED(app);
+        QCC_UNUSED(digest);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Persist when a failed synchronization of an application will be
+     *        retried, so retries survive a restart of the agent.
+     *
+     * @param[in] retry                       The retry with a valid app.keyInfo set.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support sync retries.
+     * @return others              On failure.
+     */
+    virtual QStatus StoreSyncRetry(const SyncRetry& retry)
+    {
+        QCC_UNUSED(retry);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Remove the pending retry of an application, if any.
+     *
+     * @param[in] app                         The application with a valid keyInfo set.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support sync retries.
+     * @return others              On failure.
+     */
+    virtual QStatus RemoveSyncRetry(const Application& app)
+    {
+        QCC_UNUSED(app);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Retrieve all pending retries.
+     *
+     * @param[in,out] retries                 The pending retries.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support sync retries.
+     * @return others              On failure.
+     */
+    virtual QStatus GetSyncRetries(vector<SyncRetry>& retries) const
+    {
+        QCC_UNUSED(retries);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Remember the decision on a manifest, replacing any earlier
+     *        decision on the same manifest.
+     *
+     * @param[in] approval                    The decision with a valid digest.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support manifest approvals.
+     * @return others              On failure.
+     */
+    virtual QStatus StoreManifestApproval(const ManifestApproval& approval)
+    {
+        QCC_UNUSED(approval);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Retrieve the remembered decision on a manifest.
+     *
+     * @param[in,out] approval                The digest should be set; the
+     *                                        decision is filled in.
+     *
+     * @return ER_OK               On success.
+     * @return ER_END_OF_DATA      If no decision was stored for the manifest.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support manifest approvals.
+     * @return others              On failure.
+     */
+    virtual QStatus GetManifestApproval(ManifestApproval& approval) const
+    {
+        QCC_UNUSED(approval);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Forget the decision on a manifest, so the ClaimListener is asked
+     *        again the next time it is requested.
+     *
+     * @param[in] digest                      A byte array of Crypto_SHA256::DIGEST_SIZE bytes.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support manifest approvals.
+     * @return others              On failure.
+     */
+    virtual QStatus RemoveManifestApproval(const uint8_t* digest)
+    {
+        QCC_UNUSED(digest);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Retrieve all managed applications with their sync state in a
+     *        single scan of storage.
+     *
+     * @param[in,out] apps                    The managed applications.
+     *
+     * @return ER_OK               On success.
+     * @return ER_NOT_IMPLEMENTED  If storage does not support a bulk retrieval.
+     * @return others              On failure.
+     */
+    virtual QStatus GetManagedApplications(vector<Application>& apps) const
+    {
+        QCC_UNUSED(apps);
+        return ER_NOT_IMPLEMENTED;
+    }
+
+    /**
+     * @brief Retrieve the complete desired state of a given application.
+     *
+     * Storage implementations should override this to read all data at once
+     * from a consistent snapshot. The default implementation combines the
+     * individual getters.
+     *
+     * @param[in] app                         The application with a valid keyInfo set.
+     * @param[in,out] bundle                  The desired state of the application.
+     *
+     * @return ER_OK           On success.
+     * @return ER_END_OF_DATA  If the application is not managed.
+     * @return others          On failure.
+     */
+    virtual QStatus GetSyncBundle(const Application& app,
+                                  SyncBundle& bundle) const
+    {
+        Application managedApp(app);
+        QStatus status = GetManagedApplication(managedApp);
+        if (ER_OK != status) {
+            return status;
+        }
+        bundle.syncState = managedApp.syncState;
+        if (ER_OK != (status = GetMembershipCertificates(app, bundle.memberships))) {
+            return status;
+        }
+        if (ER_OK != (status = GetIdentityCertificatesAndManifest(app, bundle.identityCertificates,
+                                                                  bundle.manifest))) {
+            return status;
+        }
+        status = GetPolicy(app, bundle.policy);
+        if ((ER_OK != status) && (ER_END_OF_DATA != status)) {
+            return status;
+        }
+        bundle.hasPolicy = (ER_OK == status);
+        bundle.hasSyncDigest = (ER_OK == GetSyncDigest(app, bundle.syncDigest));
+        return ER_OK;
+    }
+
     /**
      * @brief Register a storage listener with storage.
      *
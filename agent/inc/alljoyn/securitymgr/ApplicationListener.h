@@ -17,6 +17,8 @@
 #ifndef ALLJOYN_SECMGR_APPLICATIONLISTENER_H_
 #define ALLJOYN_SECMGR_APPLICATIONLISTENER_H_
 
+#include <vector>
+
 #include <qcc/Debug.h>
 
 #include "Application.h"
@@ -25,6 +27,21 @@
 
 namespace ajn {
 namespace securitymgr {
+/**
+ * @brief A change of the state of an application, as reported by
+ *        ApplicationListener::OnApplicationStateChanges.
+ */
+struct ApplicationStateChange {
+    const OnlineApplication* oldApp; ///< The state before the change or nullptr if it was unknown.
+    const OnlineApplication* newApp; ///< The state after the change or nullptr if no longer tracked.
+
+    ApplicationStateChange(const OnlineApplication* _oldApp,
+                           const OnlineApplication* _newApp) :
+        oldApp(_oldApp), newApp(_newApp)
+    {
+    }
+};
+
 class ApplicationListener {
   public:
     /**
@@ -41,6 +58,27 @@ class ApplicationListener {
     virtual void OnApplicationStateChange(const OnlineApplication* oldApp,
                                           const OnlineApplication* newApp) = 0;
 
+    /**
+     * @brief Callback that is triggered with the state changes collected
+     *        during the batch window of a listener registered with
+     *        SecurityAgent::RegisterBatchedApplicationListener. Multiple
+     *        changes of the same application are coalesced into one change
+     *        from its first to its last known state. The pointers are only
+     *        valid during the callback.
+     *
+     *        The default implementation calls OnApplicationStateChange for
+     *        every change.
+     *
+     * @param[in] changes  The state changes, in the order of their first
+     *                     occurrence.
+     */
+    virtual void OnApplicationStateChanges(const std::vector<ApplicationStateChange>& changes)
+    {
+        for (size_t i = 0; i < changes.size(); i++) {
+            OnApplicationStateChange(changes[i].oldApp, changes[i].newApp);
+        }
+    }
+
     /**
      * @brief Callback that is triggered when an application could not be
      *        synchronized with the persisted state.
@@ -0,0 +1,100 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_CLAIMHANDLE_H_
+#define ALLJOYN_SECMGR_CLAIMHANDLE_H_
+
+#include <qcc/Event.h>
+
+#include <alljoyn/Status.h>
+
+#include "Application.h"
+
+namespace ajn {
+namespace securitymgr {
+/**
+ * @brief Handle of a claim started by SecurityAgent::ClaimAsync. It can be
+ *        used to follow the progress of the claim, to wait for it and to
+ *        cancel it.
+ */
+class ClaimHandle {
+  public:
+    /**
+     * @brief The stages a claim goes through, in order.
+     */
+    enum Stage {
+        CLAIM_QUEUED,             // Waiting for a worker of the security agent.
+        CLAIM_FETCHING_MANIFEST,  // Retrieving manifest and claim capabilities.
+        CLAIM_APPROVING_MANIFEST, // Waiting for the ClaimListener.
+        CLAIM_SIGNING,            // Generating the identity certificate and
+                                  // setting up the session for claiming.
+        CLAIM_CLAIMING,           // Claiming the remote application.
+        CLAIM_FINISHED            // Done; GetStatus returns the result.
+    };
+
+    /**
+     * @brief Get the application that is being claimed.
+     */
+    virtual const OnlineApplication& GetApplication() const = 0;
+
+    /**
+     * @brief Get the current stage of the claim.
+     */
+    virtual Stage GetStage() const = 0;
+
+    /**
+     * @brief Get the result of the claim, as it would have been returned by
+     *        SecurityAgent::Claim. Only meaningful once the claim is
+     *        CLAIM_FINISHED.
+     */
+    virtual QStatus GetStatus() const = 0;
+
+    /**
+     * @brief Cancel the claim. A claim can only be cancelled before the
+     *        remote application is claimed; a cancelled claim finishes with
+     *        ER_FAIL.
+     *
+     * @return true   If the claim will not be applied to the application.
+     * @return false  If it is too late to cancel the claim.
+     */
+    virtual bool Cancel() = 0;
+
+    /**
+     * @brief Check whether the claim was cancelled.
+     */
+    virtual bool IsCancelled() const = 0;
+
+    /**
+     * @brief Wait for the claim to finish.
+     *
+     * @param[in] timeout  Maximum time (in ms) to wait.
+     *
+     * @return ER_OK       If the claim is finished.
+     * @return ER_TIMEOUT  If the claim did not finish in time.
+     */
+    virtual QStatus Wait(uint32_t timeout = qcc::Event::WAIT_FOREVER) = 0;
+
+    /**
+     * @brief Virtual destructor for derivable class.
+     */
+    virtual ~ClaimHandle() { };
+
+  protected:
+    ClaimHandle() { };
+};
+}
+}
+#endif /* ALLJOYN_SECMGR_CLAIMHANDLE_H_ */
@@ -151,6 +151,31 @@ class ClaimContext {
         manifestApproved = approved;
     }
 
+    /**
+     * @brief Remember the decision on the manifest and the selected claim
+     * type, so later claims of applications requesting the same manifest do
+     * not call the ClaimListener. An approval is only reused when the
+     * claim type is supported by the application and is not
+     * CAPABLE_ECDHE_PSK, as the pre-shared key differs per application.
+     * Decisions are only remembered if the storage supports it.
+     *
+     * @param[in] remember true if the decision should be remembered.
+     */
+    void RememberDecision(bool remember = true)
+    {
+        rememberDecision = remember;
+    }
+
+    /**
+     * @brief retrieves whether the decision on the manifest will be remembered.
+     *
+     * @return true if the decision will be remembered, false otherwise.
+     */
+    bool IsDecisionRemembered() const
+    {
+        return rememberDecision;
+    }
+
     /**
      * @brief sets a pre-shared key to be used for this claim action
      *
@@ -174,8 +199,7 @@ class ClaimContext {
                  const PermissionConfigurator::ClaimCapabilities _capabilities,
                  const PermissionConfigurator::ClaimCapabilityAdditionalInfo _capInfo) :
         app(application), mnf(manifest), capabilities(_capabilities), capInfo(_capInfo), claimType(CLAIM_TYPE_NOT_SET),
-        manifestApproved(
-            false) { }
+        manifestApproved(false), rememberDecision(false) { }
 
   private:
 
@@ -186,6 +210,7 @@ class ClaimContext {
 
     PermissionConfigurator::ClaimCapabilities claimType;
     bool manifestApproved;
+    bool rememberDecision;
 };
 
 /**
@@ -0,0 +1,50 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_CLAIMRESULTLISTENER_H_
+#define ALLJOYN_SECMGR_CLAIMRESULTLISTENER_H_
+
+#include <alljoyn/Status.h>
+
+#include "Application.h"
+
+namespace ajn {
+namespace securitymgr {
+class ClaimResultListener {
+  public:
+    /**
+     * @brief Callback that is triggered when claiming one of the applications
+     *        passed to SecurityAgent::ClaimApplications has finished. It can be
+     *        called concurrently for different applications.
+     *
+     * @param[in] app     The application that was (attempted to be) claimed.
+     * @param[in] status  The result of claiming the application, as it would
+     *                    have been returned by SecurityAgent::Claim.
+     */
+    virtual void OnClaimResult(const OnlineApplication& app,
+                               QStatus status) = 0;
+
+    /**
+     * @brief Virtual destructor for derivable class.
+     */
+    virtual ~ClaimResultListener() { };
+
+  protected:
+    ClaimResultListener() { };
+};
+}
+}
+#endif /* ALLJOYN_SECMGR_CLAIMRESULTLISTENER_H_ */
@@ -17,6 +17,8 @@
 #ifndef ALLJOYN_SECMGR_SECURITYAGENT_H_
 #define ALLJOYN_SECMGR_SECURITYAGENT_H_
 
+#include <memory>
+
 #include <alljoyn/Status.h>
 #include <alljoyn/AllJoynStd.h>
 #include <alljoyn/PermissionConfigurator.h>
@@ -26,12 +28,20 @@
 #include "IdentityInfo.h"
 #include "ApplicationListener.h"
 #include "ClaimListener.h"
+#include "ClaimHandle.h"
+#include "ClaimResultListener.h"
 #include "Manifest.h"
 
 using namespace qcc;
 
 namespace ajn {
 namespace securitymgr {
+/* Default time (in ms) during which state changes are collected for a batched listener. */
+#define APPLICATION_LISTENER_DEFAULT_BATCH_WINDOW 100
+
+/* Default number of applications that ClaimApplications claims concurrently. */
+#define CLAIM_APPLICATIONS_DEFAULT_MAX_IN_FLIGHT 4
+
 class SecurityAgent {
   public:
 
@@ -62,6 +72,58 @@ class SecurityAgent {
     virtual QStatus Claim(const OnlineApplication& app,
                           const IdentityInfo& idInfo) = 0;
 
+    /**
+     * @brief Claim a set of remote applications, assigning all of them the
+     * same identity. Each application is claimed as by Claim, but up to
+     * maxInFlight applications are handled concurrently: while one
+     * application is being claimed, the manifest of the next one can already
+     * be fetched and approved, and its identity certificate be signed.
+     *
+     * This method returns when all applications have been handled. The
+     * ClaimListener can be called concurrently for different applications.
+     *
+     * @param[in] apps         The applications that will be claimed.
+     * @param[in] idInfo       The identity that should be assigned to the
+     *                         applications.
+     * @param[in] listener     Listener that is called with the result of each
+     *                         application as soon as it is known, or nullptr.
+     *                         The security agent does not take ownership of
+     *                         the passed pointer.
+     * @param[in] maxInFlight  The maximum number of applications that are
+     *                         claimed concurrently.
+     *
+     * @return ER_OK    If all applications were claimed successfully.
+     * @return ER_FAIL  If at least one application could not be claimed; the
+     *                  listener is informed about the reason.
+     *                  This is also returned when no ClaimListener is
+     *                  registered; the listener is not called then.
+     */
+    virtual QStatus ClaimApplications(const vector<OnlineApplication>& apps,
+                                      const IdentityInfo& idInfo,
+                                      ClaimResultListener* listener,
+                                      size_t maxInFlight = CLAIM_APPLICATIONS_DEFAULT_MAX_IN_FLIGHT) = 0;
+
+    /**
+     * @brief Claim a remote application without blocking the caller. The
+     * claim is done as by Claim, but on a worker thread of the security
+     * agent.
+     *
+     * @param[in]  app       The application that will be claimed.
+     * @param[in]  idInfo    The identity that should be assigned to the
+     *                       application.
+     * @param[in]  listener  Listener that is called with the result of the
+     *                       claim, or nullptr. The security agent does not
+     *                       take ownership of the passed pointer.
+     * @param[out] handle    Handle to follow, wait for or cancel the claim.
+     *
+     * @return ER_OK    If the claim was started.
+     * @return ER_FAIL  If no ClaimListener is registered.
+     */
+    virtual QStatus ClaimAsync(const OnlineApplication& app,
+                               const IdentityInfo& idInfo,
+                               ClaimResultListener* listener,
+                               shared_ptr<ClaimHandle>& handle) = 0;
+
     /**
      * @brief Register a ClaimListener to the security agent, which will
      * be called during Claim.
@@ -85,6 +147,26 @@ class SecurityAgent {
      */
     virtual void RegisterApplicationListener(ApplicationListener* applicationListener) = 0;
 
+    /**
+     * @brief Add an ApplicationListener that receives application state
+     * changes in batches through OnApplicationStateChanges. Changes are
+     * collected during a short window, so bursts of changes (e.g., during
+     * discovery) result in few callbacks. Sync errors and manifest updates
+     * are still reported one by one, in order with the state changes.
+     *
+     * Every listener is called from its own thread, so a slow listener does
+     * not delay the others.
+     *
+     * @param[in] applicationListener  A new ApplicationListener. The security
+     *                                 agent does not take ownership of the
+     *                                 passed pointer.
+     * @param[in] batchWindow          Time (in ms) to collect changes for a
+     *                                 batch.
+     */
+    virtual void RegisterBatchedApplicationListener(ApplicationListener* applicationListener,
+                                                    uint32_t batchWindow =
+                                                        APPLICATION_LISTENER_DEFAULT_BATCH_WINDOW) = 0;
+
     /**
      * @brief Remove a previously registered ApplicationListener.
      *
@@ -114,6 +196,30 @@ class SecurityAgent {
      */
     virtual QStatus GetApplication(OnlineApplication& app) const = 0;
 
+    /**
+     * @brief Retrieve the online applications that changed since a given
+     * version of the set of online applications. This allows to follow the
+     * online applications by polling, without copying all of them each time.
+     *
+     * An application that left the bus is reported without a bus name. Unless
+     * it is managed, it is forgotten afterwards.
+     *
+     * If the version is too old for the changes to be known, all known
+     * applications are returned; applications that are not among them have
+     * been forgotten.
+     *
+     * @param[in,out] version  The version returned by the previous call, or 0
+     *                         to retrieve all applications. Set to the current
+     *                         version on return.
+     * @param[in,out] apps     The current information of the applications that
+     *                         changed since the given version.
+     *
+     * @return ER_OK   On success.
+     * @return Others  On failure.
+     */
+    virtual QStatus GetApplicationChanges(uint64_t& version,
+                                          vector<OnlineApplication>& apps) const = 0;
+
     /**
      * @brief This method will synchronize (all) claimed applications with the
      * persistent storage in an asynchronous manner.
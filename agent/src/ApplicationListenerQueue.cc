@@ -0,0 +1,153 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "ApplicationListenerQueue.h"
+
+#include <map>
+
+#include <qcc/Debug.h>
+#include <qcc/Thread.h>
+
+#define QCC_MODULE "SECMGR_AGENT"
+
+namespace ajn {
+namespace securitymgr {
+ApplicationListenerQueue::ApplicationListenerQueue(ApplicationListener* _listener,
+                                                   uint32_t _batchWindow) :
+    listener(_listener), batchWindow(_batchWindow), removed(false), pendingHighWaterMark(0), delivered(0),
+    flusher(this)
+{
+}
+
+ApplicationListenerQueue::~ApplicationListenerQueue()
+{
+    flusher.Stop();
+
+    TaskQueueStats stats = flusher.GetStats();
+    lock.Lock(__FILE__, __LINE__);
+    QCC_DbgHLPrintf(("Listener queue: %u events pending, at most %u, %llu delivered in %llu flushes, "
+                     "max latency %llu ms",
+                     (unsigned)pending.size(), (unsigned)pendingHighWaterMark, (unsigned long long)delivered,
+                     (unsigned long long)stats.priorities[0].handled,
+                     (unsigned long long)stats.priorities[0].maxLatency));
+    lock.Unlock(__FILE__, __LINE__);
+}
+
+void ApplicationListenerQueue::Add(const shared_ptr<AppListenerEvent>& event)
+{
+    lock.Lock(__FILE__, __LINE__);
+    if (removed) {
+        lock.Unlock(__FILE__, __LINE__);
+        return;
+    }
+    bool idle = pending.empty();
+    pending.push_back(event);
+    if (pending.size() > pendingHighWaterMark) {
+        pendingHighWaterMark = pending.size();
+    }
+    lock.Unlock(__FILE__, __LINE__);
+
+    if (idle) {
+        flusher.AddTask(new ListenerFlush());
+    }
+}
+
+void ApplicationListenerQueue::Remove()
+{
+    deliveryLock.Lock(__FILE__, __LINE__);
+    lock.Lock(__FILE__, __LINE__);
+    removed = true;
+    pending.clear();
+    lock.Unlock(__FILE__, __LINE__);
+    deliveryLock.Unlock(__FILE__, __LINE__);
+}
+
+void ApplicationListenerQueue::HandleTask(ListenerFlush* flush)
+{
+    QCC_UNUSED(flush);
+
+    if (batchWindow > 0) {
+        // Let the changes of a burst accumulate.
+        qcc::Sleep(batchWindow);
+    }
+
+    vector<shared_ptr<AppListenerEvent> > events;
+    lock.Lock(__FILE__, __LINE__);
+    events.swap(pending);
+    lock.Unlock(__FILE__, __LINE__);
+
+    if (events.empty()) {
+        return;
+    }
+
+    deliveryLock.Lock(__FILE__, __LINE__);
+    if (!removed) {
+        Deliver(events);
+        lock.Lock(__FILE__, __LINE__);
+        delivered += events.size();
+        lock.Unlock(__FILE__, __LINE__);
+    }
+    deliveryLock.Unlock(__FILE__, __LINE__);
+}
+
+void ApplicationListenerQueue::Deliver(const vector<shared_ptr<AppListenerEvent> >& events)
+{
+    vector<ApplicationStateChange> batch;
+    map<KeyInfoNISTP256, size_t> batched; // Index in batch per application.
+
+    for (size_t i = 0; i < events.size(); i++) {
+        const AppListenerEvent* event = events[i].get();
+        if ((event->syncError == nullptr) && (event->manifestUpdate == nullptr)) {
+            if (batchWindow == 0) {
+                listener->OnApplicationStateChange(event->oldApp, event->newApp);
+                continue;
+            }
+            const OnlineApplication* app = event->newApp ? event->newApp : event->oldApp;
+            map<KeyInfoNISTP256, size_t>::iterator it = batched.find(app->keyInfo);
+            if (it == batched.end()) {
+                batched[app->keyInfo] = batch.size();
+                batch.push_back(ApplicationStateChange(event->oldApp, event->newApp));
+            } else {
+                // Report the change from the first known to the last known state.
+                batch[it->second].newApp = event->newApp;
+            }
+            continue;
+        }
+
+        // Keep other events in order with the state changes.
+        DeliverBatch(batch);
+        batched.clear();
+        if (event->syncError) {
+            listener->OnSyncError(event->syncError);
+        } else {
+            listener->OnManifestUpdate(event->manifestUpdate);
+        }
+    }
+    DeliverBatch(batch);
+}
+
+void ApplicationListenerQueue::DeliverBatch(vector<ApplicationStateChange>& batch)
+{
+    if (batch.empty()) {
+        return;
+    }
+    QCC_DbgPrintf(("Delivering %u application state changes", (unsigned)batch.size()));
+    listener->OnApplicationStateChanges(batch);
+    batch.clear();
+}
+}
+}
+#undef QCC_MODULE
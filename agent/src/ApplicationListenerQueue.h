@@ -0,0 +1,161 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_APPLICATIONLISTENERQUEUE_H_
+#define ALLJOYN_SECMGR_APPLICATIONLISTENERQUEUE_H_
+
+#include <memory>
+#include <vector>
+
+#include <qcc/Mutex.h>
+
+#include <alljoyn/securitymgr/Application.h>
+#include <alljoyn/securitymgr/ApplicationListener.h>
+#include <alljoyn/securitymgr/ManifestUpdate.h>
+#include <alljoyn/securitymgr/SyncError.h>
+
+#include "TaskQueue.h"
+
+using namespace std;
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+/**
+ * @brief An event for the ApplicationListeners. One event is shared by the
+ *        queues of all listeners.
+ */
+class AppListenerEvent {
+  public:
+    AppListenerEvent(const OnlineApplication* _oldInfo,
+                     const OnlineApplication* _newInfo) :
+        oldApp(nullptr), newApp(nullptr), syncError(nullptr), manifestUpdate(nullptr)
+    {
+        if (_oldInfo != nullptr) {
+            oldInfo = *_oldInfo;
+            oldApp = &oldInfo;
+        }
+        if (_newInfo != nullptr) {
+            newInfo = *_newInfo;
+            newApp = &newInfo;
+        }
+    }
+
+    AppListenerEvent(const SyncError* _error) :
+        oldApp(nullptr), newApp(nullptr), syncError(_error), manifestUpdate(nullptr)
+    {
+    }
+
+    AppListenerEvent(const ManifestUpdate* _manifestUpdate) :
+        oldApp(nullptr), newApp(nullptr), syncError(nullptr), manifestUpdate(_manifestUpdate)
+    {
+    }
+
+    ~AppListenerEvent()
+    {
+        delete syncError;
+        syncError = nullptr;
+        delete manifestUpdate;
+        manifestUpdate = nullptr;
+    }
+
+    const OnlineApplication* oldApp;
+    const OnlineApplication* newApp;
+    const SyncError* syncError;
+    const ManifestUpdate* manifestUpdate;
+
+  private:
+    AppListenerEvent(const AppListenerEvent& other);
+    AppListenerEvent& operator=(const AppListenerEvent& other);
+
+    OnlineApplication oldInfo;
+    OnlineApplication newInfo;
+};
+
+/**
+ * @brief Task that makes the queue of a listener deliver its pending events.
+ */
+struct ListenerFlush {
+};
+
+/**
+ * @brief Delivers the events of a single ApplicationListener on its own
+ *        worker, so a slow listener does not delay the others. In batched
+ *        mode, state changes arriving within the batch window are delivered
+ *        together, with the changes of each application coalesced.
+ */
+class ApplicationListenerQueue {
+  public:
+    /**
+     * @param[in] _listener     The listener; no ownership is taken.
+     * @param[in] _batchWindow  Time (in ms) to collect state changes before
+     *                          delivering them in a batch, or 0 to deliver
+     *                          every change on its own.
+     */
+    ApplicationListenerQueue(ApplicationListener* _listener,
+                             uint32_t _batchWindow);
+
+    /**
+     * @brief Stop delivering events and log the load of the queue.
+     */
+    ~ApplicationListenerQueue();
+
+    void Add(const shared_ptr<AppListenerEvent>& event);
+
+    /**
+     * @brief Drop all pending events. The listener is no longer called once
+     *        this returns, unless it is called from within the listener.
+     */
+    void Remove();
+
+    /**
+     * @brief Check whether the listener is no longer called after Remove,
+     *        so that the queue can be deleted.
+     */
+    bool IsIdle()
+    {
+        return flusher.IsIdle();
+    }
+
+    ApplicationListener* GetListener() const
+    {
+        return listener;
+    }
+
+    void HandleTask(ListenerFlush* flush);
+
+  private:
+    ApplicationListenerQueue(const ApplicationListenerQueue& other);
+    ApplicationListenerQueue& operator=(const ApplicationListenerQueue& other);
+
+    void Deliver(const vector<shared_ptr<AppListenerEvent> >& events);
+
+    void DeliverBatch(vector<ApplicationStateChange>& batch);
+
+    ApplicationListener* listener;
+    uint32_t batchWindow;
+    bool removed;
+    size_t pendingHighWaterMark; // The maximum number of pending events so far.
+    uint64_t delivered;          // The number of events delivered to the listener.
+    Mutex lock;         // Guards pending, removed and the counters.
+    Mutex deliveryLock; // Held while the listener is called.
+    vector<shared_ptr<AppListenerEvent> > pending;
+    TaskQueue<ListenerFlush*, ApplicationListenerQueue> flusher;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_APPLICATIONLISTENERQUEUE_H_ */
@@ -17,6 +17,7 @@
 #include "ApplicationMonitor.h"
 
 #include <qcc/Debug.h>
+#include <qcc/time.h>
 
 #include <alljoyn/securitymgr/Util.h>
 
@@ -28,7 +29,7 @@ using namespace qcc;
 namespace ajn {
 namespace securitymgr {
 ApplicationMonitor::ApplicationMonitor(BusAttachment* ba) :
-    busAttachment(ba)
+    busAttachment(ba), dispatcher(this)
 {
     QStatus status = ER_FAIL;
 
@@ -37,6 +38,7 @@ ApplicationMonitor::ApplicationMonitor(BusAttachment* ba) :
         return;
     }
 
+    busAttachment->RegisterBusListener(*this);
     busAttachment->RegisterApplicationStateListener(*this);
     busAttachment->AddApplicationStateRule();
 }
@@ -45,6 +47,9 @@ ApplicationMonitor::~ApplicationMonitor()
 {
     busAttachment->RemoveApplicationStateRule();
     busAttachment->UnregisterApplicationStateListener(*this);
+    busAttachment->UnregisterBusListener(*this);
+    dispatcher.Stop();
+    LogDispatchStats();
 }
 
 void ApplicationMonitor::State(const char* busName,
@@ -66,30 +71,195 @@ void ApplicationMonitor::State(const char* busName,
     QCC_DbgPrintf(("busName = %s", info.busName.c_str()));
     QCC_DbgPrintf(("applicationState = %s", PermissionConfigurator::ToString(state)));
 
+    QueueEvent(info, false);
+}
+
+void ApplicationMonitor::NameOwnerChanged(const char* busName,
+                                          const char* previousOwner,
+                                          const char* newOwner)
+{
+    QCC_UNUSED(previousOwner);
+
+    // Only the unique names of departed applications are of interest.
+    if ((nullptr == busName) || (':' != busName[0]) || ((nullptr != newOwner) && ('\0' != newOwner[0]))) {
+        return;
+    }
+
+    SecurityInfo info;
+    info.busName = busName;
+    QueueEvent(info, true);
+}
+
+void ApplicationMonitor::QueueEvent(const SecurityInfo& info,
+                                    bool departed)
+{
+    pendingEventsMutex.Lock(__FILE__, __LINE__);
+    dispatchStats.signals++;
+    map<string, MonitorEvent*>::iterator it = pendingEvents.find(info.busName);
+    if (it != pendingEvents.end()) {
+        // Only the latest state of a bus name is of interest.
+        MonitorEvent* event = it->second;
+        if (departed) {
+            event->departed = true;
+        } else {
+            event->info = info;
+        }
+        event->signals++;
+        pendingEventsMutex.Unlock(__FILE__, __LINE__);
+        return;
+    }
+
+    MonitorEvent* event = new MonitorEvent();
+    event->info = info;
+    event->departed = departed;
+    event->received = GetTimestamp64();
+    event->signals = 1;
+    pendingEvents[info.busName] = event;
+    QStatus status = dispatcher.AddTask(event);
+    if (ER_OK != status) {
+        // The dispatcher deleted the event.
+        QCC_LogError(status, ("Failed to queue event for %s", info.busName.c_str()));
+        pendingEvents.erase(info.busName);
+    }
+    pendingEventsMutex.Unlock(__FILE__, __LINE__);
+}
+
+void ApplicationMonitor::HandleTask(MonitorEvent* event)
+{
+    // Once taken out of the pending events, later signals are queued anew.
+    pendingEventsMutex.Lock(__FILE__, __LINE__);
+    map<string, MonitorEvent*>::iterator it = pendingEvents.find(event->info.busName);
+    if ((it != pendingEvents.end()) && (it->second == event)) {
+        pendingEvents.erase(it);
+    }
+    pendingEventsMutex.Unlock(__FILE__, __LINE__);
+
+    if (event->departed) {
+        HandleDeparture(event->info.busName);
+    } else {
+        HandleState(event->info);
+    }
+
+    uint64_t latency = GetTimestamp64() - event->received;
+    pendingEventsMutex.Lock(__FILE__, __LINE__);
+    dispatchStats.handled++;
+    dispatchStats.totalLatency += latency;
+    if (latency > dispatchStats.maxLatency) {
+        dispatchStats.maxLatency = latency;
+    }
+    pendingEventsMutex.Unlock(__FILE__, __LINE__);
+    QCC_DbgPrintf(("Handled %u signals of %s in %llu ms", event->signals,
+                   event->info.busName.c_str(), (unsigned long long)latency));
+}
+
+void ApplicationMonitor::HandleState(const SecurityInfo& info)
+{
     appsMutex.Lock(__FILE__, __LINE__);
 
-    map<string, SecurityInfo>::iterator it = applications.find(info.busName);
+    // A bus name that was used by another key belongs to an application that
+    // was reset or replaced; that application is gone.
+    SecurityInfo replacedInfo;
+    bool replaced = false;
+    unordered_map<string, KeyInfoNISTP256>::iterator nameIt = busNames.find(info.busName);
+    if ((nameIt != busNames.end()) && !(nameIt->second == info.keyInfo)) {
+        unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::iterator replacedIt =
+            applications.find(nameIt->second);
+        if (replacedIt != applications.end()) {
+            replacedInfo = replacedIt->second;
+            replaced = true;
+            Forget(replacedIt);
+        }
+    }
+
+    unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::iterator it = applications.find(info.keyInfo);
     if (it != applications.end()) {
-        // known bus name
+        // known application, possibly on a new bus name
         SecurityInfo oldInfo = it->second;
+        bool moved = (oldInfo.busName != info.busName);
+        if (moved) {
+            busNames.erase(oldInfo.busName);
+        }
         it->second = info;
+        busNames[info.busName] = info.keyInfo;
         appsMutex.Unlock(__FILE__, __LINE__);
-        NotifySecurityInfoListeners(&oldInfo, &info);
+        if (replaced) {
+            NotifySecurityInfoListeners(&replacedInfo, nullptr);
+        }
+        if (moved) {
+            // The application reconnected: it left its old bus name and was
+            // discovered on a new one. Listeners that act on discovery (e.g.,
+            // the updater that syncs newly discovered applications) must see
+            // it as such rather than as an update.
+            NotifySecurityInfoListeners(&oldInfo, nullptr);
+            NotifySecurityInfoListeners(nullptr, &info);
+        } else {
+            NotifySecurityInfoListeners(&oldInfo, &info);
+        }
     } else {
-        // new bus name
-        applications[info.busName] = info;
+        // new application
+        applications[info.keyInfo] = info;
+        busNames[info.busName] = info.keyInfo;
         appsMutex.Unlock(__FILE__, __LINE__);
+        if (replaced) {
+            NotifySecurityInfoListeners(&replacedInfo, nullptr);
+        }
         NotifySecurityInfoListeners(nullptr, &info);
     }
 }
 
+void ApplicationMonitor::HandleDeparture(const string& busName)
+{
+    appsMutex.Lock(__FILE__, __LINE__);
+    unordered_map<string, KeyInfoNISTP256>::iterator nameIt = busNames.find(busName);
+    if (nameIt == busNames.end()) {
+        appsMutex.Unlock(__FILE__, __LINE__);
+        return;
+    }
+    unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::iterator it = applications.find(nameIt->second);
+    if (it == applications.end()) {
+        busNames.erase(nameIt);
+        appsMutex.Unlock(__FILE__, __LINE__);
+        return;
+    }
+    SecurityInfo oldInfo = it->second;
+    Forget(it);
+    appsMutex.Unlock(__FILE__, __LINE__);
+
+    QCC_DbgPrintf(("Application %s left the bus", busName.c_str()));
+    NotifySecurityInfoListeners(&oldInfo, nullptr);
+}
+
+MonitorDispatchStats ApplicationMonitor::GetDispatchStats() const
+{
+    pendingEventsMutex.Lock(__FILE__, __LINE__);
+    MonitorDispatchStats stats = dispatchStats;
+    pendingEventsMutex.Unlock(__FILE__, __LINE__);
+    return stats;
+}
+
+void ApplicationMonitor::LogDispatchStats() const
+{
+    MonitorDispatchStats stats = GetDispatchStats();
+    QCC_DbgHLPrintf(("%llu signals handled as %llu events, average latency %llu ms, max latency %llu ms",
+                     (unsigned long long)stats.signals, (unsigned long long)stats.handled,
+                     (unsigned long long)(stats.handled == 0 ? 0 : stats.totalLatency / stats.handled),
+                     (unsigned long long)stats.maxLatency));
+}
+
+void ApplicationMonitor::Forget(unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::iterator it)
+{
+    busNames.erase(it->second.busName);
+    applications.erase(it);
+}
+
 vector<SecurityInfo> ApplicationMonitor::GetApplications() const
 {
     appsMutex.Lock(__FILE__, __LINE__);
 
     if (!applications.empty()) {
         vector<SecurityInfo> apps;
-        map<string, SecurityInfo>::const_iterator it = applications.begin();
+        apps.reserve(applications.size());
+        unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::const_iterator it = applications.begin();
         for (; it != applications.end(); ++it) {
             const SecurityInfo& app = it->second;
             apps.push_back(app);
@@ -104,7 +274,24 @@ vector<SecurityInfo> ApplicationMonitor::GetApplications() const
 QStatus ApplicationMonitor::GetApplication(SecurityInfo& secInfo) const
 {
     appsMutex.Lock(__FILE__, __LINE__);
-    map<string, SecurityInfo>::const_iterator it  = applications.find(secInfo.busName);
+    unordered_map<string, KeyInfoNISTP256>::const_iterator nameIt = busNames.find(secInfo.busName);
+    if (nameIt != busNames.end()) {
+        unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::const_iterator it = applications.find(nameIt->second);
+        if (it != applications.end()) {
+            secInfo = it->second;
+            appsMutex.Unlock(__FILE__, __LINE__);
+            return ER_OK;
+        }
+    }
+    appsMutex.Unlock(__FILE__, __LINE__);
+    return ER_FAIL;
+}
+
+QStatus ApplicationMonitor::GetApplication(const KeyInfoNISTP256& keyInfo,
+                                           SecurityInfo& secInfo) const
+{
+    appsMutex.Lock(__FILE__, __LINE__);
+    unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::const_iterator it = applications.find(keyInfo);
     if (it != applications.end()) {
         secInfo = it->second;
         appsMutex.Unlock(__FILE__, __LINE__);
@@ -119,7 +306,7 @@ void ApplicationMonitor::RegisterSecurityInfoListener(SecurityInfoListener* al)
     if (nullptr != al) {
         appsMutex.Lock(__FILE__, __LINE__);
         securityListenersMutex.Lock(__FILE__, __LINE__);
-        map<string, SecurityInfo>::const_iterator it = applications.begin();
+        unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::const_iterator it = applications.begin();
         for (; it != applications.end(); ++it) {
             al->OnSecurityStateChange(nullptr, &(it->second));
         }
@@ -20,6 +20,7 @@
 #include <vector>
 #include <map>
 #include <string>
+#include <unordered_map>
 
 #include <qcc/Debug.h>
 #include <qcc/String.h>
@@ -27,7 +28,9 @@
 
 #include <alljoyn/BusAttachment.h>
 #include <alljoyn/ApplicationStateListener.h>
+#include <alljoyn/BusListener.h>
 
+#include "ApplicationSnapshot.h"
 #include "SecurityInfo.h"
 #include "SecurityInfoListener.h"
 #include "TaskQueue.h"
@@ -37,14 +40,56 @@ using namespace qcc;
 
 namespace ajn {
 namespace securitymgr {
+/**
+ * @brief A signal of the bus, waiting to be handled by the dispatcher of the
+ *        ApplicationMonitor. Signals of the same bus name that arrive before
+ *        the first one is handled are merged into it.
+ */
+struct MonitorEvent {
+    SecurityInfo info;
+    bool departed;     // The bus name left the bus.
+    uint64_t received; // Timestamp (in ms) of the first merged signal.
+    uint32_t signals;  // The number of merged signals.
+
+    MonitorEvent() :
+        departed(false), received(0), signals(0) { }
+};
+
+/**
+ * @brief Counters describing the signals handled by an ApplicationMonitor.
+ */
+struct MonitorDispatchStats {
+    uint64_t signals;      ///< The number of signals received.
+    uint64_t handled;      ///< The number of events handled; merged signals count once.
+    uint64_t totalLatency; ///< The total time (in ms) from signal to handled event.
+    uint64_t maxLatency;   ///< The longest time (in ms) from signal to handled event.
+
+    MonitorDispatchStats() :
+        signals(0), handled(0), totalLatency(0), maxLatency(0) { }
+};
+
+/**
+ * @brief Tracks the security state of the applications on the bus. An
+ *        application is forgotten as soon as its bus name leaves the bus, so
+ *        the monitor only holds the applications that are online.
+ *
+ *        Signals are handed over to a dispatcher thread, so the bus thread
+ *        is not held up by slow listeners.
+ */
 class ApplicationMonitor :
-    public ApplicationStateListener {
+    public ApplicationStateListener,
+    public BusListener {
   private:
-    map<string, SecurityInfo> applications; /* key = busName */
+    unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash> applications; /* key = public key */
+    unordered_map<string, KeyInfoNISTP256> busNames; /* index on busName */
     vector<SecurityInfoListener*> listeners; /* no ownership */
     BusAttachment* busAttachment;
     mutable Mutex securityListenersMutex;
     mutable Mutex appsMutex;
+    map<string, MonitorEvent*> pendingEvents; /* Queued events per busName; owned by the dispatcher. */
+    MonitorDispatchStats dispatchStats;
+    mutable Mutex pendingEventsMutex; /* Guards pendingEvents and dispatchStats. */
+    TaskQueue<MonitorEvent*, ApplicationMonitor> dispatcher;
 
     ApplicationMonitor();
 
@@ -54,6 +99,22 @@ class ApplicationMonitor :
                const KeyInfoNISTP256& publicKeyInfo,
                PermissionConfigurator::ApplicationState state);
 
+    void NameOwnerChanged(const char* busName,
+                          const char* previousOwner,
+                          const char* newOwner);
+
+    void QueueEvent(const SecurityInfo& info,
+                    bool departed);
+
+    void HandleState(const SecurityInfo& info);
+
+    void HandleDeparture(const string& busName);
+
+    void LogDispatchStats() const;
+
+    // Must be called with the appsMutex held.
+    void Forget(unordered_map<KeyInfoNISTP256, SecurityInfo, KeyInfoHash>::iterator it);
+
     void NotifySecurityInfoListeners(const SecurityInfo* oldSecInfo,
                                      const SecurityInfo* newSecInfo);
 
@@ -64,11 +125,24 @@ class ApplicationMonitor :
 
     vector<SecurityInfo> GetApplications() const;
 
+    /**
+     * @brief Look up an online application on the busName of secInfo.
+     */
     QStatus GetApplication(SecurityInfo& secInfo) const;
 
+    /**
+     * @brief Look up an online application on its public key.
+     */
+    QStatus GetApplication(const KeyInfoNISTP256& keyInfo,
+                           SecurityInfo& secInfo) const;
+
     void RegisterSecurityInfoListener(SecurityInfoListener* al);
 
     void UnregisterSecurityInfoListener(SecurityInfoListener* al);
+
+    MonitorDispatchStats GetDispatchStats() const;
+
+    void HandleTask(MonitorEvent* event);
 };
 }
 }
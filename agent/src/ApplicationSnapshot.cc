@@ -0,0 +1,154 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "ApplicationSnapshot.h"
+
+namespace ajn {
+namespace securitymgr {
+size_t KeyInfoHash::operator()(const KeyInfoNISTP256& keyInfo) const
+{
+    // The coordinates of a public key are uniformly distributed, so a few
+    // bytes of X make a good fingerprint. FNV-1a folds them into a size_t.
+    const ECCPublicKey* publicKey = keyInfo.GetPublicKey();
+    size_t hash = 2166136261U;
+    if (publicKey != nullptr) {
+        const uint8_t* x = publicKey->GetX();
+        size_t size = publicKey->GetCoordinateSize();
+        for (size_t i = 0; (i < size) && (i < 16); i++) {
+            hash = (hash ^ x[i]) * 16777619U;
+        }
+    }
+    return hash;
+}
+
+ApplicationSnapshot::ApplicationSnapshot() :
+    version(0)
+{
+}
+
+void ApplicationSnapshot::Unindex(const OnlineApplication& old)
+{
+    const KeyInfoNISTP256* owner = old.busName.empty() ? nullptr : busNames.Find(old.busName);
+    // The bus name may have been taken over by another application.
+    if ((owner != nullptr) && (*owner == old.keyInfo)) {
+        busNames = busNames.Erase(old.busName);
+    }
+    byState[old.applicationState] = byState[old.applicationState].Erase(old.keyInfo);
+    bySyncState[old.syncState] = bySyncState[old.syncState].Erase(old.keyInfo);
+}
+
+shared_ptr<const ApplicationSnapshot> ApplicationSnapshot::With(const OnlineApplication& app) const
+{
+    shared_ptr<ApplicationSnapshot> next(new ApplicationSnapshot(*this));
+
+    const OnlineApplication* old = applications.Find(app.keyInfo);
+    if (old != nullptr) {
+        next->Unindex(*old);
+    }
+
+    next->applications = applications.Set(app.keyInfo, app);
+    if (!app.busName.empty()) {
+        next->busNames = next->busNames.Set(app.busName, app.keyInfo);
+    }
+    next->byState[app.applicationState] = next->byState[app.applicationState].Set(app.keyInfo, true);
+    next->bySyncState[app.syncState] = next->bySyncState[app.syncState].Set(app.keyInfo, true);
+    next->version = version + 1;
+    return next;
+}
+
+shared_ptr<const ApplicationSnapshot> ApplicationSnapshot::Without(const KeyInfoNISTP256& key) const
+{
+    shared_ptr<ApplicationSnapshot> next(new ApplicationSnapshot(*this));
+
+    const OnlineApplication* old = applications.Find(key);
+    if (old != nullptr) {
+        next->Unindex(*old);
+        next->applications = applications.Erase(key);
+    }
+    next->version = version + 1;
+    return next;
+}
+
+const OnlineApplication* ApplicationSnapshot::Find(const KeyInfoNISTP256& key) const
+{
+    return applications.Find(key);
+}
+
+const OnlineApplication* ApplicationSnapshot::FindByBusName(const string& busName) const
+{
+    const KeyInfoNISTP256* key = busNames.Find(busName);
+    return (key == nullptr) ? nullptr : applications.Find(*key);
+}
+
+/* Collects the applications of the visited keys. */
+class ApplicationCollector {
+  public:
+    ApplicationCollector(const PersistentHashMap<KeyInfoNISTP256, OnlineApplication, KeyInfoHash>& _applications,
+                         vector<OnlineApplication>& _apps) :
+        applications(_applications), apps(_apps) { }
+
+    void operator()(const KeyInfoNISTP256& key, bool present)
+    {
+        QCC_UNUSED(present);
+        const OnlineApplication* app = applications.Find(key);
+        if (app != nullptr) {
+            apps.push_back(*app);
+        }
+    }
+
+    void operator()(const KeyInfoNISTP256& key, const OnlineApplication& app)
+    {
+        QCC_UNUSED(key);
+        apps.push_back(app);
+    }
+
+  private:
+    const PersistentHashMap<KeyInfoNISTP256, OnlineApplication, KeyInfoHash>& applications;
+    vector<OnlineApplication>& apps;
+};
+
+void ApplicationSnapshot::GetByState(PermissionConfigurator::ApplicationState state,
+                                     vector<OnlineApplication>& apps) const
+{
+    map<PermissionConfigurator::ApplicationState, KeyMap>::const_iterator it = byState.find(state);
+    if (it == byState.end()) {
+        return;
+    }
+    apps.reserve(apps.size() + it->second.Size());
+    ApplicationCollector collector(applications, apps);
+    it->second.ForEach(collector);
+}
+
+void ApplicationSnapshot::GetBySyncState(ApplicationSyncState syncState,
+                                         vector<OnlineApplication>& apps) const
+{
+    map<ApplicationSyncState, KeyMap>::const_iterator it = bySyncState.find(syncState);
+    if (it == bySyncState.end()) {
+        return;
+    }
+    apps.reserve(apps.size() + it->second.Size());
+    ApplicationCollector collector(applications, apps);
+    it->second.ForEach(collector);
+}
+
+void ApplicationSnapshot::GetAll(vector<OnlineApplication>& apps) const
+{
+    apps.reserve(apps.size() + applications.Size());
+    ApplicationCollector collector(applications, apps);
+    applications.ForEach(collector);
+}
+}
+}
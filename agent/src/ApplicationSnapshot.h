@@ -0,0 +1,116 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_APPLICATIONSNAPSHOT_H_
+#define ALLJOYN_SECMGR_APPLICATIONSNAPSHOT_H_
+
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include <qcc/KeyInfoECC.h>
+
+#include <alljoyn/PermissionConfigurator.h>
+
+#include <alljoyn/securitymgr/Application.h>
+
+#include "PersistentHashMap.h"
+
+using namespace std;
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+/**
+ * @brief Hashes a key info on a fingerprint of its public key, which is far
+ *        cheaper than the ordered comparison of complete key infos.
+ */
+struct KeyInfoHash {
+    size_t operator()(const KeyInfoNISTP256& keyInfo) const;
+};
+
+/**
+ * @brief An immutable, versioned view on the online applications, indexed
+ *        by public key, bus name, application state and sync state. Readers
+ *        can share a snapshot without locking. A change creates a new
+ *        snapshot that shares all unchanged parts with its predecessor, so
+ *        it costs O(log N) regardless of the number of applications.
+ */
+class ApplicationSnapshot {
+  public:
+    typedef unordered_set<KeyInfoNISTP256, KeyInfoHash> KeySet;
+
+    ApplicationSnapshot();
+
+    /**
+     * @brief Create the next version of this snapshot, in which an
+     *        application is added or replaced.
+     */
+    shared_ptr<const ApplicationSnapshot> With(const OnlineApplication& app) const;
+
+    /**
+     * @brief Create the next version of this snapshot, in which an
+     *        application is removed.
+     */
+    shared_ptr<const ApplicationSnapshot> Without(const KeyInfoNISTP256& key) const;
+
+    uint64_t GetVersion() const
+    {
+        return version;
+    }
+
+    const OnlineApplication* Find(const KeyInfoNISTP256& key) const;
+
+    const OnlineApplication* FindByBusName(const string& busName) const;
+
+    void GetByState(PermissionConfigurator::ApplicationState state,
+                    vector<OnlineApplication>& apps) const;
+
+    void GetBySyncState(ApplicationSyncState syncState,
+                        vector<OnlineApplication>& apps) const;
+
+    void GetAll(vector<OnlineApplication>& apps) const;
+
+    size_t Size() const
+    {
+        return applications.Size();
+    }
+
+    bool Empty() const
+    {
+        return applications.Empty();
+    }
+
+  private:
+    /* Removes an application from the bus name and state indexes. */
+    void Unindex(const OnlineApplication& old);
+
+    typedef PersistentHashMap<KeyInfoNISTP256, OnlineApplication, KeyInfoHash> ApplicationMap;
+    typedef PersistentHashMap<KeyInfoNISTP256, bool, KeyInfoHash> KeyMap;
+    typedef PersistentHashMap<string, KeyInfoNISTP256, hash<string> > BusNameMap;
+
+    uint64_t version;
+    ApplicationMap applications;
+    BusNameMap busNames;
+    map<PermissionConfigurator::ApplicationState, KeyMap> byState;
+    map<ApplicationSyncState, KeyMap> bySyncState;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_APPLICATIONSNAPSHOT_H_ */
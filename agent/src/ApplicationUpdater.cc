@@ -17,6 +17,7 @@
 #include "ApplicationUpdater.h"
 #include <alljoyn/securitymgr/ManifestUpdate.h>
 
+#include <algorithm>
 #include <string>
 
 #include <qcc/Debug.h>
@@ -282,6 +283,14 @@ QStatus ApplicationUpdater::UpdateIdentity(ProxyObjectManager::ManagedProxyObjec
                 break;
             }
 
+            // Do not ask again for a manifest that was rejected before.
+            ManifestApproval approval;
+            if ((ER_OK == remoteManifest.GetDigest(approval.digest)) &&
+                (ER_OK == storage->GetManifestApproval(approval)) && !approval.approved) {
+                QCC_DbgPrintf(("Manifest update was rejected before"));
+                break;
+            }
+
             ManifestUpdate* mfUpdate = new ManifestUpdate(mngdProxy.GetApplication(), mf, remoteManifest);
             securityAgentImpl->NotifyApplicationListeners(mfUpdate);
         }
@@ -295,7 +304,8 @@ QStatus ApplicationUpdater::UpdateIdentity(ProxyObjectManager::ManagedProxyObjec
 }
 
 QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app,
-                                              const SecurityInfo& secInfo)
+                                              const SecurityInfo& secInfo,
+                                              bool forceRemoteCheck)
 {
     QStatus status = ER_FAIL;
     QCC_DbgPrintf(("Updating %s", secInfo.busName.c_str()));
@@ -339,34 +349,27 @@ QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app,
                 }
 
                 //Collect update info from storage.
-                vector<MembershipCertificateChain> persistedMembershipCerts;
-                if (ER_OK != (status = storage->GetMembershipCertificates(app, persistedMembershipCerts))) {
-                    QCC_DbgPrintf(("Failed to GetMembershipCertificates"));
+                SyncBundle bundle;
+                if (ER_OK != (status = storage->GetSyncBundle(app, bundle))) {
+                    QCC_LogError(status, ("Failed to retrieve desired state from storage"));
                     SyncError* error = new SyncError(app, status, SYNC_ER_STORAGE);
                     securityAgentImpl->NotifyApplicationListeners(error);
                     return status;
                 }
+                vector<MembershipCertificateChain>& persistedMembershipCerts = bundle.memberships;
+                IdentityCertificateChain& persistedIdCerts = bundle.identityCertificates;
+                Manifest& mf = bundle.manifest;
+                PermissionPolicy* persistedPolicy = bundle.hasPolicy ? &bundle.policy : nullptr;
                 QCC_DbgPrintf(("Found %i local membership certificates", persistedMembershipCerts.size()));
 
-                IdentityCertificateChain persistedIdCerts;
-                Manifest mf;
-                if (ER_OK != (status = storage->GetIdentityCertificatesAndManifest(app, persistedIdCerts, mf))) {
-                    SyncError* error = new SyncError(app, status, SYNC_ER_STORAGE);
-                    QCC_LogError(status, ("Could not get identity certificate from storage"));
-                    securityAgentImpl->NotifyApplicationListeners(error);
-                    return status;
-                }
+                uint8_t syncDigest[Crypto_SHA256::DIGEST_SIZE];
+                bool hasSyncDigest = (ER_OK == ComputeSyncDigest(persistedMembershipCerts, persistedIdCerts,
+                                                                 persistedPolicy, syncDigest));
+                bool unchangedLocally = hasSyncDigest && !forceRemoteCheck &&
+                                        (PermissionConfigurator::CLAIMED == app.applicationState) &&
+                                        bundle.hasSyncDigest &&
+                                        (memcmp(bundle.syncDigest, syncDigest, Crypto_SHA256::DIGEST_SIZE) == 0);
 
-                PermissionPolicy policy;
-                status = storage->GetPolicy(app, policy);
-                if (ER_OK != status && ER_END_OF_DATA != status) {
-                    QCC_LogError(status, ("Failed to retrieve local policy"));
-                    SyncError* error = new SyncError(app, status, SYNC_ER_STORAGE);
-                    securityAgentImpl->NotifyApplicationListeners(error);
-                    return status;
-                }
-                QCC_DbgPrintf(("GetPolicy from storage returned %i", status));
-                PermissionPolicy* persistedPolicy = status == ER_OK ? &policy : nullptr;
                 //Connect to remote app
                 ProxyObjectManager::ManagedProxyObject mngdProxy(app);
                 status = proxyObjectManager->GetProxyObject(mngdProxy);
@@ -379,6 +382,23 @@ QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app,
                     return status;
                 }
 
+                if (unchangedLocally) {
+                    // The application may have been changed by someone else
+                    // (e.g., another agent or a factory reset of its policy);
+                    // its policy version is a single cheap call that shows so.
+                    uint32_t remoteVersion = 0;
+                    if ((ER_OK == mngdProxy.GetPolicyVersion(remoteVersion)) &&
+                        IsUnchangedSinceLastSync(bundle, syncDigest, remoteVersion)) {
+                        QCC_DbgPrintf(("State of %s unchanged since last sync; skipping remote checks",
+                                       secInfo.busName.c_str()));
+                        status = ER_OK;
+                        managedApp.syncState = SYNC_OK;
+                        break;
+                    }
+                    QCC_DbgPrintf(("Remote policy version of %s changed since last sync",
+                                   secInfo.busName.c_str()));
+                }
+
                 if (ER_OK != (status = UpdateMemberships(mngdProxy, persistedMembershipCerts))) {
                     break;
                 }
@@ -389,6 +409,13 @@ QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app,
                     break;
                 }
                 managedApp.syncState = SYNC_OK;
+
+                if (hasSyncDigest) {
+                    QStatus digestStatus = storage->StoreSyncDigest(app, syncDigest);
+                    if ((ER_OK != digestStatus) && (ER_NOT_IMPLEMENTED != digestStatus)) {
+                        QCC_LogError(digestStatus, ("Failed to store sync digest"));
+                    }
+                }
             } while (0);
         }
 
@@ -416,7 +443,7 @@ QStatus ApplicationUpdater::UpdateApplication(const SecurityInfo& secInfo)
 {
     OnlineApplication app(secInfo.applicationState, secInfo.busName);
     app.keyInfo = secInfo.keyInfo;
-    return UpdateApplication(app, secInfo);
+    return UpdateApplication(app, secInfo, false);
 }
 
 QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app)
@@ -428,13 +455,12 @@ QStatus ApplicationUpdater::UpdateApplication(const OnlineApplication& app)
     }
     status = securityAgentImpl->SetSyncState(tmp, SYNC_OK);
     SecurityInfo secInfo;
-    secInfo.busName = app.busName;
-    status = securityAgentImpl->GetApplicationSecInfo(secInfo);
+    status = monitor->GetApplication(app.keyInfo, secInfo);
     if (status != ER_OK) {
         QCC_LogError(status, ("Failed to fetch security info !"));
         return status;
     }
-    return UpdateApplication(app, secInfo);
+    return UpdateApplication(app, secInfo, true);
 }
 
 void ApplicationUpdater::OnPendingChanges(vector<Application>& apps)
@@ -442,16 +468,12 @@ void ApplicationUpdater::OnPendingChanges(vector<Application>& apps)
     QCC_DbgPrintf(("Changes needed from DB"));
     std::vector<Application>::iterator it = apps.begin();
     for (; it != apps.end(); it++) {
-        OnlineApplication app;
-        app.keyInfo = it->keyInfo;
-        QStatus status = securityAgentImpl->GetApplication(app);
-        if (status == ER_OK && app.busName.size() != 0) {
-            SecurityInfo secInfo;
-            secInfo.busName = app.busName;
-            if (ER_OK == monitor->GetApplication(secInfo)) {
-                QCC_DbgPrintf(("Added to queue ..."));
-                queue.AddTask(new SecurityEvent(&secInfo, nullptr));
-            }
+        // The monitor only knows the applications that are online.
+        SecurityInfo secInfo;
+        if (ER_OK == monitor->GetApplication(it->keyInfo, secInfo)) {
+            QCC_DbgPrintf(("Added to queue ..."));
+            QueueSecurityEvent(nullptr, &secInfo,
+                               (SYNC_WILL_RESET == it->syncState) ? SYNC_PRIORITY_RESET : SYNC_PRIORITY_POLICY);
         }
     }
 }
@@ -459,27 +481,196 @@ void ApplicationUpdater::OnPendingChanges(vector<Application>& apps)
 void ApplicationUpdater::OnSecurityStateChange(const SecurityInfo* oldSecInfo,
                                                const SecurityInfo* newSecInfo)
 {
-    queue.AddTask(new SecurityEvent(newSecInfo, oldSecInfo));
+    QueueSecurityEvent(oldSecInfo, newSecInfo,
+                       SecurityEvent::RequiresSync(oldSecInfo, newSecInfo) ? SYNC_PRIORITY_IDENTITY : SYNC_PRIORITY_POLICY);
+}
+
+void ApplicationUpdater::QueueSecurityEvent(const SecurityInfo* oldSecInfo,
+                                            const SecurityInfo* newSecInfo,
+                                            SyncPriority priority)
+{
+    const SecurityInfo* info = (nullptr != newSecInfo) ? newSecInfo : oldSecInfo;
+    if (nullptr == info) {
+        return;
+    }
+
+    pendingEventsLock.Lock(__FILE__, __LINE__);
+    map<string, SecurityEvent*>::iterator it = pendingEvents.find(info->busName);
+    if ((it != pendingEvents.end()) && (it->second->priority <= priority)) {
+        QCC_DbgPrintf(("Coalescing event for %s", info->busName.c_str()));
+        it->second->Coalesce(oldSecInfo, newSecInfo);
+    } else if (it != pendingEvents.end()) {
+        QCC_DbgPrintf(("Raising priority of event for %s", info->busName.c_str()));
+        SecurityEvent* pending = it->second;
+        SecurityEvent* event = new SecurityEvent(pending->newInfo, pending->oldInfo, priority);
+        event->syncRequired = pending->syncRequired;
+        event->Coalesce(oldSecInfo, newSecInfo);
+        pending->superseded = true;
+        it->second = event;
+        QStatus status = queue.AddTask(event);
+        if (ER_OK != status) {
+            // The queue deleted the event; keep the pending one instead.
+            QCC_LogError(status, ("Failed to queue event for %s", info->busName.c_str()));
+            pending->superseded = false;
+            pending->Coalesce(oldSecInfo, newSecInfo);
+            it->second = pending;
+        }
+    } else {
+        SecurityEvent* event = new SecurityEvent(newSecInfo, oldSecInfo, priority);
+        pendingEvents[info->busName] = event;
+        QStatus status = queue.AddTask(event);
+        if (ER_OK != status) {
+            // The queue deleted the event.
+            QCC_LogError(status, ("Failed to queue event for %s", info->busName.c_str()));
+            pendingEvents.erase(info->busName);
+        }
+    }
+    pendingEventsLock.Unlock(__FILE__, __LINE__);
 }
 
 void ApplicationUpdater::HandleTask(SecurityEvent* event)
 {
+    // Once taken out of the pending events, later changes are queued anew.
+    pendingEventsLock.Lock(__FILE__, __LINE__);
+    const SecurityInfo* info = (nullptr != event->newInfo) ? event->newInfo : event->oldInfo;
+    if (nullptr != info) {
+        map<string, SecurityEvent*>::iterator it = pendingEvents.find(info->busName);
+        if ((it != pendingEvents.end()) && (it->second == event)) {
+            pendingEvents.erase(it);
+        }
+    }
+    pendingEventsLock.Unlock(__FILE__, __LINE__);
+
     const SecurityInfo* oldSecInfo = event->oldInfo;
     const SecurityInfo* newSecInfo = event->newInfo;
 
-    // new bus name
-    if ((nullptr == oldSecInfo) && (nullptr != newSecInfo)) {
-        QCC_DbgPrintf(("Detected new busName %s", newSecInfo->busName.c_str()));
-        UpdateApplication(*newSecInfo);
+    if (event->superseded || !event->syncRequired || (nullptr == newSecInfo)) {
+        return;
     }
 
-    // application changed to NEED_UPDATE
-    if ((nullptr != oldSecInfo) && (nullptr != newSecInfo)
-        && (oldSecInfo->applicationState != PermissionConfigurator::NEED_UPDATE)
-        && (newSecInfo->applicationState == PermissionConfigurator::NEED_UPDATE)) {
+    if (nullptr == oldSecInfo) {
+        QCC_DbgPrintf(("Detected new busName %s", newSecInfo->busName.c_str()));
+    } else {
         QCC_DbgPrintf(("Application %s changed to NEED_UPDATE", newSecInfo->busName.c_str()));
-        UpdateApplication(*newSecInfo);
     }
+    QStatus status = UpdateApplication(*newSecInfo);
+
+    Application app;
+    app.keyInfo = newSecInfo->keyInfo;
+    if ((ER_OK == status) || (ER_END_OF_DATA == status)) {
+        // Synchronized, or no longer managed.
+        retryScheduler.CancelRetry(app);
+    } else if ((PermissionConfigurator::CLAIMABLE == newSecInfo->applicationState) ||
+               (PermissionConfigurator::NOT_CLAIMABLE == newSecInfo->applicationState)) {
+        // Retrying cannot help; the application is synced again once it
+        // changes its state.
+        retryScheduler.CancelRetry(app);
+    } else {
+        retryScheduler.ScheduleRetry(app);
+    }
+}
+
+bool ApplicationUpdater::OnSyncRetry(const Application& app)
+{
+    OnlineApplication onlineApp;
+    onlineApp.keyInfo = app.keyInfo;
+    SecurityInfo secInfo;
+    if ((ER_OK != securityAgentImpl->GetApplication(onlineApp)) ||
+        (ER_OK != monitor->GetApplication(app.keyInfo, secInfo))) {
+        return false;
+    }
+    QCC_DbgPrintf(("Retrying sync of %s", secInfo.busName.c_str()));
+    QueueSecurityEvent(nullptr, &secInfo,
+                       (SYNC_WILL_RESET == onlineApp.syncState) ? SYNC_PRIORITY_RESET : SYNC_PRIORITY_POLICY);
+    return true;
+}
+
+void ApplicationUpdater::LogQueueStats()
+{
+    TaskQueueStats stats = queue.GetStats();
+    QCC_DbgHLPrintf(("Sync queue: %u queued, at most %u, %llu added, %llu dropped, %llu coalesced",
+                     (unsigned)stats.depth, (unsigned)stats.highWaterMark, (unsigned long long)stats.added,
+                     (unsigned long long)stats.dropped, (unsigned long long)stats.coalesced));
+    for (size_t i = 0; i < stats.priorities.size(); i++) {
+        const TaskQueuePriorityStats& level = stats.priorities[i];
+        QCC_DbgHLPrintf(("Priority %u: %u queued, %llu tasks, average latency %llu ms, max latency %llu ms",
+                         (unsigned)i, (unsigned)level.depth, (unsigned long long)level.handled,
+                         (unsigned long long)(level.handled == 0 ? 0 : level.totalLatency / level.handled),
+                         (unsigned long long)level.maxLatency));
+    }
+    QCC_DbgHLPrintf(("%llu tasks handled ahead of their priority", (unsigned long long)stats.aged));
+}
+
+static void AppendDigestField(string& buffer, const uint8_t* data, size_t size)
+{
+    uint32_t length = (uint32_t)size;
+    buffer.append((const char*)&length, sizeof(length));
+    buffer.append((const char*)data, size);
+}
+
+QStatus ApplicationUpdater::ComputeSyncDigest(const vector<MembershipCertificateChain>& memberships,
+                                              const IdentityCertificateChain& idCerts,
+                                              const PermissionPolicy* policy,
+                                              uint8_t* digest)
+{
+    // Memberships are sorted so the digest does not depend on the order in
+    // which they are returned by storage.
+    vector<string> leafs;
+    for (size_t i = 0; i < memberships.size(); i++) {
+        if (memberships[i].empty()) {
+            continue;
+        }
+        const MembershipCertificate& leaf = memberships[i][0];
+        string leafId;
+        AppendDigestField(leafId, leaf.GetSerial(), leaf.GetSerialLen());
+        const qcc::String& aki = leaf.GetAuthorityKeyId();
+        AppendDigestField(leafId, (const uint8_t*)aki.data(), aki.size());
+        leafs.push_back(leafId);
+    }
+    sort(leafs.begin(), leafs.end());
+
+    string state;
+    uint32_t count = (uint32_t)leafs.size();
+    state.append((const char*)&count, sizeof(count));
+    for (size_t i = 0; i < leafs.size(); i++) {
+        state.append(leafs[i]);
+    }
+
+    count = (uint32_t)idCerts.size();
+    state.append((const char*)&count, sizeof(count));
+    for (size_t i = 0; i < idCerts.size(); i++) {
+        AppendDigestField(state, idCerts[i].GetSerial(), idCerts[i].GetSerialLen());
+        const qcc::String& aki = idCerts[i].GetAuthorityKeyId();
+        AppendDigestField(state, (const uint8_t*)aki.data(), aki.size());
+    }
+
+    uint8_t hasPolicy = (nullptr == policy) ? 0 : 1;
+    uint32_t policyVersion = (nullptr == policy) ? 0 : policy->GetVersion();
+    state.append((const char*)&hasPolicy, sizeof(hasPolicy));
+    state.append((const char*)&policyVersion, sizeof(policyVersion));
+
+    Crypto_SHA256 hash;
+    QStatus status = hash.Init();
+    if (ER_OK != status) {
+        return status;
+    }
+    status = hash.Update((const uint8_t*)state.data(), state.size());
+    if (ER_OK != status) {
+        return status;
+    }
+    return hash.GetDigest(digest);
+}
+
+bool ApplicationUpdater::IsUnchangedSinceLastSync(const SyncBundle& bundle,
+                                                  const uint8_t* digest,
+                                                  uint32_t remotePolicyVersion)
+{
+    if (!bundle.hasSyncDigest || (memcmp(bundle.syncDigest, digest, Crypto_SHA256::DIGEST_SIZE) != 0)) {
+        return false;
+    }
+    // Without a desired policy, the application must be on its default policy.
+    uint32_t localVersion = bundle.hasPolicy ? bundle.policy.GetVersion() : 0;
+    return (localVersion == remotePolicyVersion);
 }
 
 bool ApplicationUpdater::IsSameCertificate(const MembershipSummary& summary, const MembershipCertificate& cert)
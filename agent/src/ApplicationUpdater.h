@@ -24,24 +24,82 @@
 
 #include <alljoyn/securitymgr/Application.h>
 #include <alljoyn/securitymgr/AgentCAStorage.h>
+#include <map>
 #include <memory>
+#include <string>
+
+#include <qcc/Mutex.h>
 
 #include "ProxyObjectManager.h"
 #include "SecurityInfoListener.h"
+#include "SyncRetryScheduler.h"
 #include "TaskQueue.h"
 #include "SecurityAgentImpl.h"
 
 namespace ajn {
 namespace securitymgr {
+/*
+ * The order in which the updater handles its work. Tasks that waited too
+ * long are handled first regardless of their priority.
+ */
+enum SyncPriority {
+    SYNC_PRIORITY_RESET = 0,    // Resets of applications removed from storage.
+    SYNC_PRIORITY_IDENTITY = 1, // Applications that came online or need an update.
+    SYNC_PRIORITY_POLICY = 2,   // Routine pushes of changed policies and memberships.
+    SYNC_PRIORITY_LEVELS = 3
+};
+
+/* Time (in ms) after which a sync is handled regardless of its priority. */
+#define SYNC_PRIORITY_MAX_WAIT 10000
+
 class SecurityEvent {
   public:
     SecurityInfo* newInfo;
     SecurityInfo* oldInfo;
+    bool syncRequired; // True if this or any event coalesced into it requires a sync.
+    SyncPriority priority;
+    bool superseded;   // True if a higher priority event took over.
     SecurityEvent(const SecurityInfo* n,
-                  const SecurityInfo* o) :
+                  const SecurityInfo* o,
+                  SyncPriority p = SYNC_PRIORITY_POLICY) :
         newInfo(n == nullptr ? nullptr : new SecurityInfo(*n)),
-        oldInfo(o == nullptr ? nullptr : new SecurityInfo(*o))
+        oldInfo(o == nullptr ? nullptr : new SecurityInfo(*o)),
+        syncRequired(RequiresSync(o, n)),
+        priority(p),
+        superseded(false)
+    {
+    }
+
+    static size_t GetPriority(SecurityEvent* event)
+    {
+        return event->priority;
+    }
+
+    /**
+     * @brief Merge a later state change of the same bus name into this
+     *        event. The event keeps the latest security info.
+     */
+    void Coalesce(const SecurityInfo* o,
+                  const SecurityInfo* n)
     {
+        syncRequired = syncRequired || RequiresSync(o, n);
+        delete newInfo;
+        newInfo = (n == nullptr ? nullptr : new SecurityInfo(*n));
+    }
+
+    /*
+     * A sync is required when a bus name is discovered or when an
+     * application changes to NEED_UPDATE.
+     */
+    static bool RequiresSync(const SecurityInfo* o,
+                             const SecurityInfo* n)
+    {
+        if (nullptr == n) {
+            return false;
+        }
+        return (nullptr == o) ||
+               ((o->applicationState != PermissionConfigurator::NEED_UPDATE) &&
+                (n->applicationState == PermissionConfigurator::NEED_UPDATE));
     }
 
     ~SecurityEvent()
@@ -57,7 +115,8 @@ class SecurityAgentImpl; //needed because of cyclic dependency between Agent and
 
 class ApplicationUpdater :
     public SecurityInfoListener,
-    public StorageListener {
+    public StorageListener,
+    public SyncRetryListener {
   public:
     ApplicationUpdater(BusAttachment* ba, // No ownership.
                        const shared_ptr<AgentCAStorage>& s,
@@ -67,17 +126,23 @@ class ApplicationUpdater :
                        ) :
         busAttachment(ba), storage(s), proxyObjectManager(_pom),
         monitor(_monitor), securityAgentImpl(smi),
-        queue(TaskQueue<SecurityEvent*, ApplicationUpdater>(this))
+        retryScheduler(s, this),
+        queue(this)
     {
+        queue.SetPriorities(SYNC_PRIORITY_LEVELS, SecurityEvent::GetPriority, SYNC_PRIORITY_MAX_WAIT);
         monitor->RegisterSecurityInfoListener(this);
         storage->RegisterStorageListener(this);
+        retryScheduler.Start();
     }
 
     ~ApplicationUpdater()
     {
         storage->UnRegisterStorageListener(this);
         monitor->UnregisterSecurityInfoListener(this);
+        retryScheduler.Terminate();
+        retryScheduler.Join();
         queue.Stop();
+        LogQueueStats();
     }
 
     QStatus UpdateApplication(const OnlineApplication& app);
@@ -86,14 +151,52 @@ class ApplicationUpdater :
 
     void HandleTask(SecurityEvent* event);
 
+    /**
+     * @brief Compute the digest of the desired state of an application, as
+     *        stored after each successful synchronization.
+     */
+    static QStatus ComputeSyncDigest(const vector<MembershipCertificateChain>& memberships,
+                                     const IdentityCertificateChain& idCerts,
+                                     const PermissionPolicy* policy,
+                                     uint8_t* digest);
+
+    /**
+     * @brief Check whether an application is still in the state of its last
+     *        successful synchronization, both locally and remotely.
+     *
+     * @param[in] bundle               The desired state of the application.
+     * @param[in] digest               The digest of that desired state.
+     * @param[in] remotePolicyVersion  The policy version reported by the
+     *                                 application.
+     *
+     * @return true if the digest matches the one of the last synchronization
+     *         and the application still has the desired policy version.
+     */
+    static bool IsUnchangedSinceLastSync(const SyncBundle& bundle,
+                                         const uint8_t* digest,
+                                         uint32_t remotePolicyVersion);
+
   private:
     static bool IsSameCertificate(const MembershipSummary& summary,
                                   const MembershipCertificate& cert);
 
     QStatus ResetApplication(const OnlineApplication& app);
 
+    /**
+     * @brief Synchronize an application with its desired state in storage.
+     *
+     * @param[in] app               The application to synchronize.
+     * @param[in] secInfo           The latest security info of the application.
+     * @param[in] forceRemoteCheck  If false, the remote calls are skipped when the
+     *                              application is CLAIMED, its desired state
+     *                              still matches the digest of its last successful
+     *                              synchronization and it still reports the
+     *                              desired policy version.
+     */
     QStatus UpdateApplication(const OnlineApplication& app,
-                              const SecurityInfo& secInfo);
+                              const SecurityInfo& secInfo,
+                              bool forceRemoteCheck);
+
 
     QStatus UpdatePolicy(ProxyObjectManager::ManagedProxyObject& app,
                          const PermissionPolicy* localPolicy);
@@ -118,11 +221,28 @@ class ApplicationUpdater :
 
     virtual void OnPendingChanges(vector<Application>& apps);
 
+    virtual bool OnSyncRetry(const Application& app);
+
     virtual void OnPendingChangesCompleted(vector<Application>& apps)
     {
         QCC_UNUSED(apps);
     }
 
+    /*
+     * Queue a state change of a bus name, or merge it into the event that is
+     * already queued for that bus name. If the queued event has a lower
+     * priority, it is superseded by a new event of the requested priority.
+     */
+    void QueueSecurityEvent(const SecurityInfo* oldSecInfo,
+                            const SecurityInfo* newSecInfo,
+                            SyncPriority priority);
+
+    /*
+     * Log the depth and high-water mark of the queue, and how long the tasks
+     * of every priority were queued.
+     */
+    void LogQueueStats();
+
   private:
     BusAttachment* busAttachment;
     shared_ptr<AgentCAStorage> storage;
@@ -130,6 +250,12 @@ class ApplicationUpdater :
     shared_ptr<ApplicationMonitor> monitor;
     SecurityAgentImpl* securityAgentImpl;
 
+    Mutex pendingEventsLock;
+    /* Queued events per bus name; owned by the queue. Events are not merged
+     * per application key, as the departure of an old bus name may be seen
+     * after the arrival of a new one and must not cancel its sync. */
+    map<string, SecurityEvent*> pendingEvents;
+    SyncRetryScheduler retryScheduler;
     TaskQueue<SecurityEvent*, ApplicationUpdater> queue;
 };
 }
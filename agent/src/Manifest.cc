@@ -184,6 +184,7 @@ QStatus Manifest::SetFromByteArray(const uint8_t* manifestByteArray, const size_
     DefaultPolicyMarshaller* marshaller = Util::GetDefaultMarshaller(&msg);
     if (marshaller) {
         if (ER_OK == (status = manifest.Import(*marshaller, manifestByteArray, _size))) {
+            delete[]byteArray;
             size = _size;
             byteArray = new uint8_t[size];
             memcpy(byteArray, manifestByteArray, size);
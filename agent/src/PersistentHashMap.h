@@ -0,0 +1,255 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_PERSISTENTHASHMAP_H_
+#define ALLJOYN_SECMGR_PERSISTENTHASHMAP_H_
+
+#include <memory>
+#include <vector>
+
+using namespace std;
+
+namespace ajn {
+namespace securitymgr {
+/* Number of hash bits consumed per level of a PersistentHashMap. */
+#define PERSISTENT_MAP_LEVEL_BITS 4
+/* Number of children of a branch of a PersistentHashMap. */
+#define PERSISTENT_MAP_FANOUT (1 << PERSISTENT_MAP_LEVEL_BITS)
+
+/**
+ * @brief An immutable hash map. Set and Erase return a new map that shares
+ *        all unchanged nodes with the original one, so a change only copies
+ *        the nodes on the path to the changed entry: O(log N) instead of
+ *        O(N). Maps can be shared between threads without locking.
+ *
+ * The map is a hash trie: a branch selects one of its children on the next
+ * PERSISTENT_MAP_LEVEL_BITS bits of the hash; a leaf holds the entries of a
+ * single hash value.
+ */
+template <typename KEY, typename VALUE, typename HASH>
+class PersistentHashMap {
+  public:
+    PersistentHashMap() : count(0) { }
+
+    /**
+     * @brief Find the value of a key.
+     *
+     * @return The value or nullptr if the key is not in the map. The pointer
+     *         is valid as long as this map (or a copy of it) exists.
+     */
+    const VALUE* Find(const KEY& key) const
+    {
+        size_t hash = HASH()(key);
+        const Node* node = root.get();
+        size_t shift = 0;
+        while ((node != nullptr) && !node->children.empty()) {
+            node = node->children[Slot(hash, shift)].get();
+            shift += PERSISTENT_MAP_LEVEL_BITS;
+        }
+        if (node != nullptr) {
+            for (size_t i = 0; i < node->entries.size(); i++) {
+                if ((node->entries[i].hash == hash) && (node->entries[i].key == key)) {
+                    return &node->entries[i].value;
+                }
+            }
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Create a map in which a key is added or its value replaced.
+     */
+    PersistentHashMap Set(const KEY& key,
+                          const VALUE& value) const
+    {
+        Entry entry;
+        entry.hash = HASH()(key);
+        entry.key = key;
+        entry.value = value;
+        bool added = false;
+        PersistentHashMap next;
+        next.root = Insert(root, 0, entry, added);
+        next.count = count + (added ? 1 : 0);
+        return next;
+    }
+
+    /**
+     * @brief Create a map without a key.
+     */
+    PersistentHashMap Erase(const KEY& key) const
+    {
+        bool removed = false;
+        shared_ptr<const Node> erased = Remove(root, 0, HASH()(key), key, removed);
+        if (!removed) {
+            return *this;
+        }
+        PersistentHashMap next;
+        next.root = erased;
+        next.count = count - 1;
+        return next;
+    }
+
+    size_t Size() const
+    {
+        return count;
+    }
+
+    bool Empty() const
+    {
+        return (count == 0);
+    }
+
+    /**
+     * @brief Call visitor(key, value) for every entry, in no particular order.
+     */
+    template <typename VISITOR>
+    void ForEach(VISITOR& visitor) const
+    {
+        Visit(root.get(), visitor);
+    }
+
+  private:
+    struct Entry {
+        size_t hash;
+        KEY key;
+        VALUE value;
+    };
+
+    struct Node {
+        vector<shared_ptr<const Node> > children; // Empty for a leaf.
+        vector<Entry> entries;                    // Entries of one hash; leafs only.
+    };
+
+    static size_t Slot(size_t hash,
+                       size_t shift)
+    {
+        return (hash >> shift) & (PERSISTENT_MAP_FANOUT - 1);
+    }
+
+    static shared_ptr<const Node> Insert(const shared_ptr<const Node>& node,
+                                         size_t shift,
+                                         const Entry& entry,
+                                         bool& added)
+    {
+        if (node == nullptr) {
+            shared_ptr<Node> leaf(new Node());
+            leaf->entries.push_back(entry);
+            added = true;
+            return leaf;
+        }
+
+        if (node->children.empty()) {
+            if (node->entries[0].hash == entry.hash) {
+                shared_ptr<Node> leaf(new Node(*node));
+                for (size_t i = 0; i < leaf->entries.size(); i++) {
+                    if (leaf->entries[i].key == entry.key) {
+                        leaf->entries[i] = entry;
+                        return leaf;
+                    }
+                }
+                leaf->entries.push_back(entry);
+                added = true;
+                return leaf;
+            }
+            // Different hashes; they differ on a deeper level, so branch here.
+            shared_ptr<Node> branch(new Node());
+            branch->children.resize(PERSISTENT_MAP_FANOUT);
+            branch->children[Slot(node->entries[0].hash, shift)] = node;
+            branch->children[Slot(entry.hash, shift)] =
+                Insert(branch->children[Slot(entry.hash, shift)], shift + PERSISTENT_MAP_LEVEL_BITS, entry, added);
+            return branch;
+        }
+
+        shared_ptr<Node> branch(new Node(*node));
+        size_t slot = Slot(entry.hash, shift);
+        branch->children[slot] = Insert(node->children[slot], shift + PERSISTENT_MAP_LEVEL_BITS, entry, added);
+        return branch;
+    }
+
+    static shared_ptr<const Node> Remove(const shared_ptr<const Node>& node,
+                                         size_t shift,
+                                         size_t hash,
+                                         const KEY& key,
+                                         bool& removed)
+    {
+        if (node == nullptr) {
+            return node;
+        }
+
+        if (node->children.empty()) {
+            for (size_t i = 0; i < node->entries.size(); i++) {
+                if ((node->entries[i].hash == hash) && (node->entries[i].key == key)) {
+                    removed = true;
+                    if (node->entries.size() == 1) {
+                        return shared_ptr<const Node>();
+                    }
+                    shared_ptr<Node> leaf(new Node(*node));
+                    leaf->entries.erase(leaf->entries.begin() + i);
+                    return leaf;
+                }
+            }
+            return node;
+        }
+
+        size_t slot = Slot(hash, shift);
+        shared_ptr<const Node> child = Remove(node->children[slot], shift + PERSISTENT_MAP_LEVEL_BITS, hash, key, removed);
+        if (!removed) {
+            return node;
+        }
+
+        shared_ptr<Node> branch(new Node(*node));
+        branch->children[slot] = child;
+
+        // Collapse a branch that is left with a single leaf.
+        size_t used = 0;
+        shared_ptr<const Node> last;
+        for (size_t i = 0; i < branch->children.size(); i++) {
+            if (branch->children[i] != nullptr) {
+                used++;
+                last = branch->children[i];
+            }
+        }
+        if (used == 0) {
+            return shared_ptr<const Node>();
+        }
+        if ((used == 1) && last->children.empty()) {
+            return last;
+        }
+        return branch;
+    }
+
+    template <typename VISITOR>
+    static void Visit(const Node* node,
+                      VISITOR& visitor)
+    {
+        if (node == nullptr) {
+            return;
+        }
+        for (size_t i = 0; i < node->children.size(); i++) {
+            Visit(node->children[i].get(), visitor);
+        }
+        for (size_t i = 0; i < node->entries.size(); i++) {
+            visitor(node->entries[i].key, node->entries[i].value);
+        }
+    }
+
+    shared_ptr<const Node> root;
+    size_t count;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_PERSISTENTHASHMAP_H_ */
@@ -17,6 +17,7 @@
 #include "ProxyObjectManager.h"
 
 #include <qcc/Debug.h>
+#include <qcc/time.h>
 #include <alljoyn/AllJoynStd.h>
 
 #define QCC_MODULE "SECMGR_AGENT"
@@ -28,13 +29,21 @@ using namespace std;
 
 namespace ajn {
 namespace securitymgr {
+const uint32_t JoinSessionStats::bucketLimits[JOIN_HISTOGRAM_BUCKETS - 1] = { 10, 50, 100, 500, 1000, 5000 };
+
 ProxyObjectManager::ProxyObjectManager(BusAttachment* ba) :
-    bus(ba)
+    bus(ba), activeListener(nullptr), unreachableTtl(UNREACHABLE_APP_DEFAULT_TTL), stopping(false),
+    joinTimeout(JOIN_SESSION_DEFAULT_TIMEOUT), sessionIdleTtl(SESSION_POOL_DEFAULT_IDLE_TTL), reaper(this)
 {
+    QStatus status = reaper.Start();
+    if (ER_OK != status) {
+        QCC_LogError(status, ("Failed to start session reaper"));
+    }
 }
 
 ProxyObjectManager::~ProxyObjectManager()
 {
+    Stop();
     // Empty string as authMechanism to avoid resetting keyStore
     bus->EnablePeerSecurity("", nullptr);
 }
@@ -51,55 +60,432 @@ QStatus ProxyObjectManager::GetProxyObject(ManagedProxyObject& managedProxy,
         return status;
     }
 
+    if (IsUnreachable(managedProxy.remoteApp)) {
+        QCC_DbgPrintf(("Skipping join of unreachable application %s", busName));
+        return ER_ALLJOYN_JOINSESSION_REPLY_FAILED;
+    }
+
     lock.Lock(__FILE__, __LINE__);
 
     if (sessionType == ECDHE_NULL) {
-        bus->EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
+        EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
     } else if (sessionType == ECDHE_DSA) {
-        bus->EnablePeerSecurity(ECDHE_KEYX, &listener);
+        EnablePeerSecurity(ECDHE_KEYX, &listener);
     } else if (sessionType == ECDHE_PSK) {
-        bus->EnablePeerSecurity(KEYX_ECDHE_PSK, authListener ? authListener : &listener);
+        EnablePeerSecurity(KEYX_ECDHE_PSK, authListener ? authListener : &listener);
     }
 
     SessionId sessionId;
-    SessionOpts opts(SessionOpts::TRAFFIC_MESSAGES, false,
-                     SessionOpts::PROXIMITY_ANY, TRANSPORT_ANY);
-    status = bus->JoinSession(busName, ALLJOYN_SESSIONPORT_PERMISSION_MGMT,
-                              this, sessionId, opts);
+    bool needReAuth = false;
+    if (AcquirePooledSession(PoolKey(managedProxy.remoteApp.busName, sessionType), sessionId, needReAuth)) {
+        QCC_DbgPrintf(("Reusing session %lu with %s", (unsigned long)sessionId, busName));
+        status = ER_OK;
+    } else {
+        status = JoinSession(busName, sessionType, sessionId);
+        SetUnreachable(managedProxy.remoteApp,
+                       (ER_ALLJOYN_JOINSESSION_REPLY_FAILED == status) || (ER_TIMEOUT == status));
+    }
     if (status != ER_OK) {
         QCC_DbgRemoteError(("Could not join session with %s", busName));
-        if (authListener) {
-            bus->EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
+        if (activeListener != &listener) {
+            EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
         }
         lock.Unlock(__FILE__, __LINE__);
         return status;
     }
 
     managedProxy.remoteObj = new SecurityApplicationProxy(*bus, busName, sessionId);
-    managedProxy.resetAuthListener = (authListener != nullptr);
+    managedProxy.sessionType = sessionType;
+    managedProxy.needReAuth = needReAuth;
+    // A pre-shared key is only valid for a single claim attempt.
+    managedProxy.discardSession = (ECDHE_PSK == sessionType);
     managedProxy.proxyObjectManager = this;
     return status;
 }
 
-QStatus ProxyObjectManager::ReleaseProxyObject(SecurityApplicationProxy* remoteObject,
-                                               bool resetListener)
+QStatus ProxyObjectManager::EnablePeerSecurity(const char* mechanisms,
+                                               AuthListener* al)
 {
-    SessionId sessionId = remoteObject->GetSessionId();
-    delete remoteObject;
-    remoteObject = nullptr;
-    QStatus status =  bus->LeaveSession(sessionId);
-    if (resetListener) {
-        bus->EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
+    lock.Lock(__FILE__, __LINE__);
+    if ((al == activeListener) && (activeMechanisms == mechanisms)) {
+        peerSecurityStats.skipped++;
+        lock.Unlock(__FILE__, __LINE__);
+        return ER_OK;
+    }
+
+    uint64_t start = GetTimestamp64();
+    QStatus status = bus->EnablePeerSecurity(mechanisms, al);
+    peerSecurityStats.enabled++;
+    peerSecurityStats.totalTime += GetTimestamp64() - start;
+    if (ER_OK == status) {
+        activeMechanisms = mechanisms;
+        activeListener = al;
+    } else {
+        // Unknown what is enabled now; reconfigure on the next call.
+        activeMechanisms.clear();
+        activeListener = nullptr;
     }
     lock.Unlock(__FILE__, __LINE__);
     return status;
 }
 
+PeerSecurityStats ProxyObjectManager::GetPeerSecurityStats()
+{
+    lock.Lock(__FILE__, __LINE__);
+    PeerSecurityStats stats = peerSecurityStats;
+    lock.Unlock(__FILE__, __LINE__);
+    return stats;
+}
+
+bool ProxyObjectManager::AcquirePooledSession(const PoolKey& key,
+                                              SessionId& sessionId,
+                                              bool& needReAuth)
+{
+    bool found = false;
+    poolLock.Lock(__FILE__, __LINE__);
+    map<PoolKey, PooledSession>::iterator it = sessionPool.find(key);
+    if ((it != sessionPool.end()) && !it->second.discarded) {
+        it->second.refs++;
+        sessionId = it->second.sessionId;
+        // The new user authenticates again before its first call.
+        needReAuth = it->second.needReAuth;
+        it->second.needReAuth = false;
+        found = true;
+    }
+    poolLock.Unlock(__FILE__, __LINE__);
+    return found;
+}
+
+void ProxyObjectManager::ReleasePooledSession(const PoolKey& key,
+                                              SessionId sessionId,
+                                              bool discard,
+                                              bool needReAuth)
+{
+    bool leave = true;
+    poolLock.Lock(__FILE__, __LINE__);
+    map<PoolKey, PooledSession>::iterator it = sessionPool.find(key);
+    if ((it != sessionPool.end()) && (it->second.sessionId == sessionId)) {
+        PooledSession& session = it->second;
+        session.refs--;
+        session.discarded = session.discarded || discard;
+        session.needReAuth = session.needReAuth || needReAuth;
+        // Other users keep a discarded session until they are done with it.
+        leave = session.discarded && (0 == session.refs);
+        if (leave) {
+            sessionPool.erase(it);
+        } else if (!session.discarded) {
+            session.expiry = GetTimestamp64() + sessionIdleTtl;
+            poolCond.Signal();
+        }
+    } else if (!discard && (sessionIdleTtl > 0) && !stopping && (it == sessionPool.end())) {
+        PooledSession& session = sessionPool[key];
+        session.sessionId = sessionId;
+        session.refs = 0;
+        session.expiry = GetTimestamp64() + sessionIdleTtl;
+        session.discarded = false;
+        session.needReAuth = needReAuth;
+        leave = false;
+        poolCond.Signal();
+    }
+    poolLock.Unlock(__FILE__, __LINE__);
+
+    if (leave) {
+        bus->LeaveSession(sessionId);
+    }
+    LeaveIdleSessions(false);
+}
+
+void ProxyObjectManager::LeaveIdleSessions(bool all)
+{
+    vector<SessionId> expired;
+    poolLock.Lock(__FILE__, __LINE__);
+    uint64_t now = GetTimestamp64();
+    map<PoolKey, PooledSession>::iterator it = sessionPool.begin();
+    while (it != sessionPool.end()) {
+        if ((0 == it->second.refs) && (all || (now >= it->second.expiry))) {
+            expired.push_back(it->second.sessionId);
+            sessionPool.erase(it++);
+        } else {
+            ++it;
+        }
+    }
+    poolLock.Unlock(__FILE__, __LINE__);
+
+    for (size_t i = 0; i < expired.size(); i++) {
+        bus->LeaveSession(expired[i]);
+    }
+}
+
+ThreadReturn STDCALL ProxyObjectManager::SessionReaper::Run(void* arg)
+{
+    QCC_UNUSED(arg);
+    manager->ReapIdleSessions();
+    return nullptr;
+}
+
+void ProxyObjectManager::ReapIdleSessions()
+{
+    poolLock.Lock(__FILE__, __LINE__);
+    while (!stopping) {
+        bool idle = false;
+        uint64_t next = 0;
+        for (map<PoolKey, PooledSession>::iterator it = sessionPool.begin(); it != sessionPool.end(); ++it) {
+            if ((0 == it->second.refs) && (!idle || (it->second.expiry < next))) {
+                next = it->second.expiry;
+                idle = true;
+            }
+        }
+        if (!idle) {
+            poolCond.Wait(poolLock);
+            continue;
+        }
+
+        uint64_t now = GetTimestamp64();
+        if (next > now) {
+            uint64_t wait = next - now;
+            poolCond.TimedWait(poolLock, (uint32_t)((wait > 0xFFFFFFFF) ? 0xFFFFFFFF : wait));
+            continue;
+        }
+
+        poolLock.Unlock(__FILE__, __LINE__);
+        LeaveIdleSessions(false);
+        poolLock.Lock(__FILE__, __LINE__);
+    }
+    poolLock.Unlock(__FILE__, __LINE__);
+}
+
+void ProxyObjectManager::SetSessionIdleTtl(uint32_t ttl)
+{
+    poolLock.Lock(__FILE__, __LINE__);
+    sessionIdleTtl = ttl;
+    poolLock.Unlock(__FILE__, __LINE__);
+    if (0 == ttl) {
+        LeaveIdleSessions(true);
+    }
+}
+
+QStatus ProxyObjectManager::JoinSession(const char* busName,
+                                        SessionType type,
+                                        SessionId& sessionId)
+{
+    joinLock.Lock(__FILE__, __LINE__);
+    if (stopping) {
+        joinLock.Unlock(__FILE__, __LINE__);
+        return ER_BUS_STOPPING;
+    }
+    uint32_t timeout = joinTimeout;
+    JoinRequest* request = new JoinRequest(bus);
+    pendingJoins.insert(request);
+    joinLock.Unlock(__FILE__, __LINE__);
+
+    uint64_t start = GetTimestamp64();
+    SessionOpts opts(SessionOpts::TRAFFIC_MESSAGES, false,
+                     SessionOpts::PROXIMITY_ANY, TRANSPORT_ANY);
+    // The join may complete after this manager is gone, so the session
+    // listener is only set once the session is known to be used.
+    QStatus status = bus->JoinSessionAsync(busName, ALLJOYN_SESSIONPORT_PERMISSION_MGMT,
+                                           nullptr, opts, request, nullptr);
+    bool completed = (ER_OK != status);
+
+    if (ER_OK == status) {
+        request->lock.Lock(__FILE__, __LINE__);
+        while (!request->done && !request->cancelled) {
+            uint64_t elapsed = GetTimestamp64() - start;
+            if ((elapsed >= timeout) ||
+                (ER_TIMEOUT == request->cond.TimedWait(request->lock, (uint32_t)(timeout - elapsed)))) {
+                break;
+            }
+        }
+        completed = request->done;
+        request->lock.Unlock(__FILE__, __LINE__);
+
+        if (!completed) {
+            // Once abandoned, the request may delete itself at any time, so
+            // it must no longer be reachable by Stop.
+            joinLock.Lock(__FILE__, __LINE__);
+            pendingJoins.erase(request);
+            request->lock.Lock(__FILE__, __LINE__);
+            completed = request->done;
+            if (!completed) {
+                request->abandoned = true;
+                status = request->cancelled ? ER_BUS_STOPPING : ER_TIMEOUT;
+            }
+            request->lock.Unlock(__FILE__, __LINE__);
+            joinLock.Unlock(__FILE__, __LINE__);
+        }
+
+        if (completed) {
+            status = request->status;
+            sessionId = request->sessionId;
+            if (ER_OK == status) {
+                bus->SetSessionListener(sessionId, this);
+            }
+        }
+    }
+
+    uint64_t duration = GetTimestamp64() - start;
+    joinLock.Lock(__FILE__, __LINE__);
+    if (completed) {
+        pendingJoins.erase(request);
+    }
+    JoinSessionStats& stats = joinStats[type];
+    if (ER_OK == status) {
+        size_t bucket = 0;
+        while ((bucket < JOIN_HISTOGRAM_BUCKETS - 1) && (duration >= JoinSessionStats::bucketLimits[bucket])) {
+            bucket++;
+        }
+        stats.buckets[bucket]++;
+    } else if (completed) {
+        stats.failures++;
+    } else {
+        stats.timeouts++;
+    }
+    joinLock.Unlock(__FILE__, __LINE__);
+
+    QCC_DbgPrintf(("Join of session with %s took %llu ms (%s)", busName,
+                   (unsigned long long)duration, QCC_StatusText(status)));
+
+    if (completed) {
+        delete request;
+    }
+    return status;
+}
+
+void ProxyObjectManager::JoinRequest::JoinSessionCB(QStatus joinStatus,
+                                                    SessionId joinedId,
+                                                    const SessionOpts& opts,
+                                                    void* context)
+{
+    QCC_UNUSED(opts);
+    QCC_UNUSED(context);
+
+    lock.Lock(__FILE__, __LINE__);
+    if (!abandoned) {
+        done = true;
+        status = joinStatus;
+        sessionId = joinedId;
+        cond.Signal();
+        lock.Unlock(__FILE__, __LINE__);
+        return;
+    }
+    lock.Unlock(__FILE__, __LINE__);
+
+    // Nobody waits for this session anymore.
+    if (ER_OK == joinStatus) {
+        bus->EnableConcurrentCallbacks();
+        bus->LeaveSession(joinedId);
+    }
+    delete this;
+}
+
+void ProxyObjectManager::SetJoinTimeout(uint32_t timeout)
+{
+    joinLock.Lock(__FILE__, __LINE__);
+    joinTimeout = timeout;
+    joinLock.Unlock(__FILE__, __LINE__);
+}
+
+JoinSessionStats ProxyObjectManager::GetJoinSessionStats(SessionType type)
+{
+    JoinSessionStats stats;
+    if (type >= SESSION_TYPE_COUNT) {
+        return stats;
+    }
+    joinLock.Lock(__FILE__, __LINE__);
+    stats = joinStats[type];
+    joinLock.Unlock(__FILE__, __LINE__);
+    return stats;
+}
+
+void ProxyObjectManager::Stop()
+{
+    poolLock.Lock(__FILE__, __LINE__);
+    joinLock.Lock(__FILE__, __LINE__);
+    stopping = true;
+    for (set<JoinRequest*>::iterator it = pendingJoins.begin(); it != pendingJoins.end(); ++it) {
+        (*it)->lock.Lock(__FILE__, __LINE__);
+        (*it)->cancelled = true;
+        (*it)->cond.Signal();
+        (*it)->lock.Unlock(__FILE__, __LINE__);
+    }
+    joinLock.Unlock(__FILE__, __LINE__);
+    poolCond.Signal();
+    poolLock.Unlock(__FILE__, __LINE__);
+
+    reaper.Join();
+    LeaveIdleSessions(true);
+}
+
+void ProxyObjectManager::SetUnreachableTtl(uint32_t ttl)
+{
+    unreachableLock.Lock(__FILE__, __LINE__);
+    unreachableTtl = ttl;
+    if (0 == ttl) {
+        unreachableApps.clear();
+    }
+    unreachableLock.Unlock(__FILE__, __LINE__);
+}
+
+bool ProxyObjectManager::IsUnreachable(const OnlineApplication& app)
+{
+    bool unreachable = false;
+    unreachableLock.Lock(__FILE__, __LINE__);
+    map<string, UnreachableApp>::iterator it = unreachableApps.find(app.busName);
+    if (it != unreachableApps.end()) {
+        if (GetTimestamp64() >= it->second.expiry) {
+            unreachableApps.erase(it);
+        } else {
+            // A bus name is only cached for the application it belonged to.
+            unreachable = (it->second.keyInfo == app.keyInfo);
+        }
+    }
+    unreachableLock.Unlock(__FILE__, __LINE__);
+    return unreachable;
+}
+
+void ProxyObjectManager::SetUnreachable(const OnlineApplication& app,
+                                        bool unreachable)
+{
+    unreachableLock.Lock(__FILE__, __LINE__);
+    if (unreachable && (unreachableTtl > 0)) {
+        uint64_t now = GetTimestamp64();
+        map<string, UnreachableApp>::iterator it = unreachableApps.begin();
+        while (it != unreachableApps.end()) {
+            if (now >= it->second.expiry) {
+                unreachableApps.erase(it++);
+            } else {
+                ++it;
+            }
+        }
+        UnreachableApp& entry = unreachableApps[app.busName];
+        entry.keyInfo = app.keyInfo;
+        entry.expiry = now + unreachableTtl;
+    } else if (!unreachable) {
+        unreachableApps.erase(app.busName);
+    }
+    unreachableLock.Unlock(__FILE__, __LINE__);
+}
+
+QStatus ProxyObjectManager::ReleaseProxyObject(ManagedProxyObject& managedProxy)
+{
+    SessionId sessionId = managedProxy.remoteObj->GetSessionId();
+    delete managedProxy.remoteObj;
+    managedProxy.remoteObj = nullptr;
+    ReleasePooledSession(PoolKey(managedProxy.remoteApp.busName, managedProxy.sessionType),
+                         sessionId, managedProxy.discardSession, managedProxy.needReAuth);
+    // Do not keep a listener of the caller registered.
+    if (activeListener != &listener) {
+        EnablePeerSecurity(KEYX_ECDHE_NULL, &listener);
+    }
+    lock.Unlock(__FILE__, __LINE__);
+    return ER_OK;
+}
+
 ProxyObjectManager::ManagedProxyObject::~ManagedProxyObject()
 {
     if (remoteObj != nullptr) {
         assert(proxyObjectManager);
-        proxyObjectManager->ReleaseProxyObject(remoteObj, resetAuthListener);
+        proxyObjectManager->ReleaseProxyObject(*this);
     }
 }
 
@@ -128,6 +514,10 @@ QStatus ProxyObjectManager::ManagedProxyObject::Claim(KeyInfoNISTP256& certifica
                                   manifestRules, manifestRulesCount);
         delete[] identityCertChainArray;
         identityCertChainArray = nullptr;
+        if (ER_OK == status) {
+            // The application is authenticated differently from now on.
+            discardSession = true;
+        }
     }
 
     delete[] manifestRules;
@@ -345,6 +735,8 @@ QStatus ProxyObjectManager::ManagedProxyObject::Reset()
     QStatus status = remoteObj->Reset();
     if (ER_OK != status) {
         QCC_LogError(status, ("Failed to Reset"));
+    } else {
+        discardSession = true;
     }
 
     return status;
@@ -442,9 +834,21 @@ void ProxyObjectManager::SessionLost(SessionId sessionId,
                                      SessionLostReason reason)
 {
     QCC_UNUSED(reason);
-    QCC_UNUSED(sessionId);  // For Release builds.
 
     QCC_DbgPrintf(("Lost session %lu", (unsigned long)sessionId));
+
+    poolLock.Lock(__FILE__, __LINE__);
+    for (map<PoolKey, PooledSession>::iterator it = sessionPool.begin(); it != sessionPool.end(); ++it) {
+        if (it->second.sessionId == sessionId) {
+            if (0 == it->second.refs) {
+                sessionPool.erase(it);
+            } else {
+                it->second.discarded = true;
+            }
+            break;
+        }
+    }
+    poolLock.Unlock(__FILE__, __LINE__);
 }
 }
 }
@@ -16,10 +16,14 @@
 #ifndef ALLJOYN_SECMGR_PROXYOBJECTMANAGER_H_
 #define ALLJOYN_SECMGR_PROXYOBJECTMANAGER_H_
 
+#include <map>
+#include <set>
 #include <vector>
 #include <string>
 
+#include <qcc/Condition.h>
 #include <qcc/Mutex.h>
+#include <qcc/Thread.h>
 
 #include <alljoyn/Status.h>
 #include <alljoyn/Session.h>
@@ -35,6 +39,18 @@
 #define KEYX_ECDHE_PSK "ALLJOYN_ECDHE_PSK"
 #define ECDHE_KEYX "ALLJOYN_ECDHE_ECDSA"
 
+/* Time (in ms) an application that could not be joined is not tried again. */
+#define UNREACHABLE_APP_DEFAULT_TTL 10000
+
+/* Time (in ms) GetProxyObject waits for a session to be joined. */
+#define JOIN_SESSION_DEFAULT_TIMEOUT 10000
+
+/* Time (in ms) an idle session is kept for reuse by a next operation. */
+#define SESSION_POOL_DEFAULT_IDLE_TTL 5000
+
+/* The number of buckets of a join duration histogram. */
+#define JOIN_HISTOGRAM_BUCKETS 7
+
 using namespace qcc;
 using namespace std;
 
@@ -45,13 +61,46 @@ struct MembershipSummary {
     string serial;
 };
 
+/**
+ * Durations of the session joins of one session type.
+ */
+struct JoinSessionStats {
+    /* Upper bounds (in ms) of the buckets; the last bucket holds the rest. */
+    static const uint32_t bucketLimits[JOIN_HISTOGRAM_BUCKETS - 1];
+
+    uint64_t buckets[JOIN_HISTOGRAM_BUCKETS]; ///< The number of successful joins per duration bucket.
+    uint64_t failures;                        ///< The number of joins that failed.
+    uint64_t timeouts;                        ///< The number of joins that timed out or were cancelled.
+
+    JoinSessionStats() :
+        failures(0), timeouts(0)
+    {
+        for (size_t i = 0; i < JOIN_HISTOGRAM_BUCKETS; i++) {
+            buckets[i] = 0;
+        }
+    }
+};
+
+/**
+ * Cost of configuring the authentication mechanisms of the bus attachment.
+ */
+struct PeerSecurityStats {
+    uint64_t enabled;   ///< The number of calls to BusAttachment::EnablePeerSecurity.
+    uint64_t skipped;   ///< The number of calls avoided because nothing changed.
+    uint64_t totalTime; ///< The total time (in ms) spent in BusAttachment::EnablePeerSecurity.
+
+    PeerSecurityStats() :
+        enabled(0), skipped(0), totalTime(0) { }
+};
+
 class ProxyObjectManager :
     public SessionListener {
   public:
     enum SessionType {
         ECDHE_NULL,
         ECDHE_DSA,
-        ECDHE_PSK
+        ECDHE_PSK,
+        SESSION_TYPE_COUNT
     };
 
     ProxyObjectManager(BusAttachment* ba);
@@ -60,8 +109,8 @@ class ProxyObjectManager :
 
     class ManagedProxyObject {
       public:
-        ManagedProxyObject(const OnlineApplication& app) : remoteApp(app), remoteObj(nullptr), resetAuthListener(false),
-            needReAuth(false), proxyObjectManager(nullptr)
+        ManagedProxyObject(const OnlineApplication& app) : remoteApp(app), remoteObj(nullptr), needReAuth(false),
+            discardSession(false), sessionType(ECDHE_DSA), proxyObjectManager(nullptr)
         {
         }
 
@@ -113,8 +162,9 @@ class ProxyObjectManager :
       private:
         OnlineApplication remoteApp;
         SecurityApplicationProxy* remoteObj;
-        bool resetAuthListener;
         bool needReAuth;
+        bool discardSession; // True if the session must not be reused, e.g., after a reset.
+        SessionType sessionType;
         ProxyObjectManager* proxyObjectManager;
 
         void CheckReAuthenticate();
@@ -146,11 +196,166 @@ class ProxyObjectManager :
                            SessionType type = ECDHE_DSA,
                            AuthListener* al = nullptr);
 
+    /**
+     * @brief Set how long an application that could not be joined is not
+     * tried again. GetProxyObject fails immediately for such an application
+     * with ER_ALLJOYN_JOINSESSION_REPLY_FAILED.
+     *
+     * @param[in] ttl  Time in ms; 0 disables caching of unreachable applications.
+     */
+    void SetUnreachableTtl(uint32_t ttl);
+
+    /**
+     * @brief Set how long GetProxyObject waits for a session to be joined
+     * before it fails with ER_TIMEOUT.
+     *
+     * @param[in] timeout  Time in ms.
+     */
+    void SetJoinTimeout(uint32_t timeout);
+
+    /**
+     * @brief Set how long a session is kept after its last use, so a next
+     * operation on the same application and of the same session type can
+     * reuse it without joining and authenticating again.
+     *
+     * @param[in] ttl  Time in ms; 0 disables session reuse.
+     */
+    void SetSessionIdleTtl(uint32_t ttl);
+
+    /**
+     * @brief Retrieve the join duration histogram of a session type.
+     */
+    JoinSessionStats GetJoinSessionStats(SessionType type);
+
+    /**
+     * @brief Enable the given authentication mechanisms on the bus attachment,
+     * unless they are already enabled with the same listener.
+     *
+     * @param[in] mechanisms  The authentication mechanisms.
+     * @param[in] al          The AuthListener to use. No ownership is taken.
+     */
+    QStatus EnablePeerSecurity(const char* mechanisms,
+                               AuthListener* al);
+
+    PeerSecurityStats GetPeerSecurityStats();
+
+    /**
+     * @brief Cancel all pending session joins, fail new ones with
+     * ER_BUS_STOPPING and leave all idle sessions.
+     */
+    void Stop();
+
     DefaultECDHEAuthListener listener;
 
   private:
+    /*
+     * A pending JoinSessionAsync. If the waiting thread gives up, the request
+     * deletes itself once the join completes, leaving the session if needed.
+     */
+    class JoinRequest :
+        public BusAttachment::JoinSessionAsyncCB {
+      public:
+        JoinRequest(BusAttachment* ba) :
+            bus(ba), done(false), abandoned(false), cancelled(false),
+            status(ER_FAIL), sessionId(0) { }
+
+        virtual void JoinSessionCB(QStatus status,
+                                   SessionId sessionId,
+                                   const SessionOpts& opts,
+                                   void* context);
+
+        BusAttachment* bus;
+        Mutex lock;
+        Condition cond;
+        bool done;
+        bool abandoned;
+        bool cancelled;
+        QStatus status;
+        SessionId sessionId;
+    };
+
+    QStatus JoinSession(const char* busName,
+                        SessionType type,
+                        SessionId& sessionId);
+
+    typedef pair<string, SessionType> PoolKey;
+
+    struct PooledSession {
+        SessionId sessionId;
+        size_t refs;     // The number of ManagedProxyObjects using the session.
+        uint64_t expiry; // Timestamp (in ms) after which an idle session is left.
+        bool discarded;  // True if the session is left once it is no longer used.
+        bool needReAuth; // True if the next user must authenticate the session again.
+    };
+
+    /*
+     * Take a session from the pool; returns false if none is available.
+     * needReAuth is set if the authorization changed during an earlier use.
+     */
+    bool AcquirePooledSession(const PoolKey& key,
+                              SessionId& sessionId,
+                              bool& needReAuth);
+
+    /*
+     * Return a session to the pool, or leave it if it should not be reused.
+     */
+    void ReleasePooledSession(const PoolKey& key,
+                              SessionId sessionId,
+                              bool discard,
+                              bool needReAuth);
+
+    /*
+     * Leave the idle sessions that expired, or all idle sessions.
+     */
+    void LeaveIdleSessions(bool all);
+
+    /*
+     * Leaves idle sessions when they expire, also when no further operations
+     * are done.
+     */
+    class SessionReaper :
+        public Thread {
+      public:
+        SessionReaper(ProxyObjectManager* _manager) :
+            Thread("SessionReaper"), manager(_manager) { }
+
+      protected:
+        virtual ThreadReturn STDCALL Run(void* arg);
+
+      private:
+        ProxyObjectManager* manager;
+    };
+
+    void ReapIdleSessions();
+
+    struct UnreachableApp {
+        KeyInfoNISTP256 keyInfo;
+        uint64_t expiry; // Timestamp (in ms) after which a join is tried again.
+    };
+
     Mutex lock;
     BusAttachment* bus;
+    string activeMechanisms;       // The mechanisms last enabled on the bus attachment.
+    AuthListener* activeListener;  // The listener last enabled on the bus attachment.
+    PeerSecurityStats peerSecurityStats;
+    Mutex unreachableLock;
+    map<string, UnreachableApp> unreachableApps; // Keyed by bus name.
+    uint32_t unreachableTtl;
+    Mutex joinLock;
+    set<JoinRequest*> pendingJoins;
+    bool stopping;
+    uint32_t joinTimeout;
+    JoinSessionStats joinStats[SESSION_TYPE_COUNT];
+    Mutex poolLock;
+    map<PoolKey, PooledSession> sessionPool;
+    uint32_t sessionIdleTtl;
+    Condition poolCond; // Signaled when a session becomes idle or on Stop.
+    SessionReaper reaper;
+
+    bool IsUnreachable(const OnlineApplication& app);
+
+    void SetUnreachable(const OnlineApplication& app,
+                        bool unreachable);
 
     /* SessionListener */
     virtual void SessionLost(SessionId sessionId,
@@ -160,8 +365,7 @@ class ProxyObjectManager :
      * @brief Release the remoteObject.
      * @param[in] managedProxy The object to be released.
      */
-    QStatus ReleaseProxyObject(SecurityApplicationProxy* managedProxy,
-                               bool resetListener = false);
+    QStatus ReleaseProxyObject(ManagedProxyObject& managedProxy);
 };
 }
 }
@@ -18,7 +18,10 @@
 
 #include <qcc/Debug.h>
 #include <qcc/CertificateECC.h>
+#include <qcc/Condition.h>
 #include <qcc/KeyInfoECC.h>
+#include <qcc/Thread.h>
+#include <qcc/time.h>
 
 #include <alljoyn/version.h>
 #include <alljoyn/Session.h>
@@ -71,6 +74,201 @@ class ClaimContextImpl :
     }
 };
 
+class ClaimHandleImpl :
+    public ClaimHandle {
+  public:
+    ClaimHandleImpl(const OnlineApplication& _app) :
+        app(_app), stage(CLAIM_QUEUED), status(ER_OK), cancelled(false)
+    {
+    }
+
+    const OnlineApplication& GetApplication() const
+    {
+        return app;
+    }
+
+    Stage GetStage() const
+    {
+        lock.Lock(__FILE__, __LINE__);
+        Stage current = stage;
+        lock.Unlock(__FILE__, __LINE__);
+        return current;
+    }
+
+    QStatus GetStatus() const
+    {
+        lock.Lock(__FILE__, __LINE__);
+        QStatus current = status;
+        lock.Unlock(__FILE__, __LINE__);
+        return current;
+    }
+
+    bool Cancel()
+    {
+        lock.Lock(__FILE__, __LINE__);
+        if ((stage != CLAIM_CLAIMING) && (stage != CLAIM_FINISHED)) {
+            cancelled = true;
+        }
+        bool result = cancelled;
+        lock.Unlock(__FILE__, __LINE__);
+        return result;
+    }
+
+    bool IsCancelled() const
+    {
+        lock.Lock(__FILE__, __LINE__);
+        bool result = cancelled;
+        lock.Unlock(__FILE__, __LINE__);
+        return result;
+    }
+
+    QStatus Wait(uint32_t timeout)
+    {
+        uint64_t deadline = GetTimestamp64() + timeout;
+        QStatus result = ER_OK;
+        lock.Lock(__FILE__, __LINE__);
+        while (stage != CLAIM_FINISHED) {
+            if (timeout == Event::WAIT_FOREVER) {
+                finished.Wait(lock);
+                continue;
+            }
+            uint64_t now = GetTimestamp64();
+            if (now >= deadline) {
+                result = ER_TIMEOUT;
+                break;
+            }
+            finished.TimedWait(lock, (uint32_t)(deadline - now));
+        }
+        lock.Unlock(__FILE__, __LINE__);
+        return result;
+    }
+
+    /**
+     * @brief Move the claim to the next stage.
+     *
+     * @return false if the claim was cancelled and should be stopped.
+     */
+    bool EnterStage(Stage next)
+    {
+        lock.Lock(__FILE__, __LINE__);
+        bool proceed = !cancelled;
+        if (proceed) {
+            stage = next;
+        }
+        lock.Unlock(__FILE__, __LINE__);
+        return proceed;
+    }
+
+    void Finish(QStatus result)
+    {
+        lock.Lock(__FILE__, __LINE__);
+        stage = CLAIM_FINISHED;
+        status = result;
+        finished.Broadcast();
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+  private:
+    ClaimHandleImpl& operator=(const ClaimHandleImpl& other);
+
+    const OnlineApplication app;
+    Stage stage;
+    QStatus status;
+    bool cancelled;
+    mutable Mutex lock;
+    Condition finished;
+};
+
+/**
+ * @brief A claim started by ClaimAsync, waiting for or running on a worker
+ * of the claim queue. The claim is finished when this task is deleted
+ * without having been handled, e.g., because the agent is stopping.
+ */
+class AsyncClaim {
+  public:
+    AsyncClaim(const shared_ptr<ClaimHandleImpl>& _handle,
+               const IdentityInfo& _identityInfo,
+               ClaimResultListener* _listener) :
+        handle(_handle), identityInfo(_identityInfo), listener(_listener), done(false)
+    {
+    }
+
+    ~AsyncClaim()
+    {
+        if (!done) {
+            Complete(ER_BUS_STOPPING);
+        }
+    }
+
+    void Complete(QStatus status)
+    {
+        done = true;
+        if (listener != nullptr) {
+            listener->OnClaimResult(handle->GetApplication(), status);
+        }
+        handle->Finish(status);
+    }
+
+    shared_ptr<ClaimHandleImpl> handle;
+    const IdentityInfo identityInfo;
+
+  private:
+    AsyncClaim& operator=(const AsyncClaim& other);
+
+    ClaimResultListener* listener;
+    bool done;
+};
+
+/**
+ * @brief Generates the identity certificate of an application that is being
+ * claimed, so this can run while the claim session is set up.
+ */
+class ClaimSigner :
+    public Thread {
+  public:
+    ClaimSigner(const shared_ptr<AgentCAStorage>& _caStorage,
+                const OnlineApplication& _app,
+                const IdentityInfo& _identityInfo,
+                const Manifest& _manifest) :
+        Thread("ClaimSigner"), caStorage(_caStorage), app(_app), identityInfo(_identityInfo),
+        manifest(_manifest), status(ER_FAIL), duration(0)
+    {
+    }
+
+    void Sign()
+    {
+        uint64_t start = GetTimestamp64();
+        status = caStorage->StartApplicationClaiming(app, identityInfo, manifest, adminGroup, idCertificate);
+        duration = GetTimestamp64() - start;
+    }
+
+    GroupInfo adminGroup;
+    IdentityCertificateChain idCertificate;
+    QStatus status;
+    uint64_t duration; // Time (in ms) it took to sign.
+
+  protected:
+    ThreadReturn STDCALL Run(void* arg)
+    {
+        QCC_UNUSED(arg);
+        Sign();
+        return nullptr;
+    }
+
+  private:
+    ClaimSigner& operator=(const ClaimSigner& other);
+
+    const shared_ptr<AgentCAStorage>& caStorage;
+    const OnlineApplication& app;
+    const IdentityInfo& identityInfo;
+    const Manifest& manifest;
+};
+
+static bool EnterClaimStage(ClaimHandleImpl* handle, ClaimHandle::Stage stage)
+{
+    return (handle == nullptr) || handle->EnterStage(stage);
+}
+
 QStatus SecurityAgentImpl::ClaimSelf()
 {
     QStatus status = ER_FAIL;
@@ -217,10 +415,11 @@ QStatus SecurityAgentImpl::ClaimSelf()
 
 SecurityAgentImpl::SecurityAgentImpl(const shared_ptr<AgentCAStorage>& _caStorage, BusAttachment* ba) :
     publicKeyInfo(),
+    applications(new ApplicationSnapshot()),
     appMonitor(nullptr),
     ownBa(false),
-    caStorage(_caStorage),
-    queue(TaskQueue<AppListenerEvent*, SecurityAgentImpl>(this)), claimListener(nullptr)
+    caStorage(_caStorage), managedAppsPreloaded(false),
+    claimQueue(this, CLAIM_ASYNC_MAX_WORKERS), claimListener(nullptr)
 {
     proxyObjectManager = nullptr;
     applicationUpdater = nullptr;
@@ -289,7 +488,7 @@ QStatus SecurityAgentImpl::Init()
 
         proxyObjectManager = make_shared<ProxyObjectManager>(busAttachment);
 
-        status = busAttachment->EnablePeerSecurity(KEYX_ECDHE_PSK, &proxyObjectManager->listener);
+        status = proxyObjectManager->EnablePeerSecurity(KEYX_ECDHE_PSK, &proxyObjectManager->listener);
         if (ER_OK != status) {
             QCC_LogError(status,
                          ("Failed to enable security on the security agent bus attachment."));
@@ -310,6 +509,8 @@ QStatus SecurityAgentImpl::Init()
             }
         }
 
+        PreloadManagedApplications();
+
         appMonitor = shared_ptr<ApplicationMonitor>(new ApplicationMonitor(busAttachment));
         if (nullptr == appMonitor) {
             QCC_LogError(status, ("nullptr Application Monitor"));
@@ -347,9 +548,24 @@ SecurityAgentImpl::~SecurityAgentImpl()
         appMonitor = nullptr;
     }
 
+    if (proxyObjectManager != nullptr) {
+        // Do not wait for pending session joins of the updater or of claims.
+        proxyObjectManager->Stop();
+    }
+
+    claimQueue.Stop();
+
     applicationUpdater = nullptr;
 
-    queue.Stop();
+    applicationListenersMutex.Lock(__FILE__, __LINE__);
+    listeners.insert(listeners.end(), retiredListeners.begin(), retiredListeners.end());
+    retiredListeners.clear();
+    vector<ApplicationListenerQueue*> listenerQueues;
+    listenerQueues.swap(listeners);
+    applicationListenersMutex.Unlock(__FILE__, __LINE__);
+    for (size_t i = 0; i < listenerQueues.size(); i++) {
+        delete listenerQueues[i];
+    }
 
     Util::Fini();
 
@@ -374,25 +590,174 @@ QStatus SecurityAgentImpl::SetSyncState(const Application& app,
 {
     appsMutex.Lock(__FILE__, __LINE__);
 
-    bool exist;
-    OnlineApplicationMap::iterator it = SafeAppExist(app.keyInfo, exist);
-    if (!exist) {
+    OnlineApplication oldApp;
+    if (!SafeAppExist(app.keyInfo, oldApp)) {
+        if (managedAppsPreloaded) {
+            // Keep the preloaded state of applications not found yet current.
+            if (SYNC_UNMANAGED == syncState) {
+                managedApps.erase(app.keyInfo);
+            } else {
+                managedApps[app.keyInfo] = syncState;
+            }
+        }
         appsMutex.Unlock(__FILE__, __LINE__);
         QCC_LogError(ER_FAIL, ("Application does not exist !"));
         return ER_FAIL;
     }
 
-    OnlineApplication oldApp = it->second;
     if (oldApp.syncState != syncState) {
-        it->second.syncState = syncState;
-        NotifyApplicationListeners(&oldApp, &(it->second));
+        OnlineApplication newApp(oldApp);
+        newApp.syncState = syncState;
+        if (newApp.busName.empty() && (SYNC_UNMANAGED == syncState)) {
+            // An offline application is only kept while it is managed.
+            UnpublishApplication(newApp);
+        } else {
+            PublishApplication(newApp);
+        }
+        NotifyApplicationListeners(&oldApp, &newApp);
     }
 
     appsMutex.Unlock(__FILE__, __LINE__);
     return ER_OK;
 }
 
+/**
+ * @brief Claims the applications of a ClaimApplications call. Each task is
+ * the claim of one application; the TaskQueue bounds how many of them are in
+ * flight.
+ */
+class BulkClaim {
+  public:
+    BulkClaim(SecurityAgentImpl* _agent,
+              const IdentityInfo& _identityInfo,
+              ClaimResultListener* _listener,
+              size_t _remaining) :
+        agent(_agent), identityInfo(_identityInfo), listener(_listener),
+        remaining(_remaining), failed(0)
+    {
+    }
+
+    void HandleTask(OnlineApplication* app)
+    {
+        Complete(*app, agent->Claim(*app, identityInfo));
+    }
+
+    /**
+     * @brief Report the result of an application, whether it was claimed or
+     * could not be handed over to the claims in flight.
+     */
+    void Complete(const OnlineApplication& app,
+                  QStatus status)
+    {
+        if (listener != nullptr) {
+            listener->OnClaimResult(app, status);
+        }
+
+        lock.Lock(__FILE__, __LINE__);
+        if (ER_OK != status) {
+            failed++;
+        }
+        if (--remaining == 0) {
+            done.Signal();
+        }
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+    /**
+     * @brief Wait until all applications have been handled.
+     *
+     * @return The number of applications that could not be claimed.
+     */
+    size_t WaitForResults()
+    {
+        lock.Lock(__FILE__, __LINE__);
+        while (remaining > 0) {
+            done.Wait(lock);
+        }
+        size_t result = failed;
+        lock.Unlock(__FILE__, __LINE__);
+        return result;
+    }
+
+  private:
+    BulkClaim& operator=(const BulkClaim& other);
+
+    SecurityAgentImpl* agent;
+    const IdentityInfo& identityInfo;
+    ClaimResultListener* listener;
+    size_t remaining;
+    size_t failed;
+    Mutex lock;
+    Condition done;
+};
+
+QStatus SecurityAgentImpl::ClaimApplications(const vector<OnlineApplication>& apps,
+                                             const IdentityInfo& identityInfo,
+                                             ClaimResultListener* listener,
+                                             size_t maxInFlight)
+{
+    if (claimListener == nullptr) {
+        QCC_LogError(ER_FAIL, ("No ClaimListener set"));
+        return ER_FAIL;
+    }
+    if (apps.empty()) {
+        return ER_OK;
+    }
+
+    uint64_t start = GetTimestamp64();
+    BulkClaim bulkClaim(this, identityInfo, listener, apps.size());
+    size_t failed;
+    {
+        // Claims of different applications overlap: remote calls still go
+        // one by one through the ProxyObjectManager, but fetching and
+        // approving a manifest and signing a certificate no longer wait for
+        // the previous application to be claimed.
+        TaskQueue<OnlineApplication*, BulkClaim> claims(&bulkClaim, maxInFlight);
+        for (size_t i = 0; i < apps.size(); i++) {
+            QStatus status = claims.AddTask(new OnlineApplication(apps[i]));
+            if (ER_OK != status) {
+                QCC_LogError(status, ("Failed to queue claim of %s", apps[i].busName.c_str()));
+                bulkClaim.Complete(apps[i], status);
+            }
+        }
+        failed = bulkClaim.WaitForResults();
+    }
+
+    QCC_DbgHLPrintf(("Claimed %u of %u applications in %llu ms",
+                     (unsigned)(apps.size() - failed), (unsigned)apps.size(),
+                     GetTimestamp64() - start));
+    return (failed == 0) ? ER_OK : ER_FAIL;
+}
+
+QStatus SecurityAgentImpl::ClaimAsync(const OnlineApplication& app,
+                                      const IdentityInfo& identityInfo,
+                                      ClaimResultListener* listener,
+                                      shared_ptr<ClaimHandle>& handle)
+{
+    if (claimListener == nullptr) {
+        QCC_LogError(ER_FAIL, ("No ClaimListener set"));
+        return ER_FAIL;
+    }
+
+    shared_ptr<ClaimHandleImpl> claimHandle(new ClaimHandleImpl(app));
+    handle = claimHandle;
+    claimQueue.AddTask(new AsyncClaim(claimHandle, identityInfo, listener));
+    return ER_OK;
+}
+
+void SecurityAgentImpl::HandleTask(AsyncClaim* claim)
+{
+    claim->Complete(ClaimApplication(claim->handle->GetApplication(), claim->identityInfo, claim->handle.get()));
+}
+
 QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInfo& identityInfo)
+{
+    return ClaimApplication(app, identityInfo, nullptr);
+}
+
+QStatus SecurityAgentImpl::ClaimApplication(const OnlineApplication& app,
+                                            const IdentityInfo& identityInfo,
+                                            ClaimHandleImpl* handle)
 {
     QStatus status;
 
@@ -404,14 +769,12 @@ QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInf
     }
 
     // Check app
-    bool exist;
-    OnlineApplicationMap::iterator appItr = SafeAppExist(app.keyInfo, exist);
-    if (!exist) {
+    OnlineApplication _app;
+    if (!SafeAppExist(app.keyInfo, _app)) {
         status = ER_FAIL;
         QCC_LogError(status, ("Unknown application"));
         return status;
     }
-    OnlineApplication _app = appItr->second;
 
     PendingClaim pc(_app, &pendingClaims, &appsMutex);
     status = pc.Init();
@@ -423,6 +786,9 @@ QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInf
     /*===========================================================
      * Step 1: Select Session type  & Accept manifest
      */
+    if (!EnterClaimStage(handle, ClaimHandle::CLAIM_FETCHING_MANIFEST)) {
+        return ER_FAIL;
+    }
     Manifest manifest;
     PermissionConfigurator::ClaimCapabilities claimCapabilities;
     PermissionConfigurator::ClaimCapabilityAdditionalInfo claimCapInfo;
@@ -447,9 +813,40 @@ QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInf
     }
     ClaimContextImpl ctx(_app, manifest, claimCapabilities, claimCapInfo);
 
-    status = claimListener->ApproveManifestAndSelectSessionType(ctx);
-    if (ER_OK != status) {
-        return status;
+    if (!EnterClaimStage(handle, ClaimHandle::CLAIM_APPROVING_MANIFEST)) {
+        return ER_FAIL;
+    }
+    // Reuse an earlier decision on the same manifest, if it was remembered.
+    ManifestApproval approval;
+    bool hasDigest = (ER_OK == manifest.GetDigest(approval.digest));
+    bool remembered = false;
+    if (hasDigest && (ER_OK == caStorage->GetManifestApproval(approval))) {
+        if (!approval.approved) {
+            QCC_DbgPrintf(("Manifest was rejected before"));
+            return ER_MANIFEST_REJECTED;
+        }
+        if ((approval.claimType != PermissionConfigurator::CAPABLE_ECDHE_PSK) &&
+            (ER_OK == ctx.SetClaimType(approval.claimType))) {
+            QCC_DbgPrintf(("Manifest was approved before"));
+            ctx.ApproveManifest();
+            remembered = true;
+        }
+    }
+
+    if (!remembered) {
+        status = claimListener->ApproveManifestAndSelectSessionType(ctx);
+        if (ER_OK != status) {
+            return status;
+        }
+
+        if (hasDigest && ctx.IsDecisionRemembered()) {
+            approval.approved = ctx.IsManifestApproved();
+            approval.claimType = ctx.GetClaimType();
+            QStatus approvalStatus = caStorage->StoreManifestApproval(approval);
+            if ((ER_OK != approvalStatus) && (ER_NOT_IMPLEMENTED != approvalStatus)) {
+                QCC_LogError(approvalStatus, ("Failed to remember manifest decision"));
+            }
+        }
     }
 
     if (!ctx.IsManifestApproved()) {
@@ -466,6 +863,9 @@ QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInf
      * Step 2: Claim
      */
 
+    if (!EnterClaimStage(handle, ClaimHandle::CLAIM_SIGNING)) {
+        return ER_FAIL;
+    }
     KeyInfoNISTP256 CAKeyInfo;
     status = caStorage->GetCaPublicKeyInfo(CAKeyInfo);
     if (status != ER_OK) {
@@ -473,22 +873,36 @@ QStatus SecurityAgentImpl::Claim(const OnlineApplication& app, const IdentityInf
         return status;
     }
 
-    IdentityCertificateChain idCertificate;
-
-    GroupInfo adminGroup;
-    status = caStorage->StartApplicationClaiming(_app, identityInfo, manifest, adminGroup, idCertificate);
-    if (status != ER_OK) {
-        return status;
+    // Generate the identity certificate while the session is set up.
+    uint64_t start = GetTimestamp64();
+    ClaimSigner signer(caStorage, _app, identityInfo, manifest);
+    bool signing = (ER_OK == signer.Start());
+    if (!signing) {
+        signer.Sign();
     }
     {   // Open scope limit the lifetime of the proxy object
         ProxyObjectManager::ManagedProxyObject mngdProxy(_app);
         status = proxyObjectManager->GetProxyObject(mngdProxy, ctx.GetSessionType(), &ctx);
+        uint64_t joinTime = GetTimestamp64() - start;
+        if (signing) {
+            signer.Join();
+        }
+        if (ER_OK != signer.status) {
+            return signer.status;
+        }
         if (ER_OK != status) {
             QCC_LogError(status, ("Could not connect to application"));
             return status;
         }
+        QCC_DbgHLPrintf(("Claim setup took %llu ms (signing %llu ms, session %llu ms)",
+                         GetTimestamp64() - start, signer.duration, joinTime));
+
+        if (!EnterClaimStage(handle, ClaimHandle::CLAIM_CLAIMING)) {
+            caStorage->FinishApplicationClaiming(_app, ER_FAIL);
+            return ER_FAIL;
+        }
 
-        status = mngdProxy.Claim(CAKeyInfo, adminGroup, idCertificate, manifest);
+        status = mngdProxy.Claim(CAKeyInfo, signer.adminGroup, signer.idCertificate, manifest);
         if (ER_OK != status) {
             QCC_LogError(status, ("Could not claim application"));
         }
@@ -527,21 +941,33 @@ void SecurityAgentImpl::OnSecurityStateChange(const SecurityInfo* oldSecInfo,
 
     KeyInfoNISTP256 pubKeyInfo =
         (nullptr != newSecInfo) ? newSecInfo->keyInfo : oldSecInfo->keyInfo;
-    bool exist;
-    OnlineApplicationMap::iterator foundAppItr = SafeAppExist(pubKeyInfo, exist);
-
+    OnlineApplication old;
+    appsMutex.Lock(__FILE__, __LINE__);
+    bool exist = SafeAppExist(pubKeyInfo, old);
     if (exist) {
-        OnlineApplication old(foundAppItr->second);
         if (nullptr != newSecInfo) {
             // update of known application
-            AddSecurityInfo(foundAppItr->second, *newSecInfo);
-            NotifyApplicationListeners(&old, &foundAppItr->second);
-        } else {
-            // removal of known application
-            // no internal clean-up is done. See ASACORE-2549
-            NotifyApplicationListeners(&old, &foundAppItr->second);
+            OnlineApplication updated(old);
+            AddSecurityInfo(updated, *newSecInfo);
+            PublishApplication(updated);
+            NotifyApplicationListeners(&old, &updated);
+        } else if (old.busName == oldSecInfo->busName) {
+            // the application left the bus; a managed application is kept
+            // without a bus name, so its sync state remains available while
+            // it is offline, other applications are forgotten
+            OnlineApplication departed(old);
+            departed.busName.clear();
+            if (SYNC_UNMANAGED == departed.syncState) {
+                UnpublishApplication(departed);
+            } else {
+                PublishApplication(departed);
+            }
+            NotifyApplicationListeners(&old, &departed);
         }
-    } else {
+    }
+    appsMutex.Unlock(__FILE__, __LINE__);
+
+    if (!exist) {
         if (nullptr == newSecInfo) {
             // removal of unknown application
             return;
@@ -550,22 +976,87 @@ void SecurityAgentImpl::OnSecurityStateChange(const SecurityInfo* oldSecInfo,
         OnlineApplication app;
         AddSecurityInfo(app, *newSecInfo);
 
-        // retrieve syncStatus from storage
-        QStatus status = caStorage->GetManagedApplication(app);
-        if (ER_END_OF_DATA == status) {
-            app.syncState = SYNC_UNMANAGED;
-        } else if (ER_OK != status) {
-            QCC_LogError(status, ("Error retrieving application from storage"));
+        appsMutex.Lock(__FILE__, __LINE__);
+        bool preloaded = managedAppsPreloaded;
+        appsMutex.Unlock(__FILE__, __LINE__);
+        if (!preloaded) {
+            // Storage is not accessed with the appsMutex held.
+            LookupSyncState(app);
         }
 
+        // The sync state is taken and published in one go, so a concurrent
+        // SetSyncState either updates the preloaded state before it is taken
+        // or the published application after it.
         appsMutex.Lock(__FILE__, __LINE__);
-        applications[app.keyInfo] = app;
+        if (SafeAppExist(pubKeyInfo, old)) {
+            // found in the meantime
+            OnlineApplication updated(old);
+            AddSecurityInfo(updated, *newSecInfo);
+            PublishApplication(updated);
+            NotifyApplicationListeners(&old, &updated);
+            appsMutex.Unlock(__FILE__, __LINE__);
+            return;
+        }
+        TakePreloadedSyncState(app);
+        PublishApplication(app);
         appsMutex.Unlock(__FILE__, __LINE__);
 
         NotifyApplicationListeners(nullptr, &app);
     }
 }
 
+void SecurityAgentImpl::PreloadManagedApplications()
+{
+    uint64_t start = GetTimestamp64();
+    vector<Application> apps;
+    QStatus status = caStorage->GetManagedApplications(apps);
+    if (ER_OK != status) {
+        if (ER_NOT_IMPLEMENTED != status) {
+            QCC_LogError(status, ("Failed to preload managed applications"));
+        }
+        return;
+    }
+
+    appsMutex.Lock(__FILE__, __LINE__);
+    managedApps.clear();
+    managedApps.reserve(apps.size());
+    for (size_t i = 0; i < apps.size(); i++) {
+        managedApps[apps[i].keyInfo] = apps[i].syncState;
+    }
+    managedAppsPreloaded = true;
+    appsMutex.Unlock(__FILE__, __LINE__);
+
+    QCC_DbgHLPrintf(("Preloaded %u managed applications in %llu ms", (unsigned)apps.size(),
+                     (unsigned long long)(GetTimestamp64() - start)));
+}
+
+bool SecurityAgentImpl::TakePreloadedSyncState(OnlineApplication& app)
+{
+    if (!managedAppsPreloaded) {
+        return false;
+    }
+    unordered_map<KeyInfoNISTP256, ApplicationSyncState, KeyInfoHash>::iterator it = managedApps.find(app.keyInfo);
+    if (it != managedApps.end()) {
+        app.syncState = it->second;
+        // From now on, the application itself holds the sync state.
+        managedApps.erase(it);
+    } else {
+        app.syncState = SYNC_UNMANAGED;
+    }
+    return true;
+}
+
+void SecurityAgentImpl::LookupSyncState(OnlineApplication& app)
+{
+    // retrieve syncStatus from storage
+    QStatus status = caStorage->GetManagedApplication(app);
+    if (ER_END_OF_DATA == status) {
+        app.syncState = SYNC_UNMANAGED;
+    } else if (ER_OK != status) {
+        QCC_LogError(status, ("Error retrieving application from storage"));
+    }
+}
+
 const KeyInfoNISTP256& SecurityAgentImpl::GetPublicKeyInfo() const
 {
     return publicKeyInfo;
@@ -574,14 +1065,13 @@ const KeyInfoNISTP256& SecurityAgentImpl::GetPublicKeyInfo() const
 QStatus SecurityAgentImpl::GetApplication(OnlineApplication& _application) const
 {
     QStatus status = ER_END_OF_DATA;
-    appsMutex.Lock(__FILE__, __LINE__);
+    shared_ptr<const ApplicationSnapshot> snapshot = GetSnapshot();
 
-    OnlineApplicationMap::const_iterator ret = applications.find(_application.keyInfo);
-    if (ret != applications.end()) {
+    const OnlineApplication* app = snapshot->Find(_application.keyInfo);
+    if (app != nullptr) {
         status = ER_OK;
-        _application = ret->second;
+        _application = *app;
     }
-    appsMutex.Unlock(__FILE__, __LINE__);
 
     return status;
 }
@@ -591,24 +1081,13 @@ QStatus SecurityAgentImpl::GetApplications(vector<OnlineApplication>& apps,
 const
 {
     QStatus status = ER_FAIL;
-    OnlineApplicationMap::const_iterator appItr;
-
-    appsMutex.Lock(__FILE__, __LINE__);
+    shared_ptr<const ApplicationSnapshot> snapshot = GetSnapshot();
 
-    if (applications.empty()) {
-        appsMutex.Unlock(__FILE__, __LINE__);
+    if (snapshot->Empty()) {
         return ER_END_OF_DATA;
     }
 
-    for (appItr = applications.begin(); appItr != applications.end();
-         ++appItr) {
-        const OnlineApplication& app = appItr->second;
-        if (appItr->second.applicationState == applicationState) {
-            apps.push_back(app);
-        }
-    }
-
-    appsMutex.Unlock(__FILE__, __LINE__);
+    snapshot->GetByState(applicationState, apps);
 
     status = (apps.empty() ? ER_END_OF_DATA : ER_OK);
 
@@ -617,42 +1096,156 @@ const
 
 void SecurityAgentImpl::RegisterApplicationListener(ApplicationListener* al)
 {
+    DeleteIdleRetiredListeners();
     if (nullptr != al) {
         applicationListenersMutex.Lock(__FILE__, __LINE__);
-        listeners.push_back(al);
+        listeners.push_back(new ApplicationListenerQueue(al, 0));
+        applicationListenersMutex.Unlock(__FILE__, __LINE__);
+    }
+}
+
+void SecurityAgentImpl::RegisterBatchedApplicationListener(ApplicationListener* al,
+                                                           uint32_t batchWindow)
+{
+    DeleteIdleRetiredListeners();
+    if (nullptr != al) {
+        applicationListenersMutex.Lock(__FILE__, __LINE__);
+        listeners.push_back(new ApplicationListenerQueue(al, (batchWindow == 0) ? 1 : batchWindow));
         applicationListenersMutex.Unlock(__FILE__, __LINE__);
     }
 }
 
 void SecurityAgentImpl::UnregisterApplicationListener(ApplicationListener* al)
 {
+    ApplicationListenerQueue* listenerQueue = nullptr;
+    applicationListenersMutex.Lock(__FILE__, __LINE__);
+    vector<ApplicationListenerQueue*>::iterator it = listeners.begin();
+    for (; it != listeners.end(); ++it) {
+        if ((*it)->GetListener() == al) {
+            listenerQueue = *it;
+            listeners.erase(it);
+            break;
+        }
+    }
+    applicationListenersMutex.Unlock(__FILE__, __LINE__);
+
+    if (listenerQueue != nullptr) {
+        // Wait for an ongoing callback outside the lock, as the listener may
+        // (un)register listeners itself. The queue cannot be deleted here, as
+        // this may be called from its own worker.
+        listenerQueue->Remove();
+        applicationListenersMutex.Lock(__FILE__, __LINE__);
+        retiredListeners.push_back(listenerQueue);
+        applicationListenersMutex.Unlock(__FILE__, __LINE__);
+    }
+    DeleteIdleRetiredListeners();
+}
+
+void SecurityAgentImpl::DeleteIdleRetiredListeners()
+{
+    // A queue whose worker is still busy may be the caller; it is deleted by
+    // a later call or on destruction.
+    vector<ApplicationListenerQueue*> idleQueues;
     applicationListenersMutex.Lock(__FILE__, __LINE__);
-    vector<ApplicationListener*>::iterator it = find(
-        listeners.begin(), listeners.end(), al);
-    if (listeners.end() != it) {
-        listeners.erase(it);
+    vector<ApplicationListenerQueue*>::iterator it = retiredListeners.begin();
+    while (it != retiredListeners.end()) {
+        if ((*it)->IsIdle()) {
+            idleQueues.push_back(*it);
+            it = retiredListeners.erase(it);
+        } else {
+            ++it;
+        }
     }
     applicationListenersMutex.Unlock(__FILE__, __LINE__);
+    for (size_t i = 0; i < idleQueues.size(); i++) {
+        delete idleQueues[i];
+    }
 }
 
-SecurityAgentImpl::OnlineApplicationMap::iterator SecurityAgentImpl::SafeAppExist(const KeyInfoNISTP256 key,
-                                                                                  bool& exist)
+shared_ptr<const ApplicationSnapshot> SecurityAgentImpl::GetSnapshot() const
 {
-    appsMutex.Lock(__FILE__, __LINE__);
-    OnlineApplicationMap::iterator ret = applications.find(key);
-    exist = (ret != applications.end());
-    appsMutex.Unlock(__FILE__, __LINE__);
-    return ret;
+    return atomic_load(&applications);
+}
+
+void SecurityAgentImpl::PublishApplication(const OnlineApplication& app)
+{
+    changesLock.Lock(__FILE__, __LINE__);
+    shared_ptr<const ApplicationSnapshot> next = GetSnapshot()->With(app);
+    atomic_store(&applications, next);
+    AddChange(next->GetVersion(), app);
+    changesLock.Unlock(__FILE__, __LINE__);
+}
+
+void SecurityAgentImpl::UnpublishApplication(const OnlineApplication& app)
+{
+    changesLock.Lock(__FILE__, __LINE__);
+    shared_ptr<const ApplicationSnapshot> next = GetSnapshot()->Without(app.keyInfo);
+    atomic_store(&applications, next);
+    // The history keeps the last state, so the removal can still be reported.
+    AddChange(next->GetVersion(), app);
+    changesLock.Unlock(__FILE__, __LINE__);
+}
+
+void SecurityAgentImpl::AddChange(uint64_t version,
+                                  const OnlineApplication& app)
+{
+    changes.push_back(make_pair(version, app));
+    if (changes.size() > APPLICATION_CHANGES_HISTORY) {
+        changes.pop_front();
+    }
+}
+
+QStatus SecurityAgentImpl::GetApplicationChanges(uint64_t& version,
+                                                 vector<OnlineApplication>& apps) const
+{
+    changesLock.Lock(__FILE__, __LINE__);
+    shared_ptr<const ApplicationSnapshot> snapshot = GetSnapshot();
+    uint64_t since = version;
+    version = snapshot->GetVersion();
+    if (since >= version) {
+        changesLock.Unlock(__FILE__, __LINE__);
+        return ER_OK;
+    }
+    if (changes.empty() || (changes.front().first > since + 1)) {
+        // The history does not go back far enough; report everything.
+        changesLock.Unlock(__FILE__, __LINE__);
+        snapshot->GetAll(apps);
+        return ER_OK;
+    }
+    // Versions in the history are consecutive. The newest change of an
+    // application that is no longer known holds its last state.
+    ApplicationSnapshot::KeySet changed;
+    size_t first = (size_t)(since + 1 - changes.front().first);
+    for (size_t i = changes.size(); i > first; i--) {
+        const OnlineApplication& change = changes[i - 1].second;
+        if (changed.insert(change.keyInfo).second) {
+            const OnlineApplication* app = snapshot->Find(change.keyInfo);
+            apps.push_back((app != nullptr) ? *app : change);
+        }
+    }
+    changesLock.Unlock(__FILE__, __LINE__);
+    return ER_OK;
+}
+
+bool SecurityAgentImpl::SafeAppExist(const KeyInfoNISTP256& key,
+                                     OnlineApplication& app)
+{
+    shared_ptr<const ApplicationSnapshot> snapshot = GetSnapshot();
+    const OnlineApplication* found = snapshot->Find(key);
+    if (found != nullptr) {
+        app = *found;
+    }
+    return (found != nullptr);
 }
 
 void SecurityAgentImpl::NotifyApplicationListeners(const ManifestUpdate* manifestUpdate)
 {
-    queue.AddTask(new AppListenerEvent(manifestUpdate));
+    DispatchToApplicationListeners(make_shared<AppListenerEvent>(manifestUpdate));
 }
 
 void SecurityAgentImpl::NotifyApplicationListeners(const SyncError* error)
 {
-    queue.AddTask(new AppListenerEvent(error));
+    DispatchToApplicationListeners(make_shared<AppListenerEvent>(error));
 }
 
 void SecurityAgentImpl::OnPendingChanges(vector<Application>& apps)
@@ -687,9 +1280,12 @@ void SecurityAgentImpl::OnStorageReset()
 {
     appsMutex.Lock(__FILE__, __LINE__);
 
-    OnlineApplicationMap::iterator it;
-    for (it = applications.begin(); it != applications.end(); ++it) {
-        SetSyncState(it->second, SYNC_UNMANAGED);
+    managedApps.clear();
+
+    vector<OnlineApplication> apps;
+    GetSnapshot()->GetAll(apps);
+    for (size_t i = 0; i < apps.size(); i++) {
+        SetSyncState(apps[i], SYNC_UNMANAGED);
     }
 
     appsMutex.Unlock(__FILE__, __LINE__);
@@ -698,59 +1294,40 @@ void SecurityAgentImpl::OnStorageReset()
 void SecurityAgentImpl::NotifyApplicationListeners(const OnlineApplication* oldApp,
                                                    const OnlineApplication* newApp)
 {
-    queue.AddTask(new AppListenerEvent(oldApp ? new OnlineApplication(*oldApp) : nullptr,
-                                       newApp ? new OnlineApplication(*newApp) : nullptr));
+    DispatchToApplicationListeners(make_shared<AppListenerEvent>(oldApp, newApp));
 }
 
-void SecurityAgentImpl::HandleTask(AppListenerEvent* event)
+void SecurityAgentImpl::DispatchToApplicationListeners(const shared_ptr<AppListenerEvent>& event)
 {
     applicationListenersMutex.Lock(__FILE__, __LINE__);
-    if (event->syncError) {
-        for (size_t i = 0; i < listeners.size(); ++i) {
-            listeners[i]->OnSyncError(event->syncError);
-        }
-    } else if (event->manifestUpdate) {
-        for (size_t i = 0; i < listeners.size(); ++i) {
-            listeners[i]->OnManifestUpdate(event->manifestUpdate);
-        }
-    } else {
-        for (size_t i = 0; i < listeners.size(); ++i) {
-            listeners[i]->OnApplicationStateChange(event->oldApp, event->newApp);
-        }
+    for (size_t i = 0; i < listeners.size(); ++i) {
+        listeners[i]->Add(event);
     }
     applicationListenersMutex.Unlock(__FILE__, __LINE__);
 }
 
-QStatus SecurityAgentImpl::GetApplicationSecInfo(SecurityInfo& secInfo) const
-{
-    return appMonitor->GetApplication(secInfo);
-}
-
 void SecurityAgentImpl::UpdateApplications(const vector<OnlineApplication>* apps)
 {
     bool syncAll = (apps == nullptr);
-    OnlineApplicationMap::const_iterator appMapItr;
+    vector<OnlineApplication> claimed;
 
+    shared_ptr<const ApplicationSnapshot> snapshot = GetSnapshot();
     if (syncAll) {
-        for (appMapItr = applications.begin(); appMapItr != applications.end();
-             ++appMapItr) {
-            const OnlineApplication& app = appMapItr->second;
-            if (app.applicationState == PermissionConfigurator::CLAIMED) {
-                applicationUpdater->UpdateApplication(app);
-            }
-        }
+        snapshot->GetByState(PermissionConfigurator::CLAIMED, claimed);
     } else {
         vector<OnlineApplication>::const_iterator appItr = apps->begin();
         while (appItr != apps->end()) {
-            if ((appMapItr = applications.find(appItr->keyInfo)) != applications.end()) {
-                const OnlineApplication& app = appMapItr->second;
-                if (app.applicationState == PermissionConfigurator::CLAIMED) {
-                    applicationUpdater->UpdateApplication(app);
-                }
+            const OnlineApplication* app = snapshot->Find(appItr->keyInfo);
+            if ((app != nullptr) && (app->applicationState == PermissionConfigurator::CLAIMED)) {
+                claimed.push_back(*app);
             }
             appItr++;
         }
     }
+
+    for (size_t i = 0; i < claimed.size(); i++) {
+        applicationUpdater->UpdateApplication(claimed[i]);
+    }
 }
 }
 }
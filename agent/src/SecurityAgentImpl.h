@@ -17,7 +17,9 @@
 #ifndef ALLJOYN_SECMGR_SECURITYAGENTIMPL_H_
 #define ALLJOYN_SECMGR_SECURITYAGENTIMPL_H_
 
+#include <deque>
 #include <memory>
+#include <unordered_map>
 
 #include <qcc/CryptoECC.h>
 #include <qcc/Mutex.h>
@@ -35,7 +37,9 @@
 #include <alljoyn/securitymgr/AgentCAStorage.h>
 #include <alljoyn/securitymgr/ManifestUpdate.h>
 
+#include "ApplicationListenerQueue.h"
 #include "ApplicationMonitor.h"
+#include "ApplicationSnapshot.h"
 #include "ProxyObjectManager.h"
 #include "ApplicationUpdater.h"
 #include "TaskQueue.h"
@@ -47,43 +51,15 @@ namespace securitymgr {
 class Identity;
 class SecurityInfoListener;
 class ApplicationUpdater;
+class ClaimHandleImpl;
+class AsyncClaim;
 struct SecurityInfo;
 
-class AppListenerEvent {
-  public:
-    AppListenerEvent(const OnlineApplication* _oldInfo,
-                     const OnlineApplication* _newInfo) :
-        oldApp(_oldInfo), newApp(_newInfo), syncError(nullptr), manifestUpdate(nullptr)
-    {
-    }
-
-    AppListenerEvent(const SyncError* _error) :
-        oldApp(nullptr), newApp(nullptr), syncError(_error), manifestUpdate(nullptr)
-    {
-    }
-
-    AppListenerEvent(const ManifestUpdate* _manifestUpdate) :
-        oldApp(nullptr), newApp(nullptr), syncError(nullptr), manifestUpdate(_manifestUpdate)
-    {
-    }
-
-    ~AppListenerEvent()
-    {
-        delete oldApp;
-        oldApp = nullptr;
-        delete newApp;
-        newApp = nullptr;
-        delete syncError;
-        syncError = nullptr;
-        delete manifestUpdate;
-        manifestUpdate = nullptr;
-    }
-
-    const OnlineApplication* oldApp;
-    const OnlineApplication* newApp;
-    const SyncError* syncError;
-    const ManifestUpdate* manifestUpdate;
-};
+/* Number of application changes kept for GetApplicationChanges. */
+#define APPLICATION_CHANGES_HISTORY 4096
+
+/* Maximum number of claims started by ClaimAsync that run concurrently. */
+#define CLAIM_ASYNC_MAX_WORKERS 4
 
 /**
  * @brief the class provides for the SecurityManager implementation hiding
@@ -104,19 +80,30 @@ class SecurityAgentImpl :
     QStatus Claim(const OnlineApplication& app,
                   const IdentityInfo& identityInfo);
 
+    QStatus ClaimApplications(const vector<OnlineApplication>& apps,
+                              const IdentityInfo& identityInfo,
+                              ClaimResultListener* listener,
+                              size_t maxInFlight = CLAIM_APPLICATIONS_DEFAULT_MAX_IN_FLIGHT);
+
+    QStatus ClaimAsync(const OnlineApplication& app,
+                       const IdentityInfo& identityInfo,
+                       ClaimResultListener* listener,
+                       shared_ptr<ClaimHandle>& handle);
+
     QStatus GetApplications(vector<OnlineApplication>& apps,
                             const PermissionConfigurator::ApplicationState applicationState =
                                 PermissionConfigurator::CLAIMABLE) const;
 
     QStatus GetApplication(OnlineApplication& _application) const;
 
+    QStatus GetApplicationChanges(uint64_t& version,
+                                  vector<OnlineApplication>& apps) const;
+
     QStatus SetSyncState(const Application& app,
                          const ApplicationSyncState syncState);
 
     void UpdateApplications(const vector<OnlineApplication>* apps = nullptr);
 
-    QStatus GetApplicationSecInfo(SecurityInfo& secInfo) const;
-
     const KeyInfoNISTP256& GetPublicKeyInfo() const;
 
     void NotifyApplicationListeners(const ManifestUpdate* manifestUpdate);
@@ -127,19 +114,25 @@ class SecurityAgentImpl :
 
     void RegisterApplicationListener(ApplicationListener* al);
 
+    void RegisterBatchedApplicationListener(ApplicationListener* al,
+                                            uint32_t batchWindow = APPLICATION_LISTENER_DEFAULT_BATCH_WINDOW);
+
     void UnregisterApplicationListener(ApplicationListener* al);
 
     virtual void OnSecurityStateChange(const SecurityInfo* oldSecInfo,
                                        const SecurityInfo* newSecInfo);
 
-    void HandleTask(AppListenerEvent* event);
+    void HandleTask(AsyncClaim* claim);
 
   private:
 
-    typedef map<KeyInfoNISTP256, OnlineApplication> OnlineApplicationMap;
-
     QStatus ClaimSelf();
 
+    /* Claims an application. Progress is reported to the handle, if any. */
+    QStatus ClaimApplication(const OnlineApplication& app,
+                             const IdentityInfo& identityInfo,
+                             ClaimHandleImpl* handle);
+
     virtual void OnPendingChanges(vector<Application>& apps);
 
     virtual void OnPendingChangesCompleted(vector<Application>& apps);
@@ -150,15 +143,46 @@ class SecurityAgentImpl :
 
     virtual void OnStorageReset();
 
-    OnlineApplicationMap::iterator SafeAppExist(const KeyInfoNISTP256 key,
-                                                bool& exist);
+    bool SafeAppExist(const KeyInfoNISTP256& key,
+                      OnlineApplication& app);
+
+    shared_ptr<const ApplicationSnapshot> GetSnapshot() const;
+
+    /* Publishes a new snapshot with an added or changed application.
+     * Must be called with appsMutex held. */
+    void PublishApplication(const OnlineApplication& app);
+
+    /* Publishes a new snapshot without an application that went offline
+     * and is not managed. Must be called with appsMutex held. */
+    void UnpublishApplication(const OnlineApplication& app);
+
+    /* Adds a published snapshot to the history of changes. */
+    void AddChange(uint64_t version,
+                   const OnlineApplication& app);
 
     void AddSecurityInfo(OnlineApplication& app,
                          const SecurityInfo& si);
 
+    /* Loads the sync states of all managed applications in one go, so the
+     * applications found during discovery need no storage access. */
+    void PreloadManagedApplications();
+
+    /* Sets the sync state of a newly found application from the preloaded
+     * managed applications. Returns false if these were not preloaded.
+     * Must be called with appsMutex held. */
+    bool TakePreloadedSyncState(OnlineApplication& app);
+
+    /* Sets the sync state of a newly found application from storage. */
+    void LookupSyncState(OnlineApplication& app);
+
     void NotifyApplicationListeners(const OnlineApplication* oldApp,
                                     const OnlineApplication* newApp);
 
+    void DispatchToApplicationListeners(const shared_ptr<AppListenerEvent>& event);
+
+    /* Deletes the retired listener queues whose worker is idle. */
+    void DeleteIdleRetiredListeners();
+
     // To prevent compilation warning on MSCV.
     SecurityAgentImpl& operator=(const SecurityAgentImpl& other);
 
@@ -211,18 +235,23 @@ class SecurityAgentImpl :
     };
 
     KeyInfoNISTP256 publicKeyInfo;
-    OnlineApplicationMap applications;
-    vector<ApplicationListener*> listeners;
+    shared_ptr<const ApplicationSnapshot> applications; // Only access with atomic_load/atomic_store.
+    vector<ApplicationListenerQueue*> listeners;
+    vector<ApplicationListenerQueue*> retiredListeners; // Unregistered, deleted once idle.
     shared_ptr<ProxyObjectManager> proxyObjectManager;
     shared_ptr<ApplicationUpdater> applicationUpdater;
     shared_ptr<ApplicationMonitor> appMonitor;
     BusAttachment* busAttachment;
     bool ownBa;
     const shared_ptr<AgentCAStorage>& caStorage;
-    mutable Mutex appsMutex;
+    mutable Mutex appsMutex; // Serializes changes to applications.
+    unordered_map<KeyInfoNISTP256, ApplicationSyncState, KeyInfoHash> managedApps; // Preloaded, for applications not found yet.
+    bool managedAppsPreloaded; // Guarded by appsMutex, like managedApps.
+    mutable Mutex changesLock;
+    deque<pair<uint64_t, OnlineApplication> > changes; // Version and application of the latest changes.
     mutable Mutex applicationListenersMutex;
     vector<OnlineApplication> pendingClaims;
-    TaskQueue<AppListenerEvent*, SecurityAgentImpl> queue;
+    TaskQueue<AsyncClaim*, SecurityAgentImpl> claimQueue;
     ClaimListener* claimListener;
 };
 }
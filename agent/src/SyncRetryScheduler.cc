@@ -0,0 +1,215 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "SyncRetryScheduler.h"
+
+#include <vector>
+
+#include <qcc/Debug.h>
+#include <qcc/Util.h>
+#include <qcc/time.h>
+
+#define QCC_MODULE "SECMGR_UPDATER"
+
+using namespace std;
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+SyncRetryBudget::SyncRetryBudget(uint32_t _budget,
+                                 uint32_t _interval,
+                                 uint64_t now) :
+    budget((0 == _budget) ? 1 : _budget), interval((0 == _interval) ? 1 : _interval),
+    tokens(budget), lastRefill(now)
+{
+}
+
+uint64_t SyncRetryBudget::Take(uint64_t now)
+{
+    if (now > lastRefill) {
+        uint64_t earned = (now - lastRefill) / interval;
+        if (earned > 0) {
+            tokens = (uint32_t)(((tokens + earned) > budget) ? budget : (tokens + earned));
+            lastRefill += earned * interval;
+        }
+    }
+    if (tokens == budget) {
+        lastRefill = now;
+    }
+    if (0 == tokens) {
+        return (lastRefill + interval > now) ? (lastRefill + interval - now) : 1;
+    }
+    tokens--;
+    return 0;
+}
+
+SyncRetryScheduler::SyncRetryScheduler(const shared_ptr<AgentCAStorage>& _storage,
+                                       SyncRetryListener* _listener,
+                                       const SyncRetryConfig& _config) :
+    Thread("SyncRetryScheduler"), storage(_storage), listener(_listener), config(_config),
+    stopped(false), budget(_config.budget, _config.budgetInterval, GetEpochTimestamp())
+{
+    if (0 == config.initialDelay) {
+        config.initialDelay = 1;
+    }
+}
+
+void SyncRetryScheduler::Reschedule(const SyncRetry& retry)
+{
+    map<Application, ScheduledRetry>::iterator it = retries.find(retry.app);
+    if (it == retries.end()) {
+        it = retries.insert(make_pair(retry.app, ScheduledRetry())).first;
+    } else {
+        schedule.erase(it->second.due);
+    }
+    it->second.retry = retry;
+    it->second.due = schedule.insert(make_pair(retry.nextAttempt, retry.app));
+}
+
+void SyncRetryScheduler::ScheduleRetry(const Application& app)
+{
+    // Storage is not accessed with the lock held, as that would block Run.
+    persistLock.Lock(__FILE__, __LINE__);
+    lock.Lock(__FILE__, __LINE__);
+    SyncRetry retry;
+    map<Application, ScheduledRetry>::iterator it = retries.find(app);
+    if (it != retries.end()) {
+        retry = it->second.retry;
+    }
+    retry.app = app;
+    retry.attempts++;
+    retry.nextAttempt = GetEpochTimestamp() + GetBackoff(config, retry.attempts);
+    Reschedule(retry);
+    cond.Signal();
+    lock.Unlock(__FILE__, __LINE__);
+
+    QCC_DbgPrintf(("Retry %u of a sync scheduled in %llu ms", retry.attempts,
+                   retry.nextAttempt - GetEpochTimestamp()));
+    QStatus status = storage->StoreSyncRetry(retry);
+    if ((ER_OK != status) && (ER_NOT_IMPLEMENTED != status)) {
+        QCC_LogError(status, ("Failed to persist sync retry"));
+    }
+    persistLock.Unlock(__FILE__, __LINE__);
+}
+
+void SyncRetryScheduler::CancelRetry(const Application& app)
+{
+    persistLock.Lock(__FILE__, __LINE__);
+    lock.Lock(__FILE__, __LINE__);
+    bool erased = false;
+    map<Application, ScheduledRetry>::iterator it = retries.find(app);
+    if (it != retries.end()) {
+        schedule.erase(it->second.due);
+        retries.erase(it);
+        erased = true;
+    }
+    lock.Unlock(__FILE__, __LINE__);
+
+    if (erased) {
+        QStatus status = storage->RemoveSyncRetry(app);
+        if ((ER_OK != status) && (ER_NOT_IMPLEMENTED != status)) {
+            QCC_LogError(status, ("Failed to remove sync retry"));
+        }
+    }
+    persistLock.Unlock(__FILE__, __LINE__);
+}
+
+void SyncRetryScheduler::Terminate()
+{
+    lock.Lock(__FILE__, __LINE__);
+    stopped = true;
+    cond.Signal();
+    lock.Unlock(__FILE__, __LINE__);
+}
+
+uint64_t SyncRetryScheduler::GetBackoff(const SyncRetryConfig& config,
+                                        uint32_t attempts)
+{
+    uint64_t delay = (0 == config.initialDelay) ? 1 : config.initialDelay;
+    for (uint32_t i = 1; (i < attempts) && (delay < config.maxDelay); i++) {
+        delay *= 2;
+    }
+    if (delay > config.maxDelay) {
+        delay = config.maxDelay;
+    }
+    // Spread retries over the second half of the delay, so applications that
+    // failed together are not retried together.
+    uint64_t half = delay / 2;
+    return (delay - half) + (Rand32() % (half + 1));
+}
+
+void SyncRetryScheduler::LoadRetries()
+{
+    vector<SyncRetry> persisted;
+    QStatus status = storage->GetSyncRetries(persisted);
+    if (ER_OK != status) {
+        if (ER_NOT_IMPLEMENTED != status) {
+            QCC_LogError(status, ("Failed to load sync retries"));
+        }
+        return;
+    }
+
+    lock.Lock(__FILE__, __LINE__);
+    for (size_t i = 0; i < persisted.size(); i++) {
+        // Retries scheduled since the start take precedence.
+        if (retries.find(persisted[i].app) == retries.end()) {
+            Reschedule(persisted[i]);
+        }
+    }
+    lock.Unlock(__FILE__, __LINE__);
+    QCC_DbgPrintf(("Loaded %u sync retries", (unsigned)persisted.size()));
+}
+
+ThreadReturn STDCALL SyncRetryScheduler::Run(void* arg)
+{
+    QCC_UNUSED(arg);
+
+    LoadRetries();
+
+    lock.Lock(__FILE__, __LINE__);
+    while (!stopped) {
+        if (schedule.empty()) {
+            cond.Wait(lock);
+            continue;
+        }
+
+        Schedule::iterator next = schedule.begin();
+        uint64_t now = GetEpochTimestamp();
+        uint64_t wait = (next->first > now) ? (next->first - now) : budget.Take(now);
+        if (wait > 0) {
+            cond.TimedWait(lock, (uint32_t)((wait > 0xFFFFFFFF) ? 0xFFFFFFFF : wait));
+            continue;
+        }
+
+        // Push the attempt back until the outcome of this retry is known.
+        SyncRetry retry = retries[next->second].retry;
+        retry.nextAttempt = now + GetBackoff(config, retry.attempts + 1);
+        Reschedule(retry);
+        lock.Unlock(__FILE__, __LINE__);
+
+        if (!listener->OnSyncRetry(retry.app)) {
+            ScheduleRetry(retry.app);
+        }
+
+        lock.Lock(__FILE__, __LINE__);
+    }
+    lock.Unlock(__FILE__, __LINE__);
+
+    return nullptr;
+}
+}
+}
+#undef QCC_MODULE
@@ -0,0 +1,170 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_SYNCRETRYSCHEDULER_H_
+#define ALLJOYN_SECMGR_SYNCRETRYSCHEDULER_H_
+
+#include <map>
+#include <memory>
+
+#include <qcc/Condition.h>
+#include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+
+#include <alljoyn/securitymgr/AgentCAStorage.h>
+#include <alljoyn/securitymgr/Application.h>
+
+using namespace std;
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+/* Delay (in ms) before the first retry of a failed sync. */
+#define SYNC_RETRY_DEFAULT_INITIAL_DELAY 5000
+/* Maximum delay (in ms) between two retries of the same application. */
+#define SYNC_RETRY_DEFAULT_MAX_DELAY (30 * 60 * 1000)
+/* Maximum number of retries that can be started in a burst. */
+#define SYNC_RETRY_DEFAULT_BUDGET 10
+/* Time (in ms) it takes to earn back one retry of the budget. */
+#define SYNC_RETRY_DEFAULT_BUDGET_INTERVAL 1000
+
+struct SyncRetryConfig {
+    uint32_t initialDelay;   // Delay (in ms) before the first retry.
+    uint32_t maxDelay;       // The delay doubles per attempt up to this maximum (in ms).
+    uint32_t budget;         // Maximum number of retries started in a burst.
+    uint32_t budgetInterval; // Time (in ms) to earn back one retry.
+
+    SyncRetryConfig() :
+        initialDelay(SYNC_RETRY_DEFAULT_INITIAL_DELAY),
+        maxDelay(SYNC_RETRY_DEFAULT_MAX_DELAY),
+        budget(SYNC_RETRY_DEFAULT_BUDGET),
+        budgetInterval(SYNC_RETRY_DEFAULT_BUDGET_INTERVAL)
+    {
+    }
+};
+
+/**
+ * @brief Token bucket limiting the number of retries that start in a burst.
+ */
+class SyncRetryBudget {
+  public:
+    /**
+     * @param[in] budget    Maximum number of retries started in a burst; at least 1.
+     * @param[in] interval  Time (in ms) to earn back one retry.
+     * @param[in] now       Epoch time (in ms) at which the budget is full.
+     */
+    SyncRetryBudget(uint32_t budget,
+                    uint32_t interval,
+                    uint64_t now);
+
+    /**
+     * @brief Take a retry out of the budget.
+     *
+     * @param[in] now  The current epoch time (in ms).
+     *
+     * @return 0 if a retry may start now; otherwise the time (in ms) until
+     *         one is earned back, and nothing is taken.
+     */
+    uint64_t Take(uint64_t now);
+
+  private:
+    uint32_t budget;
+    uint32_t interval;
+    uint32_t tokens;     // The retries left in the budget.
+    uint64_t lastRefill; // Epoch time (in ms) the budget was last refilled.
+};
+
+class SyncRetryListener {
+  public:
+    /**
+     * @brief Called when a failed sync of an application should be retried.
+     *
+     * @return true if a retry was started; false if the application could
+     *         not be retried now (e.g., it is offline).
+     */
+    virtual bool OnSyncRetry(const Application& app) = 0;
+
+    virtual ~SyncRetryListener() { }
+};
+
+/**
+ * @brief Thread that retries failed syncs with a per application exponential
+ *        backoff and jitter. The time of the next attempt is persisted, so
+ *        retries survive a restart of the agent. Retries are rate limited by
+ *        a global budget so a fleet of failing applications does not flood
+ *        the bus.
+ */
+class SyncRetryScheduler :
+    public Thread {
+  public:
+    SyncRetryScheduler(const shared_ptr<AgentCAStorage>& _storage,
+                       SyncRetryListener* _listener, // No ownership.
+                       const SyncRetryConfig& _config = SyncRetryConfig());
+
+    /**
+     * @brief Schedule the next attempt for an application of which a sync failed.
+     */
+    void ScheduleRetry(const Application& app);
+
+    /**
+     * @brief Forget the pending retry of an application, e.g., because a sync succeeded.
+     */
+    void CancelRetry(const Application& app);
+
+    /**
+     * @brief Make the thread exit. The caller should still Join the thread.
+     */
+    void Terminate();
+
+    /**
+     * @brief The delay (in ms) before attempt number attempts + 1: it doubles
+     *        per attempt up to the maximum delay, and is jittered over its
+     *        second half.
+     */
+    static uint64_t GetBackoff(const SyncRetryConfig& config,
+                               uint32_t attempts);
+
+  protected:
+    virtual ThreadReturn STDCALL Run(void* arg);
+
+  private:
+    typedef multimap<uint64_t, Application> Schedule;
+
+    struct ScheduledRetry {
+        SyncRetry retry;
+        Schedule::iterator due; // The entry of the retry in the schedule.
+    };
+
+    // Must be called with the lock held.
+    void Reschedule(const SyncRetry& retry);
+
+    void LoadRetries();
+
+    shared_ptr<AgentCAStorage> storage;
+    SyncRetryListener* listener;
+    SyncRetryConfig config;
+    bool stopped;
+    map<Application, ScheduledRetry> retries;
+    Schedule schedule;       // The applications by epoch time (in ms) of their next attempt.
+    SyncRetryBudget budget;
+    Mutex lock;
+    Mutex persistLock;       // Taken before lock; keeps storage in the order of the changes.
+    Condition cond;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_SYNCRETRYSCHEDULER_H_ */
@@ -17,69 +17,285 @@
 #ifndef ALLJOYN_SECMGR_TASKQUEUE_H_
 #define ALLJOYN_SECMGR_TASKQUEUE_H_
 
+#include <deque>
 #include <vector>
 
 #include <qcc/Mutex.h>
 #include <qcc/Condition.h>
 #include <qcc/Thread.h>
+#include <qcc/time.h>
 
 using namespace std;
 using namespace qcc;
 
 namespace ajn {
 namespace securitymgr {
+/* Time (in ms) an idle worker waits for new tasks before it exits. */
+#define TASKQUEUE_DEFAULT_IDLE_TIMEOUT 30000
+
+/* Time (in ms) after which a queued task is handled ahead of higher priority tasks. */
+#define TASKQUEUE_DEFAULT_MAX_WAIT 5000
+
+/**
+ * What AddTask does when a bounded queue is full.
+ */
+enum TaskQueueOverflowPolicy {
+    TASKQUEUE_BLOCK = 0,       ///< Wait until a worker has taken a task from the queue.
+    TASKQUEUE_DROP_OLDEST = 1, ///< Discard the oldest queued task.
+    TASKQUEUE_COALESCE = 2     ///< Merge the new task into a queued one; discard the oldest if none matches.
+};
+
+/**
+ * Counters describing the tasks of a single priority level.
+ */
+struct TaskQueuePriorityStats {
+    size_t depth;          ///< The number of queued tasks.
+    uint64_t handled;      ///< The number of tasks taken from the queue.
+    uint64_t totalLatency; ///< The total time (in ms) these tasks were queued.
+    uint64_t maxLatency;   ///< The longest time (in ms) one of these tasks was queued.
+
+    TaskQueuePriorityStats() :
+        depth(0), handled(0), totalLatency(0), maxLatency(0) { }
+};
+
+/**
+ * Counters describing the load of a TaskQueue.
+ */
+struct TaskQueueStats {
+    size_t depth;          ///< The number of queued tasks.
+    size_t highWaterMark;  ///< The maximum number of queued tasks so far.
+    uint64_t added;        ///< The number of tasks added.
+    uint64_t dropped;      ///< The number of tasks discarded because the queue was full.
+    uint64_t coalesced;    ///< The number of tasks merged into a queued task.
+    uint64_t aged;         ///< The number of tasks handled ahead of higher priority tasks.
+    vector<TaskQueuePriorityStats> priorities; ///< Per priority level, highest first.
+
+    TaskQueueStats() :
+        depth(0), highWaterMark(0), added(0), dropped(0), coalesced(0), aged(0) { }
+};
+
 template <typename TASK, typename HANDLER>
 class TaskQueue {
   public:
 
-    TaskQueue(HANDLER* handler) :
-        running(false),
+    /**
+     * Merges an incoming task into a queued one if they are about the same
+     * subject. Returns true if it did; the incoming task is deleted then.
+     */
+    typedef bool (*CoalesceFunction)(TASK queued, TASK incoming);
+
+    /**
+     * Returns the priority level of a task; 0 is the highest priority.
+     */
+    typedef size_t (*PriorityFunction)(TASK task);
+
+    /**
+     * @param[in] handler      The handler of all tasks.
+     * @param[in] maxWorkers   The maximum number of threads handling tasks concurrently.
+     *                         Tasks are only handled in order if this is 1.
+     * @param[in] idleTimeout  Time (in ms) after which an idle worker exits.
+     */
+    TaskQueue(HANDLER* handler,
+              size_t maxWorkers = 1,
+              uint32_t idleTimeout = TASKQUEUE_DEFAULT_IDLE_TIMEOUT) :
         stopped(false),
         taskHandler(handler),
-        thread(nullptr),
-        cond(new Condition())
+        maxWorkers(maxWorkers == 0 ? 1 : maxWorkers),
+        idleTimeout(idleTimeout),
+        idleWorkers(0),
+        capacity(0),
+        overflowPolicy(TASKQUEUE_DROP_OLDEST),
+        coalesce(nullptr),
+        priorityOf(nullptr),
+        maxWait(TASKQUEUE_DEFAULT_MAX_WAIT),
+        queued(0),
+        lists(1),
+        cond(new Condition()),
+        workCond(new Condition()),
+        spaceCond(new Condition())
     {
+        stats.priorities.resize(1);
     }
 
     ~TaskQueue()
     {
+        Stop();
         delete cond;
         cond = nullptr;
+        delete workCond;
+        workCond = nullptr;
+        delete spaceCond;
+        spaceCond = nullptr;
+    }
+
+    /**
+     * Bound the number of queued tasks.
+     *
+     * TASKQUEUE_BLOCK must not be used if tasks are added from within
+     * the handler, as a full queue would then never drain.
+     *
+     * @param[in] maxTasks   The maximum number of queued tasks; 0 for no bound.
+     * @param[in] policy     What to do when adding a task to a full queue.
+     * @param[in] func       Used by TASKQUEUE_COALESCE to merge tasks.
+     */
+    void SetCapacity(size_t maxTasks,
+                     TaskQueueOverflowPolicy policy = TASKQUEUE_DROP_OLDEST,
+                     CoalesceFunction func = nullptr)
+    {
+        mutex.Lock();
+        capacity = maxTasks;
+        overflowPolicy = policy;
+        coalesce = func;
+        spaceCond->Broadcast();
+        mutex.Unlock();
+    }
+
+    /**
+     * Handle tasks by priority instead of in order. A task that is queued
+     * longer than maxWait is handled first, so low priority tasks are not
+     * starved. Tasks of the same priority are handled in order.
+     *
+     * @param[in] levels     The number of priority levels.
+     * @param[in] func       Determines the level of a task; levels beyond
+     *                       the last one are treated as the last one.
+     * @param[in] maxWait    Time (in ms) after which a task is handled first.
+     *
+     * @return ER_OK          If successful.
+     * @return ER_FAIL        If tasks are queued already.
+     */
+    QStatus SetPriorities(size_t levels,
+                          PriorityFunction func,
+                          uint32_t maxWait = TASKQUEUE_DEFAULT_MAX_WAIT)
+    {
+        mutex.Lock();
+        if (queued > 0) {
+            mutex.Unlock();
+            return ER_FAIL;
+        }
+        lists.resize(levels == 0 ? 1 : levels);
+        stats.priorities.resize(lists.size());
+        priorityOf = func;
+        this->maxWait = maxWait;
+        mutex.Unlock();
+        return ER_OK;
+    }
+
+    TaskQueueStats GetStats()
+    {
+        mutex.Lock();
+        TaskQueueStats current = stats;
+        current.depth = queued;
+        for (size_t i = 0; i < lists.size(); i++) {
+            current.priorities[i].depth = lists[i].size();
+        }
+        mutex.Unlock();
+        return current;
     }
 
     void Stop()
     {
         mutex.Lock();
-        stopped = true; //Indicate that no more task should be scheduled and the current thread should stop.
-        while (running) {
-            //If we are running, wait for the thread to signal it has completed.
+        stopped = true; //Indicate that no more task should be scheduled and the active workers should stop.
+        workCond->Broadcast();
+        spaceCond->Broadcast();
+        while (workers.size() > 0) {
+            //Wait for all workers to signal they have completed.
             cond->Wait(mutex);
         }
-        if (thread) {
-            thread->Join();
-            delete thread;
-            thread = nullptr;
-        }
+        JoinFinishedWorkers();
+        mutex.Unlock();
+    }
+
+    /**
+     * Check whether no tasks are queued and no worker is handling a task.
+     * A queue to which no more tasks are added can then be deleted from
+     * any thread other than its workers.
+     */
+    bool IsIdle()
+    {
+        mutex.Lock();
+        bool idle = (queued == 0) && (workers.size() == idleWorkers);
         mutex.Unlock();
+        return idle;
     }
 
-    void AddTask(TASK task)
+    /**
+     * Queue a task. The queue takes ownership of the task, also when it is
+     * not queued.
+     *
+     * @param[in] task   The task to handle.
+     *
+     * @return ER_OK             If the task was queued or merged into a queued task.
+     * @return ER_BUS_STOPPING   If the queue is stopped; the task is deleted.
+     * @return Others            If no worker could be started to handle the
+     *                           task; the task is deleted.
+     */
+    QStatus AddTask(TASK task)
     {
         mutex.Lock();
-        if (!stopped) { // Only add task when we are not stopped.
-            list.push_back(task);
-            if (!running) {
-                if (thread != nullptr) {
-                    thread->Join();
-                    delete thread;
-                    thread = nullptr;
+        if (stopped) { // Only add task when we are not stopped.
+            mutex.Unlock();
+            delete task;
+            return ER_BUS_STOPPING;
+        }
+        size_t level = (priorityOf == nullptr) ? 0 : priorityOf(task);
+        if (level >= lists.size()) {
+            level = lists.size() - 1;
+        }
+        while ((capacity > 0) && (queued >= capacity) && !stopped) {
+            if (TASKQUEUE_BLOCK == overflowPolicy) {
+                spaceCond->Wait(mutex);
+                continue;
+            }
+            if ((TASKQUEUE_COALESCE == overflowPolicy) && (coalesce != nullptr) && Coalesce(task)) {
+                stats.coalesced++;
+                mutex.Unlock();
+                delete task;
+                return ER_OK;
+            }
+            // Drop the oldest task of the lowest priority.
+            size_t victim = lists.size() - 1;
+            while (lists[victim].empty()) {
+                victim--;
+            }
+            delete lists[victim].front().task;
+            lists[victim].pop_front();
+            queued--;
+            stats.dropped++;
+        }
+        if (stopped) {
+            mutex.Unlock();
+            delete task;
+            return ER_BUS_STOPPING;
+        }
+        lists[level].push_back(QueuedTask(task, GetTimestamp64()));
+        queued++;
+        if (idleWorkers > 0) {
+            workCond->Signal();
+        } else if (workers.size() < maxWorkers) {
+            JoinFinishedWorkers();
+            QueueThread* worker = new QueueThread(this);
+            workers.push_back(worker);
+            QStatus status = worker->Start();
+            if (ER_OK != status) {
+                workers.pop_back();
+                delete worker;
+                if (workers.empty()) {
+                    // Nobody would ever handle the task.
+                    lists[level].pop_back();
+                    queued--;
+                    mutex.Unlock();
+                    delete task;
+                    return status;
                 }
-                thread = new QueueThread(this);
-                thread->Start();
-                running = true;
             }
         }
+        stats.added++;
+        if (queued > stats.highWaterMark) {
+            stats.highWaterMark = queued;
+        }
         mutex.Unlock();
+        return ER_OK;
     }
 
     class QueueThread :
@@ -93,7 +309,7 @@ class TaskQueue {
         {
             QCC_UNUSED(arg);
 
-            queue->HandleTasks();
+            queue->HandleTasks(this);
             return nullptr;
         }
 
@@ -101,38 +317,140 @@ class TaskQueue {
         TaskQueue* queue;
     };
 
-    void HandleTasks()
+    void HandleTasks(QueueThread* worker)
     {
         mutex.Lock();
-        while (list.size() > 0) {
-            TASK task = list[0];
-            list.erase(list.begin());
-            if (!stopped) { //Only handle task when not stopped.
-                mutex.Unlock();
-                taskHandler->HandleTask(task);
-                mutex.Lock();
+        while (true) {
+            if (queued > 0) {
+                TASK task = NextTask();
+                spaceCond->Signal();
+                if (!stopped) { //Only handle task when not stopped.
+                    mutex.Unlock();
+                    taskHandler->HandleTask(task);
+                    mutex.Lock();
+                }
+                delete task;
+                task = nullptr;
+                continue;
+            }
+            if (stopped) {
+                break;
+            }
+            // Sleep until new tasks arrive; exit if none arrived in time.
+            idleWorkers++;
+            QStatus status = workCond->TimedWait(mutex, idleTimeout);
+            idleWorkers--;
+            if ((ER_TIMEOUT == status) && (queued == 0)) {
+                break;
             }
-            delete task;
-            task = nullptr;
         }
-        running = false;
+        // A thread cannot join itself; it is joined by the next AddTask or Stop.
+        for (size_t i = 0; i < workers.size(); i++) {
+            if (workers[i] == worker) {
+                workers.erase(workers.begin() + i);
+                break;
+            }
+        }
+        finishedWorkers.push_back(worker);
         cond->Broadcast();
         mutex.Unlock();
     }
 
   private:
-    volatile bool running; //To true indicates that a thread is handling the tasks.
+    struct QueuedTask {
+        TASK task;
+        uint64_t enqueued; // Timestamp (in ms) of AddTask.
+
+        QueuedTask(TASK t, uint64_t time) :
+            task(t), enqueued(time) { }
+    };
+
+    // Must be called with the mutex held.
+    bool Coalesce(TASK task)
+    {
+        // Newest tasks are the most likely to be about the same subject.
+        for (size_t i = 0; i < lists.size(); i++) {
+            for (typename deque<QueuedTask>::reverse_iterator it = lists[i].rbegin(); it != lists[i].rend(); ++it) {
+                if (coalesce(it->task, task)) {
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    // Must be called with the mutex held and at least one task queued.
+    TASK NextTask()
+    {
+        uint64_t now = GetTimestamp64();
+        size_t level = lists.size();
+        for (size_t i = 0; i < lists.size(); i++) {
+            if (!lists[i].empty()) {
+                level = i;
+                break;
+            }
+        }
+        // A lower priority task that waited too long goes first, unless a
+        // higher priority task waited even longer.
+        size_t aged = level;
+        for (size_t i = level + 1; i < lists.size(); i++) {
+            if (!lists[i].empty() && ((now - lists[i].front().enqueued) >= maxWait) &&
+                (lists[i].front().enqueued < lists[aged].front().enqueued)) {
+                aged = i;
+            }
+        }
+        if (aged != level) {
+            stats.aged++;
+            level = aged;
+        }
+
+        QueuedTask next = lists[level].front();
+        lists[level].pop_front();
+        queued--;
+
+        uint64_t latency = now - next.enqueued;
+        TaskQueuePriorityStats& levelStats = stats.priorities[level];
+        levelStats.handled++;
+        levelStats.totalLatency += latency;
+        if (latency > levelStats.maxLatency) {
+            levelStats.maxLatency = latency;
+        }
+        return next.task;
+    }
+
+    // Must be called with the mutex held.
+    void JoinFinishedWorkers()
+    {
+        for (size_t i = 0; i < finishedWorkers.size(); i++) {
+            finishedWorkers[i]->Join();
+            delete finishedWorkers[i];
+        }
+        finishedWorkers.clear();
+    }
 
     /*
      * True to indicate no thread should be started anymore
-     * and the active thread should stop ASAP.
+     * and the active workers should stop ASAP.
      */
     volatile bool stopped;
     HANDLER* taskHandler;
-    vector<TASK> list;
+    size_t maxWorkers;
+    uint32_t idleTimeout;
+    size_t idleWorkers; //The number of workers waiting for new tasks.
+    size_t capacity;    //The maximum number of queued tasks; 0 means unbounded.
+    TaskQueueOverflowPolicy overflowPolicy;
+    CoalesceFunction coalesce;
+    PriorityFunction priorityOf;
+    uint32_t maxWait;   //Time (in ms) after which a task is handled ahead of higher priorities.
+    TaskQueueStats stats;
+    size_t queued;      //The number of tasks over all priority levels.
+    vector<deque<QueuedTask> > lists; //The queued tasks per priority level, highest first.
     Mutex mutex;
-    QueueThread* thread;
-    Condition* cond;
+    vector<QueueThread*> workers;         //Workers that are handling or waiting for tasks.
+    vector<QueueThread*> finishedWorkers; //Workers that have exited but still need to be joined.
+    Condition* cond;                      //Signaled when a worker exits.
+    Condition* workCond;                  //Signaled when a task is added for an idle worker.
+    Condition* spaceCond;                 //Signaled when a task is taken from the queue.
 };
 }
 }
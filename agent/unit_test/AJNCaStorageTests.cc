@@ -19,7 +19,9 @@
 #include <stdio.h>
 
 #include "SQLStorageConfig.h"
+#include "SQLStorageSettings.h"
 #include "AJNCaStorage.h"
+#include "UIStorageImpl.h"
 
 using namespace std;
 using namespace ajn;
@@ -29,6 +31,23 @@ using namespace securitymgr;
 /** @file AJNCaStorageTests.cc */
 
 namespace secmgr_tests {
+class PendingChangesListener :
+    public StorageListener {
+  public:
+    PendingChangesListener() : calls(0) { }
+
+    void OnPendingChanges(vector<Application>& _apps)
+    {
+        calls++;
+        apps.insert(apps.end(), _apps.begin(), _apps.end());
+    }
+
+    void OnPendingChangesCompleted(vector<Application>& _apps) { QCC_UNUSED(_apps); }
+
+    size_t calls;
+    vector<Application> apps;
+};
+
 class AJNCaStorageTest :
     public::testing::Test {
   public:
@@ -116,4 +135,523 @@ TEST_F(AJNCaStorageTest, BasicTest) {
     ASSERT_EQ(ER_OK, cert6.DecodeCertificateDER(der5));
     ASSERT_EQ(ER_OK, cert6.Verify(key));
 }
+/**
+ * @test Verify that the sync digest of an application can be stored, updated
+ *       and is removed together with the application.
+ *       -# Store a managed application.
+ *       -# Check that no sync digest is available yet.
+ *       -# Store a sync digest and check that it can be retrieved.
+ *       -# Overwrite the sync digest and check the new value is returned.
+ *       -# Remove the application and check that the digest is gone.
+ **/
+TEST_F(AJNCaStorageTest, SyncDigest) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    Crypto_ECC ecc;
+    ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+    Application app;
+    app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+    app.syncState = SYNC_OK;
+    ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+
+    uint8_t digest[Crypto_SHA256::DIGEST_SIZE];
+    uint8_t readDigest[Crypto_SHA256::DIGEST_SIZE];
+    ASSERT_EQ(ER_END_OF_DATA, sql->GetSyncDigest(app, readDigest, sizeof(readDigest)));
+
+    memset(digest, 0xab, sizeof(digest));
+    ASSERT_EQ(ER_OK, sql->StoreSyncDigest(app, digest, sizeof(digest)));
+    ASSERT_EQ(ER_OK, sql->GetSyncDigest(app, readDigest, sizeof(readDigest)));
+    ASSERT_EQ(0, memcmp(digest, readDigest, sizeof(digest)));
+
+    memset(digest, 0xcd, sizeof(digest));
+    ASSERT_EQ(ER_OK, sql->StoreSyncDigest(app, digest, sizeof(digest)));
+    ASSERT_EQ(ER_OK, sql->GetSyncDigest(app, readDigest, sizeof(readDigest)));
+    ASSERT_EQ(0, memcmp(digest, readDigest, sizeof(digest)));
+
+    ASSERT_EQ(ER_OK, sql->RemoveApplication(app));
+    ASSERT_EQ(ER_END_OF_DATA, sql->GetSyncDigest(app, readDigest, sizeof(readDigest)));
+}
+
+/**
+ * @test Verify that sync retries are persisted, ordered by their next attempt
+ *       and removed together with the application.
+ *       -# Store two managed applications and a retry for each of them.
+ *       -# Check both retries are returned, earliest attempt first.
+ *       -# Update and remove a retry and check the result.
+ *       -# Remove the other application and check its retry is gone.
+ **/
+TEST_F(AJNCaStorageTest, SyncRetries) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    SyncRetry retries[2];
+    for (size_t i = 0; i < 2; i++) {
+        Crypto_ECC ecc;
+        ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+        retries[i].app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+        retries[i].app.syncState = SYNC_PENDING;
+        ASSERT_EQ(ER_OK, sql->StoreApplication(retries[i].app));
+        retries[i].attempts = i + 1;
+        retries[i].nextAttempt = 2000 - (i * 1000);
+        ASSERT_EQ(ER_OK, sql->StoreSyncRetry(retries[i]));
+    }
+
+    vector<SyncRetry> stored;
+    ASSERT_EQ(ER_OK, sql->GetSyncRetries(stored));
+    ASSERT_EQ((size_t)2, stored.size());
+    ASSERT_EQ(retries[1].app, stored[0].app);
+    ASSERT_EQ((uint32_t)2, stored[0].attempts);
+    ASSERT_EQ((uint64_t)1000, stored[0].nextAttempt);
+    ASSERT_EQ(retries[0].app, stored[1].app);
+
+    retries[1].attempts = 3;
+    retries[1].nextAttempt = 3000;
+    ASSERT_EQ(ER_OK, sql->StoreSyncRetry(retries[1]));
+    stored.clear();
+    ASSERT_EQ(ER_OK, sql->GetSyncRetries(stored));
+    ASSERT_EQ((size_t)2, stored.size());
+    ASSERT_EQ(retries[1].app, stored[1].app);
+    ASSERT_EQ((uint32_t)3, stored[1].attempts);
+
+    ASSERT_EQ(ER_OK, sql->RemoveSyncRetry(retries[1].app));
+    ASSERT_EQ(ER_OK, sql->RemoveApplication(retries[0].app));
+    stored.clear();
+    ASSERT_EQ(ER_OK, sql->GetSyncRetries(stored));
+    ASSERT_EQ((size_t)0, stored.size());
+}
+
+/**
+ * @test Verify that decisions on manifests are persisted by digest.
+ *       -# Check that no decision is found for an unknown digest.
+ *       -# Store an approval and a rejection and read them back.
+ *       -# Replace the approval by a rejection and check the result.
+ *       -# Remove a decision and check it is gone.
+ **/
+TEST_F(AJNCaStorageTest, ManifestApprovals) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    ManifestApproval approved;
+    memset(approved.digest, 1, sizeof(approved.digest));
+    ManifestApproval rejected;
+    memset(rejected.digest, 2, sizeof(rejected.digest));
+
+    ManifestApproval read;
+    memcpy(read.digest, approved.digest, sizeof(read.digest));
+    ASSERT_EQ(ER_END_OF_DATA, sql->GetManifestApproval(read));
+
+    approved.approved = true;
+    approved.claimType = PermissionConfigurator::CAPABLE_ECDHE_NULL;
+    ASSERT_EQ(ER_OK, sql->StoreManifestApproval(approved));
+    ASSERT_EQ(ER_OK, sql->StoreManifestApproval(rejected));
+
+    ASSERT_EQ(ER_OK, sql->GetManifestApproval(read));
+    ASSERT_TRUE(read.approved);
+    ASSERT_EQ(PermissionConfigurator::CAPABLE_ECDHE_NULL, read.claimType);
+    memcpy(read.digest, rejected.digest, sizeof(read.digest));
+    ASSERT_EQ(ER_OK, sql->GetManifestApproval(read));
+    ASSERT_FALSE(read.approved);
+
+    approved.approved = false;
+    ASSERT_EQ(ER_OK, sql->StoreManifestApproval(approved));
+    memcpy(read.digest, approved.digest, sizeof(read.digest));
+    ASSERT_EQ(ER_OK, sql->GetManifestApproval(read));
+    ASSERT_FALSE(read.approved);
+
+    ASSERT_EQ(ER_OK, sql->RemoveManifestApproval(approved.digest));
+    ASSERT_EQ(ER_END_OF_DATA, sql->GetManifestApproval(read));
+}
+
+/**
+ * @test Verify that expiring certificates can be found and renewed.
+ *       -# Store a managed application and a group.
+ *       -# Generate and store a membership certificate with a short validity.
+ *       -# Check that it is not expiring before its validTo.
+ *       -# Check that it is reported as expiring after its validTo.
+ *       -# Renew it, store it and check it got a new serial and a later expiry.
+ *       -# Check that it is no longer reported as expiring.
+ **/
+TEST_F(AJNCaStorageTest, CertificateRenewal) {
+    const char* storeName = "AJNCaStorageTestCA";
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+    ca = shared_ptr<AJNCaStorage>(new AJNCaStorage());
+    ASSERT_EQ(ER_OK, ca->Init(storeName, sql));
+
+    Crypto_ECC ecc;
+    ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+    Application app;
+    app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+    app.syncState = SYNC_OK;
+    ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+
+    GroupInfo group;
+    ASSERT_EQ(ER_OK, ca->GetCaPublicKeyInfo(group.authority));
+    group.guid = GUID128(0xab);
+    ASSERT_EQ(ER_OK, sql->StoreGroup(group));
+
+    ca->SetCertificateValidity(3600);
+    MembershipCertificate cert;
+    ASSERT_EQ(ER_OK, ca->GenerateMembershipCertificate(app, group, cert));
+    ASSERT_EQ(ER_OK, sql->StoreCertificate(app, cert));
+    uint64_t validTo = cert.GetValidity()->validTo;
+
+    vector<StoredCertificate> expiring;
+    ASSERT_EQ(ER_OK, sql->GetExpiringCertificates(validTo, 10, expiring));
+    ASSERT_EQ((size_t)0, expiring.size());
+    ASSERT_EQ(ER_OK, sql->GetExpiringCertificates(validTo + 1, 10, expiring));
+    ASSERT_EQ((size_t)1, expiring.size());
+    ASSERT_TRUE(expiring[0].app == app);
+    ASSERT_EQ(CertificateX509::MEMBERSHIP_CERTIFICATE, expiring[0].certificate->GetType());
+
+    ca->SetCertificateValidity(7200);
+    ASSERT_EQ(ER_OK, ca->RenewCertificates(expiring));
+    ASSERT_EQ(ER_OK, sql->StoreCertificates(expiring));
+
+    MembershipCertificate renewed;
+    renewed.SetGuild(group.guid);
+    ASSERT_EQ(ER_OK, sql->GetCertificate(app, renewed));
+    KeyInfoNISTP256 caKey;
+    ASSERT_EQ(ER_OK, ca->GetCaPublicKeyInfo(caKey));
+    ASSERT_EQ(ER_OK, renewed.Verify(caKey));
+    ASSERT_TRUE(renewed.GetValidity()->validTo > validTo);
+    ASSERT_NE(String((const char*)cert.GetSerial(), cert.GetSerialLen()),
+              String((const char*)renewed.GetSerial(), renewed.GetSerialLen()));
+
+    expiring.clear();
+    ASSERT_EQ(ER_OK, sql->GetExpiringCertificates(validTo + 1, 10, expiring));
+    ASSERT_EQ((size_t)0, expiring.size());
+}
+
+/**
+ * @test Verify that the sync bundle of an application contains its complete
+ *       desired state.
+ *       -# Check that no bundle is returned for an unknown application.
+ *       -# Store an application with an identity certificate, a manifest and
+ *          a membership certificate.
+ *       -# Check that the bundle contains all of them but no policy and no
+ *          sync digest.
+ *       -# Store a sync digest and check that it is part of the bundle.
+ **/
+TEST_F(AJNCaStorageTest, SyncBundle) {
+    const char* storeName = "AJNCaStorageTestCA";
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+    ca = shared_ptr<AJNCaStorage>(new AJNCaStorage());
+    ASSERT_EQ(ER_OK, ca->Init(storeName, sql));
+
+    Crypto_ECC ecc;
+    ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+    Application app;
+    app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+    app.syncState = SYNC_PENDING;
+
+    SyncBundle unknown;
+    ASSERT_EQ(ER_END_OF_DATA, ca->GetSyncBundle(app, unknown));
+
+    ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+
+    IdentityInfo idInfo;
+    ASSERT_EQ(ER_OK, ca->GetCaPublicKeyInfo(idInfo.authority));
+    idInfo.guid = GUID128(0xcd);
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(ER_OK, sql->StoreIdentity(idInfo));
+
+    PermissionPolicy::Rule rules[1];
+    rules[0].SetInterfaceName("org.allseenalliance.control.TV");
+    PermissionPolicy::Rule::Member member;
+    member.SetMemberName("Up");
+    member.SetMemberType(PermissionPolicy::Rule::Member::METHOD_CALL);
+    member.SetActionMask(PermissionPolicy::Rule::Member::ACTION_MODIFY);
+    rules[0].SetMembers(1, &member);
+    Manifest manifest;
+    ASSERT_EQ(ER_OK, manifest.SetFromRules(rules, 1));
+    ASSERT_EQ(ER_OK, sql->StoreManifest(app, manifest));
+
+    IdentityCertificate idCert;
+    ASSERT_EQ(ER_OK, ca->GenerateIdentityCertificate(app, idInfo, manifest, idCert));
+    ASSERT_EQ(ER_OK, sql->StoreCertificate(app, idCert));
+
+    GroupInfo group;
+    group.authority = idInfo.authority;
+    group.guid = GUID128(0xab);
+    ASSERT_EQ(ER_OK, sql->StoreGroup(group));
+    MembershipCertificate memCert;
+    ASSERT_EQ(ER_OK, ca->GenerateMembershipCertificate(app, group, memCert));
+    ASSERT_EQ(ER_OK, sql->StoreCertificate(app, memCert));
+
+    SyncBundle bundle;
+    ASSERT_EQ(ER_OK, ca->GetSyncBundle(app, bundle));
+    ASSERT_EQ(SYNC_PENDING, bundle.syncState);
+    ASSERT_EQ((size_t)1, bundle.memberships.size());
+    ASSERT_EQ((size_t)1, bundle.memberships[0].size());
+    ASSERT_EQ(group.guid, bundle.memberships[0][0].GetGuild());
+    ASSERT_EQ((size_t)1, bundle.identityCertificates.size());
+    ASSERT_EQ(idInfo.guid.ToString(), bundle.identityCertificates[0].GetAlias());
+    ASSERT_TRUE(manifest == bundle.manifest);
+    ASSERT_FALSE(bundle.hasPolicy);
+    ASSERT_FALSE(bundle.hasSyncDigest);
+
+    uint8_t digest[Crypto_SHA256::DIGEST_SIZE];
+    memset(digest, 0xef, sizeof(digest));
+    ASSERT_EQ(ER_OK, ca->StoreSyncDigest(app, digest));
+    SyncBundle bundle2;
+    ASSERT_EQ(ER_OK, ca->GetSyncBundle(app, bundle2));
+    ASSERT_TRUE(bundle2.hasSyncDigest);
+    ASSERT_EQ(0, memcmp(digest, bundle2.syncDigest, sizeof(digest)));
+}
+
+/**
+ * @test Verify that managed applications can be searched by meta data.
+ *       -# Store three applications with different meta data.
+ *       -# Check a case insensitive prefix search on each of the names.
+ *       -# Check a substring search, both long and short enough for the index.
+ *       -# Check that results can be retrieved page by page.
+ *       -# Check that updated and removed applications are found accordingly.
+ **/
+TEST_F(AJNCaStorageTest, MetaDataSearch) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    const char* appNames[] = { "LivingRoomTV", "KitchenLight", "BedroomLight" };
+    const char* deviceNames[] = { "tv-01", "light-01", "light-02" };
+    vector<Application> apps;
+    for (size_t i = 0; i < 3; i++) {
+        Crypto_ECC ecc;
+        ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+        Application app;
+        app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+        app.syncState = SYNC_OK;
+        ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+        ApplicationMetaData metaData;
+        metaData.appName = appNames[i];
+        metaData.deviceName = deviceNames[i];
+        ASSERT_EQ(ER_OK, sql->SetAppMetaData(app, metaData));
+        apps.push_back(app);
+    }
+
+    vector<MetaDataSearchResult> results;
+    uint64_t token = 0;
+    ASSERT_EQ(ER_BAD_ARG_1, sql->SearchAppMetaData("", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ(ER_BAD_ARG_3, sql->SearchAppMetaData("Light", METADATA_SEARCH_PREFIX, 0, token, results));
+
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("kitchen", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(apps[1] == results[0].app);
+    ASSERT_EQ(string("KitchenLight"), results[0].metaData.appName);
+    ASSERT_EQ((uint64_t)0, token);
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("LIGHT-", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ((size_t)2, results.size());
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("Light", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ((size_t)2, results.size());
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("roomt", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(apps[0] == results[0].app);
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("01", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)2, results.size());
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("room", METADATA_SEARCH_SUBSTRING, 1, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_NE((uint64_t)0, token);
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("room", METADATA_SEARCH_SUBSTRING, 1, token, results));
+    ASSERT_EQ((size_t)2, results.size());
+    ASSERT_FALSE(results[0].app == results[1].app);
+    if (token != 0) {
+        ASSERT_EQ(ER_OK, sql->SearchAppMetaData("room", METADATA_SEARCH_SUBSTRING, 1, token, results));
+        ASSERT_EQ((size_t)2, results.size());
+    }
+    ASSERT_EQ((uint64_t)0, token);
+
+    ApplicationMetaData metaData;
+    metaData.appName = "Garage";
+    ASSERT_EQ(ER_OK, sql->SetAppMetaData(apps[1], metaData));
+    ASSERT_EQ(ER_OK, sql->RemoveApplication(apps[2]));
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("light", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)0, results.size());
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("ara", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(apps[1] == results[0].app);
+}
+
+/**
+ * @test Verify that a prefix search does not find names that only sort
+ *       within the range of the prefix when compared case sensitively.
+ *       -# Store applications named "a@b", "a[b" and "a_b".
+ *       -# Check that searching for "A@" only finds "a@b".
+ *       -# Check that a prefix ending in the highest byte value finds names
+ *          that continue beyond it.
+ **/
+TEST_F(AJNCaStorageTest, MetaDataPrefixSearchBounds) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    const char* appNames[] = { "a@b", "a[b", "a_b", "z\xff\xffz" };
+    vector<Application> apps;
+    for (size_t i = 0; i < 4; i++) {
+        Crypto_ECC ecc;
+        ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+        Application app;
+        app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+        ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+        ApplicationMetaData metaData;
+        metaData.appName = appNames[i];
+        ASSERT_EQ(ER_OK, sql->SetAppMetaData(app, metaData));
+        apps.push_back(app);
+    }
+
+    vector<MetaDataSearchResult> results;
+    uint64_t token = 0;
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("A@", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(apps[0] == results[0].app);
+
+    results.clear();
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("z\xff\xff", METADATA_SEARCH_PREFIX, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(apps[3] == results[0].app);
+}
+
+/**
+ * @test Verify that the metadata search index is rebuilt when its triggers
+ *       were dropped, as happens when the storage was opened with an SQLite
+ *       without FTS5.
+ *       -# Store an application with meta data and close the storage.
+ *       -# Drop the triggers and rename the application behind the back of
+ *          the storage.
+ *       -# Open the storage again and check that a substring search finds
+ *          the application on its new name only.
+ **/
+TEST_F(AJNCaStorageTest, MetaDataSearchRebuild) {
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+
+    Crypto_ECC ecc;
+    ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+    Application app;
+    app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+    ASSERT_EQ(ER_OK, sql->StoreApplication(app));
+    ApplicationMetaData metaData;
+    metaData.appName = "KitchenLight";
+    ASSERT_EQ(ER_OK, sql->SetAppMetaData(app, metaData));
+    sql = nullptr;
+
+    sqlite3* db = nullptr;
+    ASSERT_EQ(SQLITE_OK, sqlite3_open("AJNCaStorageTestDB", &db));
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db, METADATA_SEARCH_DROP_TRIGGERS, nullptr, 0, nullptr));
+    ASSERT_EQ(SQLITE_OK, sqlite3_exec(db, "UPDATE " CLAIMED_APPS_TABLE_NAME " SET APP_NAME = 'GarageDoor'",
+                                      nullptr, 0, nullptr));
+    ASSERT_EQ(SQLITE_OK, sqlite3_close(db));
+
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+    vector<MetaDataSearchResult> results;
+    uint64_t token = 0;
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("kitchen", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)0, results.size());
+    ASSERT_EQ(ER_OK, sql->SearchAppMetaData("garage", METADATA_SEARCH_SUBSTRING, 10, token, results));
+    ASSERT_EQ((size_t)1, results.size());
+    ASSERT_TRUE(app == results[0].app);
+}
+
+/**
+ * @test Verify that removing a group moves all its members to their new sync
+ *       state at once and reports them in a single notification.
+ *       -# Store a group with three members in SYNC_OK, two of which have a
+ *          policy, one member in SYNC_PENDING and one application that is
+ *          not a member.
+ *       -# Remove the group and check that one PENDING_CHANGES notification
+ *          lists the four members.
+ *       -# Check that the members in SYNC_OK are now SYNC_PENDING and that
+ *          only their policies got a new version.
+ *       -# Check that the other application is left alone.
+ **/
+TEST_F(AJNCaStorageTest, RemoveGroupNotifiesOnce) {
+    const char* storeName = "AJNCaStorageTestCA";
+    SQLStorageConfig storageConfig;
+    storageConfig.settings[STORAGE_FILEPATH_KEY] = "AJNCaStorageTestDB";
+    sql = shared_ptr<SQLStorage>(new SQLStorage(storageConfig));
+    ASSERT_EQ(ER_OK, sql->GetStatus());
+    ca = shared_ptr<AJNCaStorage>(new AJNCaStorage());
+    ASSERT_EQ(ER_OK, ca->Init(storeName, sql));
+    UIStorageImpl uiStorage(ca, sql);
+
+    GroupInfo group;
+    ASSERT_EQ(ER_OK, ca->GetCaPublicKeyInfo(group.authority));
+    group.guid = GUID128(0xab);
+    group.name = "TestGroup";
+    ASSERT_EQ(ER_OK, sql->StoreGroup(group));
+
+    // members 0-2 are in SYNC_OK, member 3 is pending, app 4 is no member
+    Application apps[5];
+    for (size_t i = 0; i < 5; i++) {
+        Crypto_ECC ecc;
+        ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+        apps[i].keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+        apps[i].syncState = (i == 3) ? SYNC_PENDING : SYNC_OK;
+        ASSERT_EQ(ER_OK, sql->StoreApplication(apps[i]));
+        if (i != 2) {
+            PermissionPolicy policy;
+            policy.SetVersion(7);
+            ASSERT_EQ(ER_OK, sql->StorePolicy(apps[i], policy));
+        }
+        if (i != 4) {
+            MembershipCertificate memCert;
+            ASSERT_EQ(ER_OK, ca->GenerateMembershipCertificate(apps[i], group, memCert));
+            ASSERT_EQ(ER_OK, sql->StoreCertificate(apps[i], memCert));
+        }
+    }
+
+    PendingChangesListener listener;
+    uiStorage.RegisterStorageListener(&listener);
+    ASSERT_EQ(ER_OK, uiStorage.RemoveGroup(group));
+    uiStorage.UnRegisterStorageListener(&listener);
+
+    ASSERT_EQ((size_t)1, listener.calls);
+    ASSERT_EQ((size_t)4, listener.apps.size());
+    for (size_t i = 0; i < listener.apps.size(); i++) {
+        ASSERT_EQ(SYNC_PENDING, listener.apps[i].syncState);
+        ASSERT_FALSE(listener.apps[i] == apps[4]);
+    }
+
+    uint32_t expectedVersions[] = { 8, 8, 0, 7, 7 };
+    for (size_t i = 0; i < 5; i++) {
+        Application stored = apps[i];
+        ASSERT_EQ(ER_OK, sql->GetManagedApplication(stored));
+        ASSERT_EQ((i == 4) ? SYNC_OK : SYNC_PENDING, stored.syncState) << "application " << i;
+        PermissionPolicy policy;
+        if (i == 2) {
+            ASSERT_EQ(ER_END_OF_DATA, sql->GetPolicy(apps[i], policy));
+        } else {
+            ASSERT_EQ(ER_OK, sql->GetPolicy(apps[i], policy));
+            ASSERT_EQ(expectedVersions[i], policy.GetVersion()) << "application " << i;
+        }
+    }
+}
 }
@@ -95,6 +95,51 @@ class AgentStorageWrapper :
         return ca->GetPolicy(app, policy);
     }
 
+    virtual QStatus StoreSyncDigest(const Application& app, const uint8_t* digest)
+    {
+        return ca->StoreSyncDigest(app, digest);
+    }
+
+    virtual QStatus GetSyncDigest(const Application& app, uint8_t* digest) const
+    {
+        return ca->GetSyncDigest(app, digest);
+    }
+
+    virtual QStatus StoreSyncRetry(const SyncRetry& retry)
+    {
+        return ca->StoreSyncRetry(retry);
+    }
+
+    virtual QStatus RemoveSyncRetry(const Application& app)
+    {
+        return ca->RemoveSyncRetry(app);
+    }
+
+    virtual QStatus GetSyncRetries(vector<SyncRetry>& retries) const
+    {
+        return ca->GetSyncRetries(retries);
+    }
+
+    virtual QStatus StoreManifestApproval(const ManifestApproval& approval)
+    {
+        return ca->StoreManifestApproval(approval);
+    }
+
+    virtual QStatus GetManifestApproval(ManifestApproval& approval) const
+    {
+        return ca->GetManifestApproval(approval);
+    }
+
+    virtual QStatus RemoveManifestApproval(const uint8_t* digest)
+    {
+        return ca->RemoveManifestApproval(digest);
+    }
+
+    virtual QStatus GetManagedApplications(vector<Application>& apps) const
+    {
+        return ca->GetManagedApplications(apps);
+    }
+
     virtual void RegisterStorageListener(StorageListener* listener)
     {
         return ca->RegisterStorageListener(listener);
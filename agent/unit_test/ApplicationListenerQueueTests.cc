@@ -0,0 +1,167 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <vector>
+
+#include <qcc/Condition.h>
+#include <qcc/CryptoECC.h>
+#include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+
+#include "ApplicationListenerQueue.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn;
+using namespace ajn::securitymgr;
+
+/** @file ApplicationListenerQueueTests.cc */
+
+namespace secmgr_tests {
+class RecordingListener :
+    public ApplicationListener {
+  public:
+    RecordingListener() : singles(0), batches(0), syncErrors(0)
+    {
+    }
+
+    void OnApplicationStateChange(const OnlineApplication* oldApp,
+                                  const OnlineApplication* newApp)
+    {
+        QCC_UNUSED(oldApp);
+        QCC_UNUSED(newApp);
+        lock.Lock();
+        singles++;
+        cond.Broadcast();
+        lock.Unlock();
+    }
+
+    void OnApplicationStateChanges(const vector<ApplicationStateChange>& changes)
+    {
+        lock.Lock();
+        batches++;
+        for (size_t i = 0; i < changes.size(); i++) {
+            firstStates.push_back(changes[i].oldApp ? changes[i].oldApp->applicationState : PermissionConfigurator::NOT_CLAIMABLE);
+            lastStates.push_back(changes[i].newApp->applicationState);
+        }
+        cond.Broadcast();
+        lock.Unlock();
+    }
+
+    void OnSyncError(const SyncError* syncError)
+    {
+        QCC_UNUSED(syncError);
+        lock.Lock();
+        syncErrors++;
+        cond.Broadcast();
+        lock.Unlock();
+    }
+
+    void OnManifestUpdate(const ManifestUpdate* manifestUpdate)
+    {
+        QCC_UNUSED(manifestUpdate);
+    }
+
+    bool WaitFor(int* counter, int expected)
+    {
+        lock.Lock();
+        while (*counter < expected) {
+            if (ER_OK != cond.TimedWait(lock, 10000)) {
+                break;
+            }
+        }
+        bool reached = (*counter >= expected);
+        lock.Unlock();
+        return reached;
+    }
+
+    int singles;
+    int batches;
+    int syncErrors;
+    vector<PermissionConfigurator::ApplicationState> firstStates;
+    vector<PermissionConfigurator::ApplicationState> lastStates;
+    Mutex lock;
+    Condition cond;
+};
+
+static OnlineApplication CreateApplication(PermissionConfigurator::ApplicationState state)
+{
+    Crypto_ECC ecc;
+    ecc.GenerateDSAKeyPair();
+    OnlineApplication app;
+    app.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+    app.applicationState = state;
+    return app;
+}
+
+/**
+ * @test Verify that a batched listener receives the changes of a burst in a
+ *       single callback, with the changes of each application coalesced.
+ *       -# Add three changes of one application and one of another.
+ *       -# Check that one batch with two changes is delivered.
+ *       -# Check that the first change runs from the first to the last state.
+ **/
+TEST(ApplicationListenerQueueTest, Batching) {
+    RecordingListener listener;
+    ApplicationListenerQueue queue(&listener, 200);
+
+    OnlineApplication claimable = CreateApplication(PermissionConfigurator::CLAIMABLE);
+    OnlineApplication claimed(claimable);
+    claimed.applicationState = PermissionConfigurator::CLAIMED;
+    OnlineApplication other = CreateApplication(PermissionConfigurator::CLAIMABLE);
+
+    queue.Add(make_shared<AppListenerEvent>(nullptr, &claimable));
+    queue.Add(make_shared<AppListenerEvent>(&claimable, &claimed));
+    queue.Add(make_shared<AppListenerEvent>(nullptr, &other));
+    queue.Add(make_shared<AppListenerEvent>(&claimed, &claimed));
+
+    ASSERT_TRUE(listener.WaitFor(&listener.batches, 1));
+    qcc::Sleep(300);
+    listener.lock.Lock();
+    ASSERT_EQ(1, listener.batches);
+    ASSERT_EQ(0, listener.singles);
+    ASSERT_EQ((size_t)2, listener.lastStates.size());
+    ASSERT_EQ(PermissionConfigurator::NOT_CLAIMABLE, listener.firstStates[0]);
+    ASSERT_EQ(PermissionConfigurator::CLAIMED, listener.lastStates[0]);
+    ASSERT_EQ(PermissionConfigurator::CLAIMABLE, listener.lastStates[1]);
+    listener.lock.Unlock();
+}
+
+/**
+ * @test Verify that a listener that is not batched gets every change on its
+ *       own and that no events are delivered after it was removed.
+ *       -# Add two changes and check both are delivered one by one.
+ *       -# Remove the listener and add a sync error.
+ *       -# Check that the sync error is not delivered.
+ **/
+TEST(ApplicationListenerQueueTest, SingleChangesAndRemove) {
+    RecordingListener listener;
+    ApplicationListenerQueue queue(&listener, 0);
+
+    OnlineApplication app = CreateApplication(PermissionConfigurator::CLAIMABLE);
+    queue.Add(make_shared<AppListenerEvent>(nullptr, &app));
+    queue.Add(make_shared<AppListenerEvent>(&app, &app));
+    ASSERT_TRUE(listener.WaitFor(&listener.singles, 2));
+    ASSERT_EQ(0, listener.batches);
+
+    queue.Remove();
+    queue.Add(make_shared<AppListenerEvent>(new SyncError(app, ER_FAIL, SYNC_ER_REMOTE)));
+    ASSERT_FALSE(listener.WaitFor(&listener.syncErrors, 1));
+}
+}
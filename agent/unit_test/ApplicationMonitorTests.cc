@@ -0,0 +1,341 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include <qcc/Condition.h>
+#include <qcc/CryptoECC.h>
+#include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+
+#include <alljoyn/BusAttachment.h>
+
+#include "ApplicationMonitor.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn;
+using namespace ajn::securitymgr;
+
+/** @file ApplicationMonitorTests.cc */
+
+namespace secmgr_tests {
+struct RecordedChange {
+    bool hasOld;
+    bool hasNew;
+    SecurityInfo oldInfo;
+    SecurityInfo newInfo;
+};
+
+class RecordingListener :
+    public SecurityInfoListener {
+  public:
+    void OnSecurityStateChange(const SecurityInfo* oldSecInfo,
+                               const SecurityInfo* newSecInfo)
+    {
+        RecordedChange change;
+        change.hasOld = (nullptr != oldSecInfo);
+        change.hasNew = (nullptr != newSecInfo);
+        if (change.hasOld) {
+            change.oldInfo = *oldSecInfo;
+        }
+        if (change.hasNew) {
+            change.newInfo = *newSecInfo;
+        }
+        lock.Lock(__FILE__, __LINE__);
+        changes.push_back(change);
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+    bool WaitForChanges(size_t count, uint32_t timeout = 5000)
+    {
+        for (uint32_t waited = 0; waited < timeout; waited += 5) {
+            lock.Lock(__FILE__, __LINE__);
+            size_t received = changes.size();
+            lock.Unlock(__FILE__, __LINE__);
+            if (received >= count) {
+                return true;
+            }
+            qcc::Sleep(5);
+        }
+        return false;
+    }
+
+    vector<RecordedChange> GetChanges()
+    {
+        lock.Lock(__FILE__, __LINE__);
+        vector<RecordedChange> result = changes;
+        lock.Unlock(__FILE__, __LINE__);
+        return result;
+    }
+
+  private:
+    Mutex lock;
+    vector<RecordedChange> changes;
+};
+
+/*
+ * Holds up the dispatcher of the monitor while it is closed, so signals can
+ * be queued behind the event that is being handled.
+ */
+class GateListener :
+    public SecurityInfoListener {
+  public:
+    GateListener() :
+        closed(false) { }
+
+    void OnSecurityStateChange(const SecurityInfo* oldSecInfo,
+                               const SecurityInfo* newSecInfo)
+    {
+        QCC_UNUSED(oldSecInfo);
+        QCC_UNUSED(newSecInfo);
+        lock.Lock(__FILE__, __LINE__);
+        while (closed) {
+            cond.Wait(lock);
+        }
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+    void Close()
+    {
+        lock.Lock(__FILE__, __LINE__);
+        closed = true;
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+    void Open()
+    {
+        lock.Lock(__FILE__, __LINE__);
+        closed = false;
+        cond.Broadcast();
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+  private:
+    Mutex lock;
+    Condition cond;
+    bool closed;
+};
+
+/*
+ * The monitor is fed through its bus listener interfaces, exactly as the bus
+ * would do; the bus attachment itself is never started.
+ */
+class ApplicationMonitorTests :
+    public::testing::Test {
+  public:
+    ApplicationMonitorTests() :
+        ba("monitortest", true), monitor(&ba) { }
+
+    virtual void SetUp()
+    {
+        monitor.RegisterSecurityInfoListener(&listener);
+        monitor.RegisterSecurityInfoListener(&gate);
+    }
+
+    virtual void TearDown()
+    {
+        gate.Open();
+        monitor.UnregisterSecurityInfoListener(&gate);
+        monitor.UnregisterSecurityInfoListener(&listener);
+    }
+
+    static KeyInfoNISTP256 CreateKey(uint8_t id)
+    {
+        uint8_t coordinates[64]; // The X and Y coordinates of a NIST P-256 key.
+        for (size_t i = 0; i < sizeof(coordinates); i++) {
+            coordinates[i] = (uint8_t)(id + i);
+        }
+        ECCPublicKey publicKey;
+        publicKey.Import(coordinates, sizeof(coordinates));
+        KeyInfoNISTP256 keyInfo;
+        keyInfo.SetPublicKey(&publicKey);
+        return keyInfo;
+    }
+
+    void SendState(const char* busName,
+                   const KeyInfoNISTP256& keyInfo,
+                   PermissionConfigurator::ApplicationState state)
+    {
+        ApplicationStateListener* stateListener = &monitor;
+        stateListener->State(busName, keyInfo, state);
+    }
+
+    void SendDeparture(const char* busName)
+    {
+        BusListener* busListener = &monitor;
+        busListener->NameOwnerChanged(busName, busName, nullptr);
+    }
+
+    bool WaitForHandled(uint64_t count, uint32_t timeout = 5000)
+    {
+        for (uint32_t waited = 0; waited < timeout; waited += 5) {
+            if (monitor.GetDispatchStats().handled >= count) {
+                return true;
+            }
+            qcc::Sleep(5);
+        }
+        return false;
+    }
+
+    BusAttachment ba;
+    ApplicationMonitor monitor;
+    RecordingListener listener;
+    GateListener gate;
+};
+
+/**
+ * @test Verify that an application that shows up on a new bus name is
+ *       reported as a departure from its old bus name followed by a
+ *       discovery on the new one, so listeners sync it as a new application.
+ *       -# Send the state of an application on a first bus name.
+ *       -# Send the state of the same application on a second bus name.
+ *       -# Check that the listener got a discovery, a departure from the
+ *          first bus name and a discovery on the second bus name.
+ *       -# Check that the monitor only knows the second bus name.
+ **/
+TEST_F(ApplicationMonitorTests, Reconnect) {
+    KeyInfoNISTP256 key = CreateKey(1);
+    SendState(":app.1", key, PermissionConfigurator::CLAIMED);
+    ASSERT_TRUE(listener.WaitForChanges(1));
+    SendState(":app.2", key, PermissionConfigurator::CLAIMED);
+    ASSERT_TRUE(listener.WaitForChanges(3));
+
+    vector<RecordedChange> changes = listener.GetChanges();
+    ASSERT_EQ((size_t)3, changes.size());
+    ASSERT_FALSE(changes[0].hasOld);
+    ASSERT_EQ(string(":app.1"), changes[0].newInfo.busName);
+    ASSERT_TRUE(changes[1].hasOld);
+    ASSERT_FALSE(changes[1].hasNew);
+    ASSERT_EQ(string(":app.1"), changes[1].oldInfo.busName);
+    ASSERT_FALSE(changes[2].hasOld);
+    ASSERT_TRUE(changes[2].hasNew);
+    ASSERT_EQ(string(":app.2"), changes[2].newInfo.busName);
+
+    SecurityInfo info;
+    info.busName = ":app.1";
+    ASSERT_NE(ER_OK, monitor.GetApplication(info));
+    info.busName = ":app.2";
+    ASSERT_EQ(ER_OK, monitor.GetApplication(info));
+    ASSERT_EQ(key, info.keyInfo);
+}
+
+/**
+ * @test Verify that the signals of different bus names are handled in the
+ *       order in which they were received.
+ *       -# Send the states of three applications.
+ *       -# Check that the listener got their discoveries in the same order.
+ **/
+TEST_F(ApplicationMonitorTests, Ordering) {
+    SendState(":app.1", CreateKey(1), PermissionConfigurator::CLAIMABLE);
+    SendState(":app.2", CreateKey(2), PermissionConfigurator::CLAIMED);
+    SendState(":app.3", CreateKey(3), PermissionConfigurator::CLAIMABLE);
+    ASSERT_TRUE(listener.WaitForChanges(3));
+
+    vector<RecordedChange> changes = listener.GetChanges();
+    ASSERT_EQ((size_t)3, changes.size());
+    ASSERT_EQ(string(":app.1"), changes[0].newInfo.busName);
+    ASSERT_EQ(string(":app.2"), changes[1].newInfo.busName);
+    ASSERT_EQ(string(":app.3"), changes[2].newInfo.busName);
+}
+
+/**
+ * @test Verify that the signals of a bus name that arrive while an earlier
+ *       one is still queued are merged into it, and that the dispatch
+ *       counters reflect this.
+ *       -# Hold up the dispatcher on the discovery of a first application.
+ *       -# Send three states of a second application, with the state of a
+ *          third application in between.
+ *       -# Release the dispatcher.
+ *       -# Check that the second application is reported once, with its
+ *          latest state and before the third application.
+ *       -# Check that all signals are counted, but only three events are
+ *          handled.
+ **/
+TEST_F(ApplicationMonitorTests, Merging) {
+    gate.Close();
+    SendState(":app.0", CreateKey(0), PermissionConfigurator::CLAIMED);
+    ASSERT_TRUE(listener.WaitForChanges(1));
+
+    KeyInfoNISTP256 key = CreateKey(1);
+    SendState(":app.1", key, PermissionConfigurator::CLAIMABLE);
+    SendState(":app.1", key, PermissionConfigurator::CLAIMED);
+    SendState(":app.2", CreateKey(2), PermissionConfigurator::CLAIMABLE);
+    SendState(":app.1", key, PermissionConfigurator::NEED_UPDATE);
+    gate.Open();
+    ASSERT_TRUE(WaitForHandled(3));
+
+    vector<RecordedChange> changes = listener.GetChanges();
+    ASSERT_EQ((size_t)3, changes.size());
+    ASSERT_FALSE(changes[1].hasOld);
+    ASSERT_EQ(string(":app.1"), changes[1].newInfo.busName);
+    ASSERT_EQ(PermissionConfigurator::NEED_UPDATE, changes[1].newInfo.applicationState);
+    ASSERT_EQ(string(":app.2"), changes[2].newInfo.busName);
+
+    MonitorDispatchStats stats = monitor.GetDispatchStats();
+    ASSERT_EQ((uint64_t)5, stats.signals);
+    ASSERT_EQ((uint64_t)3, stats.handled);
+    ASSERT_LE(stats.totalLatency, stats.maxLatency * stats.handled);
+}
+
+/**
+ * @test Verify that a departure that is merged into a queued state ends the
+ *       application, whether it was known or not.
+ *       -# Discover a first application.
+ *       -# Hold up the dispatcher on the discovery of another application.
+ *       -# Send a new state of the first application followed by its
+ *          departure, and the same for an application that is not known.
+ *       -# Release the dispatcher.
+ *       -# Check that only the departure of the first application is
+ *          reported, with the state it was last known in.
+ *       -# Check that the monitor knows neither of the two applications.
+ **/
+TEST_F(ApplicationMonitorTests, DepartureMergedIntoState) {
+    KeyInfoNISTP256 key = CreateKey(1);
+    SendState(":app.1", key, PermissionConfigurator::CLAIMABLE);
+    ASSERT_TRUE(listener.WaitForChanges(1));
+
+    gate.Close();
+    SendState(":app.0", CreateKey(0), PermissionConfigurator::CLAIMED);
+    ASSERT_TRUE(listener.WaitForChanges(2));
+    SendState(":app.1", key, PermissionConfigurator::CLAIMED);
+    SendDeparture(":app.1");
+    SendState(":app.3", CreateKey(3), PermissionConfigurator::CLAIMABLE);
+    SendDeparture(":app.3");
+    gate.Open();
+    ASSERT_TRUE(WaitForHandled(4));
+
+    vector<RecordedChange> changes = listener.GetChanges();
+    ASSERT_EQ((size_t)3, changes.size());
+    ASSERT_TRUE(changes[2].hasOld);
+    ASSERT_FALSE(changes[2].hasNew);
+    ASSERT_EQ(string(":app.1"), changes[2].oldInfo.busName);
+    ASSERT_EQ(PermissionConfigurator::CLAIMABLE, changes[2].oldInfo.applicationState);
+
+    SecurityInfo info;
+    info.busName = ":app.1";
+    ASSERT_NE(ER_OK, monitor.GetApplication(info));
+    info.busName = ":app.3";
+    ASSERT_NE(ER_OK, monitor.GetApplication(info));
+
+    MonitorDispatchStats stats = monitor.GetDispatchStats();
+    ASSERT_EQ((uint64_t)6, stats.signals);
+    ASSERT_EQ((uint64_t)4, stats.handled);
+}
+}
@@ -0,0 +1,249 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <qcc/CryptoECC.h>
+
+#include "ApplicationSnapshot.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn;
+using namespace ajn::securitymgr;
+
+/** @file ApplicationSnapshotTests.cc */
+
+namespace secmgr_tests {
+typedef chrono::steady_clock Clock;
+
+static OnlineApplication CreateApplication(uint32_t id,
+                                           PermissionConfigurator::ApplicationState state,
+                                           ApplicationSyncState syncState)
+{
+    // Distinct public keys without the cost of generating real key pairs.
+    uint8_t coordinates[64]; // The X and Y coordinates of a NIST P-256 key.
+    memset(coordinates, 0, sizeof(coordinates));
+    for (size_t i = 0; i < sizeof(coordinates); i++) {
+        coordinates[i] = (uint8_t)((id >> (8 * (i % 4))) + i);
+    }
+    ECCPublicKey publicKey;
+    publicKey.Import(coordinates, sizeof(coordinates));
+
+    OnlineApplication app;
+    app.keyInfo.SetPublicKey(&publicKey);
+    app.busName = ":app." + to_string(id);
+    app.applicationState = state;
+    app.syncState = syncState;
+    return app;
+}
+
+/**
+ * @test Verify that the indexes of a snapshot follow the applications.
+ *       -# Add applications in different states.
+ *       -# Look them up on key, bus name, state and sync state.
+ *       -# Update an application and check that all indexes follow.
+ **/
+TEST(ApplicationSnapshotTest, Indexes) {
+    OnlineApplication claimable = CreateApplication(1, PermissionConfigurator::CLAIMABLE, SYNC_UNMANAGED);
+    OnlineApplication claimed = CreateApplication(2, PermissionConfigurator::CLAIMED, SYNC_OK);
+    shared_ptr<const ApplicationSnapshot> snapshot(new ApplicationSnapshot());
+    snapshot = snapshot->With(claimable)->With(claimed);
+    ASSERT_EQ((size_t)2, snapshot->Size());
+
+    ASSERT_TRUE(snapshot->Find(claimable.keyInfo) != nullptr);
+    ASSERT_EQ(claimed.busName, snapshot->Find(claimed.keyInfo)->busName);
+    ASSERT_EQ(claimable.keyInfo, snapshot->FindByBusName(claimable.busName)->keyInfo);
+    ASSERT_TRUE(snapshot->FindByBusName(":unknown") == nullptr);
+
+    vector<OnlineApplication> apps;
+    snapshot->GetByState(PermissionConfigurator::CLAIMABLE, apps);
+    ASSERT_EQ((size_t)1, apps.size());
+    ASSERT_EQ(claimable.keyInfo, apps[0].keyInfo);
+    apps.clear();
+    snapshot->GetBySyncState(SYNC_OK, apps);
+    ASSERT_EQ((size_t)1, apps.size());
+    ASSERT_EQ(claimed.keyInfo, apps[0].keyInfo);
+
+    // The claimable application gets claimed and a new bus name.
+    OnlineApplication updated(claimable);
+    updated.applicationState = PermissionConfigurator::CLAIMED;
+    updated.syncState = SYNC_OK;
+    updated.busName = ":app.new";
+    snapshot = snapshot->With(updated);
+    ASSERT_EQ((size_t)2, snapshot->Size());
+    ASSERT_TRUE(snapshot->FindByBusName(claimable.busName) == nullptr);
+    ASSERT_EQ(updated.keyInfo, snapshot->FindByBusName(updated.busName)->keyInfo);
+    apps.clear();
+    snapshot->GetByState(PermissionConfigurator::CLAIMABLE, apps);
+    ASSERT_TRUE(apps.empty());
+    snapshot->GetByState(PermissionConfigurator::CLAIMED, apps);
+    ASSERT_EQ((size_t)2, apps.size());
+    apps.clear();
+    snapshot->GetBySyncState(SYNC_UNMANAGED, apps);
+    ASSERT_TRUE(apps.empty());
+    snapshot->GetBySyncState(SYNC_OK, apps);
+    ASSERT_EQ((size_t)2, apps.size());
+}
+
+/**
+ * @test Verify that a snapshot is not affected by later changes.
+ *       -# Create a snapshot with an application.
+ *       -# Derive a new snapshot in which the application is changed and
+ *          another one is added.
+ *       -# Check that the versions increase and that the first snapshot
+ *          still holds the original application.
+ *       -# Remove an application and check that it is no longer found in
+ *          the new snapshot only.
+ **/
+TEST(ApplicationSnapshotTest, Snapshots) {
+    shared_ptr<const ApplicationSnapshot> empty(new ApplicationSnapshot());
+    ASSERT_TRUE(empty->Empty());
+    ASSERT_EQ((uint64_t)0, empty->GetVersion());
+
+    OnlineApplication app1 = CreateApplication(1, PermissionConfigurator::CLAIMABLE, SYNC_UNMANAGED);
+    shared_ptr<const ApplicationSnapshot> first = empty->With(app1);
+    ASSERT_EQ((uint64_t)1, first->GetVersion());
+    ASSERT_EQ((size_t)1, first->Size());
+    ASSERT_TRUE(empty->Find(app1.keyInfo) == nullptr);
+
+    OnlineApplication claimed(app1);
+    claimed.applicationState = PermissionConfigurator::CLAIMED;
+    OnlineApplication app2 = CreateApplication(2, PermissionConfigurator::CLAIMED, SYNC_OK);
+    shared_ptr<const ApplicationSnapshot> third = first->With(claimed)->With(app2);
+    ASSERT_EQ((uint64_t)3, third->GetVersion());
+    ASSERT_EQ((size_t)2, third->Size());
+
+    ASSERT_EQ(PermissionConfigurator::CLAIMABLE, first->Find(app1.keyInfo)->applicationState);
+    ASSERT_EQ(PermissionConfigurator::CLAIMED, third->Find(app1.keyInfo)->applicationState);
+    ASSERT_EQ(app2.keyInfo, third->FindByBusName(app2.busName)->keyInfo);
+
+    vector<OnlineApplication> apps;
+    third->GetByState(PermissionConfigurator::CLAIMED, apps);
+    ASSERT_EQ((size_t)2, apps.size());
+    apps.clear();
+    first->GetAll(apps);
+    ASSERT_EQ((size_t)1, apps.size());
+
+    shared_ptr<const ApplicationSnapshot> fourth = third->Without(app2.keyInfo);
+    ASSERT_EQ((uint64_t)4, fourth->GetVersion());
+    ASSERT_EQ((size_t)1, fourth->Size());
+    ASSERT_TRUE(fourth->Find(app2.keyInfo) == nullptr);
+    ASSERT_TRUE(fourth->FindByBusName(app2.busName) == nullptr);
+    apps.clear();
+    fourth->GetBySyncState(SYNC_OK, apps);
+    ASSERT_TRUE(apps.empty());
+    ASSERT_EQ(app2.keyInfo, third->FindByBusName(app2.busName)->keyInfo);
+}
+
+/**
+ * @test Benchmark looking up the CLAIMABLE applications among 50k online
+ *       applications, compared to scanning all of them.
+ *       -# Add 50k applications of which 100 are CLAIMABLE.
+ *       -# Time repeated lookups by state and repeated full scans.
+ *       -# Check that both find the same 100 applications.
+ **/
+TEST(ApplicationSnapshotTest, Benchmark) {
+    const uint32_t total = 50000;
+    const uint32_t claimable = 100;
+    const int rounds = 100;
+
+    shared_ptr<const ApplicationSnapshot> snapshot(new ApplicationSnapshot());
+    for (uint32_t i = 0; i < total; i++) {
+        bool isClaimable = (i % (total / claimable)) == 0;
+        snapshot = snapshot->With(CreateApplication(i,
+                                                    isClaimable ? PermissionConfigurator::CLAIMABLE : PermissionConfigurator::CLAIMED,
+                                                    isClaimable ? SYNC_UNMANAGED : SYNC_OK));
+    }
+    ASSERT_EQ((size_t)total, snapshot->Size());
+
+    vector<OnlineApplication> indexed;
+    Clock::time_point start = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        indexed.clear();
+        snapshot->GetByState(PermissionConfigurator::CLAIMABLE, indexed);
+    }
+    Clock::duration indexedTime = Clock::now() - start;
+
+    vector<OnlineApplication> all;
+    vector<OnlineApplication> scanned;
+    start = Clock::now();
+    for (int r = 0; r < rounds; r++) {
+        all.clear();
+        scanned.clear();
+        snapshot->GetAll(all);
+        for (size_t i = 0; i < all.size(); i++) {
+            if (all[i].applicationState == PermissionConfigurator::CLAIMABLE) {
+                scanned.push_back(all[i]);
+            }
+        }
+    }
+    Clock::duration scanTime = Clock::now() - start;
+
+    ASSERT_EQ((size_t)claimable, indexed.size());
+    ASSERT_EQ((size_t)claimable, scanned.size());
+    cout << "GetByState(CLAIMABLE) of " << claimable << " in " << total << " applications: "
+         << chrono::duration_cast<chrono::microseconds>(indexedTime).count() / rounds << " us indexed, "
+         << chrono::duration_cast<chrono::microseconds>(scanTime).count() / rounds << " us scanned" << endl;
+}
+
+/**
+ * @test Benchmark publishing 50k applications one by one through snapshots,
+ *       as happens when a burst of announcements reaches the agent.
+ *       -# Derive a new snapshot for every application.
+ *       -# Update every application once more through a new snapshot.
+ *       -# Check the size, version and indexes of the final snapshot.
+ **/
+TEST(ApplicationSnapshotTest, SnapshotBenchmark) {
+    const uint32_t total = 50000;
+
+    vector<OnlineApplication> apps;
+    apps.reserve(total);
+    for (uint32_t i = 0; i < total; i++) {
+        apps.push_back(CreateApplication(i, PermissionConfigurator::CLAIMABLE, SYNC_UNMANAGED));
+    }
+
+    shared_ptr<const ApplicationSnapshot> snapshot(new ApplicationSnapshot());
+    Clock::time_point start = Clock::now();
+    for (uint32_t i = 0; i < total; i++) {
+        snapshot = snapshot->With(apps[i]);
+    }
+    Clock::duration insertTime = Clock::now() - start;
+
+    start = Clock::now();
+    for (uint32_t i = 0; i < total; i++) {
+        apps[i].applicationState = PermissionConfigurator::CLAIMED;
+        snapshot = snapshot->With(apps[i]);
+    }
+    Clock::duration updateTime = Clock::now() - start;
+
+    ASSERT_EQ((size_t)total, snapshot->Size());
+    ASSERT_EQ((uint64_t)(2 * total), snapshot->GetVersion());
+    ASSERT_EQ(apps[total / 2].keyInfo, snapshot->FindByBusName(apps[total / 2].busName)->keyInfo);
+    vector<OnlineApplication> found;
+    snapshot->GetByState(PermissionConfigurator::CLAIMABLE, found);
+    ASSERT_TRUE(found.empty());
+    snapshot->GetByState(PermissionConfigurator::CLAIMED, found);
+    ASSERT_EQ((size_t)total, found.size());
+    cout << "Published " << total << " applications through snapshots: "
+         << chrono::duration_cast<chrono::milliseconds>(insertTime).count() << " ms inserting, "
+         << chrono::duration_cast<chrono::milliseconds>(updateTime).count() << " ms updating" << endl;
+}
+}
@@ -16,6 +16,8 @@
 
 #include <gtest/gtest.h>
 
+#include <atomic>
+
 #include <qcc/GUID.h>
 #include <qcc/Util.h>
 #include <qcc/Thread.h>
@@ -26,6 +28,7 @@
 
 #include "TestUtil.h"
 #include "AgentStorageWrapper.h"
+#include "ApplicationUpdater.h"
 
 /** @file ApplicationUpdaterTests.cc */
 
@@ -38,6 +41,8 @@ class SyncErrorStorageWrapper :
         AgentStorageWrapper(_ca),
         failOnStartUpdates(false),
         returnEmptyMembershipCert(false),
+        blockStartUpdates(false),
+        startUpdatesCalls(0),
         storage(_storage),
         returnWrappedPolicy(false),
         returnWrappedManifest(false)
@@ -46,6 +51,11 @@ class SyncErrorStorageWrapper :
 
     QStatus StartUpdates(Application& app, uint64_t& updateID)
     {
+        startUpdatesCalls++;
+        // Bounded, so that a failing test cannot block the agent forever.
+        for (int i = 0; blockStartUpdates && (i < 1000); i++) {
+            qcc::Sleep(10);
+        }
         if (failOnStartUpdates) {
             return ER_FAIL;
         }
@@ -111,9 +121,19 @@ class SyncErrorStorageWrapper :
         returnWrappedManifest = false;
     }
 
+    bool WaitForStartUpdates(size_t calls)
+    {
+        for (int i = 0; (startUpdatesCalls < calls) && (i < 1000); i++) {
+            qcc::Sleep(10);
+        }
+        return startUpdatesCalls >= calls;
+    }
+
   public:
     bool failOnStartUpdates;
     bool returnEmptyMembershipCert;
+    volatile bool blockStartUpdates;
+    atomic<size_t> startUpdatesCalls;
 
   private:
     SyncErrorStorageWrapper& operator=(const SyncErrorStorageWrapper);
@@ -526,4 +546,226 @@ TEST_F(ApplicationUpdaterTests, SyncErStorage) {
     ASSERT_EQ(ER_OK, testApp.Start());
     ASSERT_TRUE(WaitForSyncError(SYNC_ER_STORAGE, ER_FAIL));
 }
+
+/**
+ * @test Verify that an application that leaves the bus is no longer tracked
+ *       on its bus name, and that it is tracked on its new bus name once it
+ *       comes back online.
+ *       -# Stop the remote application.
+ *       -# Wait until the security agent reports it without a bus name.
+ *       -# Restart the remote application.
+ *       -# Wait until the security agent reports it on its new bus name.
+ **/
+TEST_F(ApplicationUpdaterTests, Departure) {
+    OnlineApplication app;
+    app.keyInfo = testAppInfo.keyInfo;
+
+    // stop the test application
+    ASSERT_EQ(ER_OK, testApp.Stop());
+    bool departed = false;
+    for (int i = 0; !departed && (i < 100); i++) {
+        ASSERT_EQ(ER_OK, secMgr->GetApplication(app));
+        departed = app.busName.empty();
+        if (!departed) {
+            qcc::Sleep(100);
+        }
+    }
+    ASSERT_TRUE(departed);
+    ASSERT_EQ(PermissionConfigurator::CLAIMED, app.applicationState);
+
+    // restart the test application
+    ASSERT_EQ(ER_OK, testApp.Start());
+    ASSERT_TRUE(WaitForState(PermissionConfigurator::CLAIMED, SYNC_OK));
+    ASSERT_EQ(ER_OK, secMgr->GetApplication(app));
+    ASSERT_EQ(testApp.GetBusName(), app.busName);
+}
+
+/**
+ * @test Verify that an application that is not managed is forgotten once it
+ *       leaves the bus.
+ *       -# Reset the remote application, so it is no longer managed.
+ *       -# Stop the remote application.
+ *       -# Wait until the security agent no longer knows the application.
+ **/
+TEST_F(ApplicationUpdaterTests, DepartureForgetsUnmanaged) {
+    ASSERT_EQ(ER_OK, storage->ResetApplication(testAppInfo));
+    ASSERT_TRUE(WaitForState(PermissionConfigurator::CLAIMABLE));
+
+    OnlineApplication app;
+    app.keyInfo = testAppInfo.keyInfo;
+    ASSERT_EQ(ER_OK, testApp.Stop());
+    bool forgotten = false;
+    for (int i = 0; !forgotten && (i < 100); i++) {
+        forgotten = (ER_END_OF_DATA == secMgr->GetApplication(app));
+        if (!forgotten) {
+            qcc::Sleep(100);
+        }
+    }
+    ASSERT_TRUE(forgotten);
+}
+
+/**
+ * @test Verify when the remote checks of a sync may be skipped: only when
+ *       the desired state matches the digest of the last sync and the
+ *       application still reports the desired policy version.
+ *       -# Compute the digest of a desired state with a policy.
+ *       -# Check that a matching digest and policy version allow the skip.
+ *       -# Check that a different remote policy version prevents it.
+ *       -# Check that a missing or different digest prevents it.
+ *       -# Check that without a desired policy, the application must be on
+ *          its default policy.
+ **/
+TEST(ApplicationUpdaterSkipTest, IsUnchangedSinceLastSync) {
+    SyncBundle bundle;
+    bundle.hasPolicy = true;
+    bundle.policy.SetVersion(5);
+    uint8_t digest[Crypto_SHA256::DIGEST_SIZE];
+    ASSERT_EQ(ER_OK, ApplicationUpdater::ComputeSyncDigest(bundle.memberships, bundle.identityCertificates,
+                                                           &bundle.policy, digest));
+
+    // never synced before
+    ASSERT_FALSE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 5));
+
+    memcpy(bundle.syncDigest, digest, sizeof(digest));
+    bundle.hasSyncDigest = true;
+    ASSERT_TRUE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 5));
+    ASSERT_FALSE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 0));
+    ASSERT_FALSE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 6));
+
+    // the desired policy changed since the last sync
+    bundle.policy.SetVersion(6);
+    ASSERT_EQ(ER_OK, ApplicationUpdater::ComputeSyncDigest(bundle.memberships, bundle.identityCertificates,
+                                                           &bundle.policy, digest));
+    ASSERT_FALSE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 6));
+
+    // no desired policy
+    bundle.hasPolicy = false;
+    ASSERT_EQ(ER_OK, ApplicationUpdater::ComputeSyncDigest(bundle.memberships, bundle.identityCertificates,
+                                                           nullptr, digest));
+    memcpy(bundle.syncDigest, digest, sizeof(digest));
+    ASSERT_TRUE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 0));
+    ASSERT_FALSE(ApplicationUpdater::IsUnchangedSinceLastSync(bundle, digest, 5));
+}
+
+/**
+ * @test Verify that an application whose desired state is unchanged since
+ *       its last sync is still fully synced when its policy was changed
+ *       behind the back of the security agent.
+ *       -# Install a policy and wait until it is synced.
+ *       -# Reset the policy on the remote application directly.
+ *       -# Restart the remote application.
+ *       -# Check that the security agent installs the policy again.
+ **/
+TEST_F(ApplicationUpdaterTests, SkipChecksRemotePolicyVersion) {
+    ASSERT_EQ(ER_OK, storage->StoreGroup(groupInfo));
+    vector<GroupInfo> groups;
+    groups.push_back(groupInfo);
+    ASSERT_EQ(ER_OK, pg->DefaultPolicy(groups, policy));
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, policy));
+    ASSERT_TRUE(WaitForUpdatesCompleted());
+    ASSERT_TRUE(CheckPolicy(policy));
+
+    // reset the policy without the security agent knowing
+    ASSERT_EQ(ER_OK, CreateProxyObjectManager());
+    {
+        ProxyObjectManager::ManagedProxyObject mngdProxy(testAppInfo);
+        ASSERT_EQ(ER_OK, proxyObjectManager->GetProxyObject(mngdProxy));
+        ASSERT_EQ(ER_OK, mngdProxy.ResetPolicy());
+    }
+    ASSERT_TRUE(CheckDefaultPolicy());
+
+    // restart the test application
+    ASSERT_EQ(ER_OK, testApp.Stop());
+    ASSERT_EQ(ER_OK, testApp.Start());
+    bool restored = false;
+    for (int i = 0; !restored && (i < 100); i++) {
+        restored = CheckRemotePolicy(policy);
+        if (!restored) {
+            qcc::Sleep(100);
+        }
+    }
+    ASSERT_TRUE(restored);
+    ASSERT_TRUE(CheckSyncState(SYNC_OK));
+}
+
+/**
+ * @test Verify that events queued for the same bus name while a sync is in
+ *       progress are coalesced into a single sync with the latest state.
+ *       -# Block the sync of a first policy update.
+ *       -# Update the policy twice more while the sync is blocked.
+ *       -# Unblock the sync and wait until the updates are completed.
+ *       -# Check that only one more sync was started and that the last
+ *          policy is installed.
+ **/
+TEST_F(ApplicationUpdaterTests, CoalesceEvents) {
+    ASSERT_TRUE(WaitForUpdatesCompleted());
+
+    vector<GroupInfo> groups;
+    vector<PermissionPolicy> policies;
+    for (int i = 0; i < 3; i++) {
+        GroupInfo group;
+        group.name = "Group" + to_string(i);
+        group.desc = "Coalescing test group";
+        ASSERT_EQ(ER_OK, storage->StoreGroup(group));
+        groups.push_back(group);
+        PermissionPolicy groupPolicy;
+        ASSERT_EQ(ER_OK, pg->DefaultPolicy(groups, groupPolicy));
+        policies.push_back(groupPolicy);
+    }
+
+    wrappedCA->blockStartUpdates = true;
+    wrappedCA->startUpdatesCalls = 0;
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, policies[0]));
+    ASSERT_TRUE(wrappedCA->WaitForStartUpdates(1));
+
+    // both updates are queued behind the blocked sync
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, policies[1]));
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, policies[2]));
+
+    wrappedCA->blockStartUpdates = false;
+    ASSERT_TRUE(wrappedCA->WaitForStartUpdates(2));
+    ASSERT_TRUE(WaitForUpdatesCompleted());
+    ASSERT_TRUE(CheckSyncState(SYNC_OK));
+    ASSERT_TRUE(CheckPolicy(policies[2]));
+    ASSERT_EQ((size_t)2, wrappedCA->startUpdatesCalls);
+}
+
+/**
+ * @test Verify that a reset queued behind a pending policy sync raises the
+ *       priority of the pending event instead of adding a second sync.
+ *       -# Block the sync of a first policy update.
+ *       -# Update the policy again and reset the application while the
+ *          sync is blocked.
+ *       -# Unblock the sync and wait until the application is CLAIMABLE.
+ *       -# Check that the superseded policy event did not start a sync.
+ **/
+TEST_F(ApplicationUpdaterTests, RaiseEventPriority) {
+    ASSERT_TRUE(WaitForUpdatesCompleted());
+
+    ASSERT_EQ(ER_OK, storage->StoreGroup(groupInfo));
+    vector<GroupInfo> groups;
+    groups.push_back(groupInfo);
+    ASSERT_EQ(ER_OK, pg->DefaultPolicy(groups, policy));
+
+    wrappedCA->blockStartUpdates = true;
+    wrappedCA->startUpdatesCalls = 0;
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, policy));
+    ASSERT_TRUE(wrappedCA->WaitForStartUpdates(1));
+
+    // queue a policy event, then raise it to a reset
+    GroupInfo otherGroup;
+    otherGroup.name = "Other";
+    otherGroup.desc = "Another test group";
+    ASSERT_EQ(ER_OK, storage->StoreGroup(otherGroup));
+    PermissionPolicy updatedPolicy;
+    groups.push_back(otherGroup);
+    ASSERT_EQ(ER_OK, pg->DefaultPolicy(groups, updatedPolicy));
+    ASSERT_EQ(ER_OK, storage->UpdatePolicy(testAppInfo, updatedPolicy));
+    ASSERT_EQ(ER_OK, storage->ResetApplication(testAppInfo));
+
+    wrappedCA->blockStartUpdates = false;
+    ASSERT_TRUE(WaitForState(PermissionConfigurator::CLAIMABLE));
+    ASSERT_TRUE(wrappedCA->WaitForStartUpdates(2));
+    ASSERT_EQ((size_t)2, wrappedCA->startUpdatesCalls);
+}
 }
@@ -127,6 +127,334 @@ TEST_F(ClaimingTests, SuccessfulClaim) {
     ASSERT_NE(ER_OK, secMgr->Claim(app, idInfo));
 }
 
+class ClaimResultCollector :
+    public ClaimResultListener {
+  public:
+    void OnClaimResult(const OnlineApplication& app, QStatus status)
+    {
+        lock.Lock();
+        results[app.keyInfo] = status;
+        lock.Unlock();
+    }
+
+    map<KeyInfoNISTP256, QStatus> results;
+    Mutex lock;
+};
+
+/**
+ * @test Claim a set of applications at once and check that the result of
+ *       each one of them is reported.
+ *       -# Start two applications and make sure they are CLAIMABLE.
+ *       -# Claim both applications and an unknown one in a single call.
+ *       -# Check that the call fails because of the unknown application.
+ *       -# Check that the result of each application was reported.
+ *       -# Check that both known applications become CLAIMED.
+ **/
+TEST_F(ClaimingTests, ClaimApplications) {
+    TestApplication testApp1("TestApp1");
+    TestApplication testApp2("TestApp2");
+    ASSERT_EQ(ER_OK, testApp1.Start());
+    ASSERT_EQ(ER_OK, testApp2.Start());
+    OnlineApplication app1;
+    OnlineApplication app2;
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp1, app1));
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp2, app2));
+    ASSERT_TRUE(WaitForState(app1, PermissionConfigurator::CLAIMABLE));
+    ASSERT_TRUE(WaitForState(app2, PermissionConfigurator::CLAIMABLE));
+
+    OnlineApplication unknown;
+    Crypto_ECC ecc;
+    ASSERT_EQ(ER_OK, ecc.GenerateDSAKeyPair());
+    unknown.keyInfo.SetPublicKey(ecc.GetDSAPublicKey());
+
+    IdentityInfo idInfo;
+    idInfo.guid = GUID128();
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(storage->StoreIdentity(idInfo), ER_OK);
+
+    vector<OnlineApplication> apps;
+    apps.push_back(app1);
+    apps.push_back(unknown);
+    apps.push_back(app2);
+    ClaimResultCollector collector;
+    ASSERT_EQ(ER_FAIL, secMgr->ClaimApplications(apps, idInfo, &collector, 2));
+
+    ASSERT_EQ((size_t)3, collector.results.size());
+    ASSERT_EQ(ER_OK, collector.results[app1.keyInfo]);
+    ASSERT_EQ(ER_OK, collector.results[app2.keyInfo]);
+    ASSERT_NE(ER_OK, collector.results[unknown.keyInfo]);
+
+    ASSERT_TRUE(WaitForState(app1, PermissionConfigurator::CLAIMED));
+    ASSERT_TRUE(WaitForState(app2, PermissionConfigurator::CLAIMED));
+    ASSERT_TRUE(CheckIdentity(app1, idInfo, aa.lastManifest));
+    ASSERT_TRUE(CheckIdentity(app2, idInfo, aa.lastManifest));
+}
+
+/*
+ * Approves every manifest, but only after a delay, and keeps track of how
+ * many claims are approving a manifest at the same time.
+ */
+class SlowClaimListener :
+    public ClaimListener {
+  public:
+    SlowClaimListener() : inFlight(0), maxInFlight(0)
+    {
+    }
+
+    QStatus ApproveManifestAndSelectSessionType(ClaimContext& ctx)
+    {
+        lock.Lock();
+        inFlight++;
+        if (inFlight > maxInFlight) {
+            maxInFlight = inFlight;
+        }
+        lock.Unlock();
+
+        qcc::Sleep(500);
+        ctx.SetClaimType(PermissionConfigurator::CAPABLE_ECDHE_NULL);
+        ctx.ApproveManifest();
+
+        lock.Lock();
+        inFlight--;
+        lock.Unlock();
+        return ER_OK;
+    }
+
+    size_t inFlight;
+    size_t maxInFlight;
+    Mutex lock;
+};
+
+/**
+ * @test Claim a set of applications at once and check that the claims
+ *       overlap, but never more than allowed.
+ *       -# Start three applications and make sure they are CLAIMABLE.
+ *       -# Claim them in a single call with at most two claims in flight,
+ *          using a claim listener that takes a while to approve a manifest.
+ *       -# Check that all applications were claimed.
+ *       -# Check that two manifests were being approved at the same time,
+ *          but never three.
+ **/
+TEST_F(ClaimingTests, ClaimApplicationsInFlight) {
+    TestApplication testApp1("TestApp1");
+    TestApplication testApp2("TestApp2");
+    TestApplication testApp3("TestApp3");
+    ASSERT_EQ(ER_OK, testApp1.Start());
+    ASSERT_EQ(ER_OK, testApp2.Start());
+    ASSERT_EQ(ER_OK, testApp3.Start());
+    vector<OnlineApplication> apps(3);
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp1, apps[0]));
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp2, apps[1]));
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp3, apps[2]));
+    for (size_t i = 0; i < apps.size(); i++) {
+        ASSERT_TRUE(WaitForState(apps[i], PermissionConfigurator::CLAIMABLE));
+    }
+
+    IdentityInfo idInfo;
+    idInfo.guid = GUID128();
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(storage->StoreIdentity(idInfo), ER_OK);
+
+    SlowClaimListener slowListener;
+    secMgr->SetClaimListener(&slowListener);
+    ClaimResultCollector collector;
+    ASSERT_EQ(ER_OK, secMgr->ClaimApplications(apps, idInfo, &collector, 2));
+    secMgr->SetClaimListener(&aa);
+
+    ASSERT_EQ((size_t)3, collector.results.size());
+    for (size_t i = 0; i < apps.size(); i++) {
+        ASSERT_EQ(ER_OK, collector.results[apps[i].keyInfo]);
+        ASSERT_TRUE(WaitForState(apps[i], PermissionConfigurator::CLAIMED));
+    }
+    ASSERT_EQ((size_t)2, slowListener.maxInFlight);
+}
+
+class CancelingClaimListener :
+    public ClaimListener {
+  public:
+    CancelingClaimListener() : cancelled(false)
+    {
+    }
+
+    QStatus ApproveManifestAndSelectSessionType(ClaimContext& ctx)
+    {
+        // Wait until the test has got the handle of the claim.
+        lock.Lock();
+        cancelled = handle->Cancel();
+        lock.Unlock();
+
+        ctx.ApproveManifest();
+        ctx.SetClaimType(PermissionConfigurator::CAPABLE_ECDHE_NULL);
+        return ER_OK;
+    }
+
+    shared_ptr<ClaimHandle> handle;
+    bool cancelled;
+    Mutex lock;
+};
+
+/**
+ * @test Claim an application asynchronously and check that the handle
+ *       reports the result.
+ *       -# Start the application and make sure it is CLAIMABLE.
+ *       -# Start claiming the application asynchronously.
+ *       -# Wait for the claim to finish using the handle.
+ *       -# Check that the handle and the listener report success.
+ *       -# Check whether the application becomes CLAIMED.
+ **/
+TEST_F(ClaimingTests, ClaimAsync) {
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app;
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp, app));
+    ASSERT_TRUE(WaitForState(app, PermissionConfigurator::CLAIMABLE));
+
+    IdentityInfo idInfo;
+    idInfo.guid = GUID128();
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(storage->StoreIdentity(idInfo), ER_OK);
+
+    ClaimResultCollector collector;
+    shared_ptr<ClaimHandle> handle;
+    ASSERT_EQ(ER_OK, secMgr->ClaimAsync(app, idInfo, &collector, handle));
+    ASSERT_TRUE(handle != nullptr);
+    ASSERT_EQ(ER_OK, handle->Wait(30000));
+
+    ASSERT_EQ(ClaimHandle::CLAIM_FINISHED, handle->GetStage());
+    ASSERT_EQ(ER_OK, handle->GetStatus());
+    ASSERT_FALSE(handle->IsCancelled());
+    ASSERT_FALSE(handle->Cancel());
+    ASSERT_EQ((size_t)1, collector.results.size());
+    ASSERT_EQ(ER_OK, collector.results[app.keyInfo]);
+
+    ASSERT_TRUE(WaitForState(app, PermissionConfigurator::CLAIMED));
+    ASSERT_TRUE(CheckIdentity(app, idInfo, aa.lastManifest));
+}
+
+/**
+ * @test Cancel an asynchronous claim before the application is claimed.
+ *       -# Start the application and make sure it is CLAIMABLE.
+ *       -# Start claiming the application asynchronously.
+ *       -# Cancel the claim while the manifest is being approved.
+ *       -# Check that the claim finishes with an error.
+ *       -# Check that the application was not stored and remains CLAIMABLE.
+ **/
+TEST_F(ClaimingTests, CancelClaimAsync) {
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app;
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp, app));
+    ASSERT_TRUE(WaitForState(app, PermissionConfigurator::CLAIMABLE));
+
+    IdentityInfo idInfo;
+    idInfo.guid = GUID128();
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(storage->StoreIdentity(idInfo), ER_OK);
+
+    CancelingClaimListener cancelingListener;
+    secMgr->SetClaimListener(&cancelingListener);
+
+    cancelingListener.lock.Lock();
+    QStatus status = secMgr->ClaimAsync(app, idInfo, nullptr, cancelingListener.handle);
+    cancelingListener.lock.Unlock();
+    ASSERT_EQ(ER_OK, status);
+    ASSERT_EQ(ER_OK, cancelingListener.handle->Wait(30000));
+
+    ASSERT_TRUE(cancelingListener.cancelled);
+    ASSERT_TRUE(cancelingListener.handle->IsCancelled());
+    ASSERT_EQ(ClaimHandle::CLAIM_FINISHED, cancelingListener.handle->GetStage());
+    ASSERT_NE(ER_OK, cancelingListener.handle->GetStatus());
+
+    ASSERT_NE(ER_OK, storage->GetManagedApplication(app));
+    testApp.SetApplicationState(PermissionConfigurator::CLAIMABLE); // Trigger another event
+    ASSERT_TRUE(WaitForState(app, PermissionConfigurator::CLAIMABLE));
+}
+
+class RememberingClaimListener :
+    public ClaimListener {
+  public:
+    RememberingClaimListener(bool _approve) : approve(_approve), calls(0)
+    {
+    }
+
+    QStatus ApproveManifestAndSelectSessionType(ClaimContext& ctx)
+    {
+        calls++;
+        ctx.ApproveManifest(approve);
+        ctx.SetClaimType(PermissionConfigurator::CAPABLE_ECDHE_NULL);
+        ctx.RememberDecision();
+        return ER_OK;
+    }
+
+    bool approve;
+    int calls;
+};
+
+/**
+ * @test Check that a remembered decision on a manifest is reused for other
+ *       applications requesting the same manifest.
+ *       -# Start two applications with the same manifest.
+ *       -# Claim the first one with a listener that remembers its approval.
+ *       -# Claim the second one and check the listener was not called again.
+ *       -# Check whether both applications become CLAIMED.
+ *       -# Remember a rejection for a third application and check that a
+ *          fourth one with the same manifest is rejected without the listener.
+ **/
+TEST_F(ClaimingTests, RememberedManifestDecision) {
+    TestApplication testApp1("TestApp1");
+    TestApplication testApp2("TestApp2");
+    ASSERT_EQ(ER_OK, testApp1.Start());
+    ASSERT_EQ(ER_OK, testApp2.Start());
+    OnlineApplication app1;
+    OnlineApplication app2;
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp1, app1));
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp2, app2));
+    ASSERT_TRUE(WaitForState(app1, PermissionConfigurator::CLAIMABLE));
+    ASSERT_TRUE(WaitForState(app2, PermissionConfigurator::CLAIMABLE));
+
+    IdentityInfo idInfo;
+    idInfo.guid = GUID128();
+    idInfo.name = "TestIdentity";
+    ASSERT_EQ(storage->StoreIdentity(idInfo), ER_OK);
+
+    RememberingClaimListener approver(true);
+    secMgr->SetClaimListener(&approver);
+    ASSERT_EQ(ER_OK, secMgr->Claim(app1, idInfo));
+    ASSERT_EQ(1, approver.calls);
+    ASSERT_EQ(ER_OK, secMgr->Claim(app2, idInfo));
+    ASSERT_EQ(1, approver.calls);
+    ASSERT_TRUE(WaitForState(app1, PermissionConfigurator::CLAIMED));
+    ASSERT_TRUE(WaitForState(app2, PermissionConfigurator::CLAIMED));
+
+    // Use another manifest, so the approval above does not apply.
+    PermissionPolicy::Rule rule;
+    rule.SetInterfaceName("org.allseen.test.Remembered");
+    PermissionPolicy::Rule::Member member;
+    member.SetMemberName("*");
+    member.SetActionMask(PermissionPolicy::Rule::Member::ACTION_PROVIDE);
+    rule.SetMembers(1, &member);
+    Manifest manifest(&rule, 1);
+    TestApplication testApp3("TestApp3");
+    TestApplication testApp4("TestApp4");
+    testApp3.SetManifest(manifest);
+    testApp4.SetManifest(manifest);
+    ASSERT_EQ(ER_OK, testApp3.Start());
+    ASSERT_EQ(ER_OK, testApp4.Start());
+    OnlineApplication app3;
+    OnlineApplication app4;
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp3, app3));
+    ASSERT_EQ(ER_OK, GetPublicKey(testApp4, app4));
+    ASSERT_TRUE(WaitForState(app3, PermissionConfigurator::CLAIMABLE));
+    ASSERT_TRUE(WaitForState(app4, PermissionConfigurator::CLAIMABLE));
+
+    RememberingClaimListener rejector(false);
+    secMgr->SetClaimListener(&rejector);
+    ASSERT_EQ(ER_MANIFEST_REJECTED, secMgr->Claim(app3, idInfo));
+    ASSERT_EQ(1, rejector.calls);
+    ASSERT_EQ(ER_MANIFEST_REJECTED, secMgr->Claim(app4, idInfo));
+    ASSERT_EQ(1, rejector.calls);
+}
+
 /**
  * @test Reject the manifest during claiming and check whether the application
  *       becomes CLAIMABLE again.
@@ -0,0 +1,362 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <string>
+
+#include <qcc/CryptoECC.h>
+#include <qcc/Thread.h>
+#include <qcc/time.h>
+
+#include <alljoyn/BusAttachment.h>
+
+#include "ProxyObjectManager.h"
+#include "TestApplication.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn;
+using namespace ajn::securitymgr;
+
+/** @file ProxyObjectManagerTests.cc */
+
+namespace secmgr_tests {
+class JoinThread :
+    public Thread {
+  public:
+    JoinThread(ProxyObjectManager* _proxyObjectManager,
+               const OnlineApplication& _app) :
+        Thread("JoinThread"), proxyObjectManager(_proxyObjectManager), app(_app), status(ER_FAIL) { }
+
+    ThreadReturn STDCALL Run(void* arg)
+    {
+        QCC_UNUSED(arg);
+        ProxyObjectManager::ManagedProxyObject mngdProxy(app);
+        status = proxyObjectManager->GetProxyObject(mngdProxy);
+        return nullptr;
+    }
+
+    ProxyObjectManager* proxyObjectManager;
+    OnlineApplication app;
+    QStatus status;
+};
+
+class ProxyObjectManagerTests :
+    public::testing::Test {
+  public:
+    ProxyObjectManagerTests() :
+        bus("proxyobjectmanagertest", true), proxyObjectManager(nullptr) { }
+
+    virtual void SetUp()
+    {
+        ASSERT_EQ(ER_OK, bus.Start());
+        ASSERT_EQ(ER_OK, bus.Connect());
+        proxyObjectManager = new ProxyObjectManager(&bus);
+    }
+
+    virtual void TearDown()
+    {
+        delete proxyObjectManager;
+        proxyObjectManager = nullptr;
+        bus.Disconnect();
+        bus.Stop();
+        bus.Join();
+    }
+
+    static OnlineApplication CreateApplication(const string& busName,
+                                               uint8_t id)
+    {
+        uint8_t coordinates[64]; // The X and Y coordinates of a NIST P-256 key.
+        for (size_t i = 0; i < sizeof(coordinates); i++) {
+            coordinates[i] = (uint8_t)(id + i);
+        }
+        ECCPublicKey publicKey;
+        publicKey.Import(coordinates, sizeof(coordinates));
+        OnlineApplication app;
+        app.keyInfo.SetPublicKey(&publicKey);
+        app.busName = busName;
+        return app;
+    }
+
+    /* The number of sessions the manager tried to join, whatever the outcome. */
+    size_t GetJoinAttempts(ProxyObjectManager::SessionType type = ProxyObjectManager::ECDHE_DSA)
+    {
+        JoinSessionStats stats = proxyObjectManager->GetJoinSessionStats(type);
+        size_t attempts = stats.failures + stats.timeouts;
+        for (size_t i = 0; i < JOIN_HISTOGRAM_BUCKETS; i++) {
+            attempts += stats.buckets[i];
+        }
+        return attempts;
+    }
+
+    QStatus GetProxyObject(const OnlineApplication& app,
+                           ProxyObjectManager::SessionType type = ProxyObjectManager::ECDHE_DSA)
+    {
+        ProxyObjectManager::ManagedProxyObject mngdProxy(app);
+        return proxyObjectManager->GetProxyObject(mngdProxy, type);
+    }
+
+    BusAttachment bus;
+    ProxyObjectManager* proxyObjectManager;
+};
+
+/**
+ * @test Verify that an application that could not be reached is not joined
+ *       again until its entry in the unreachable cache expires, and that the
+ *       entry only applies to the application it was created for.
+ *       -# Abandon every join immediately, so it ends as a timeout.
+ *       -# Get a proxy object for an application and check that it times out.
+ *       -# Get it again and check that no new join is attempted.
+ *       -# Get a proxy object for a different application on the same bus
+ *          name and check that a new join is attempted.
+ **/
+TEST_F(ProxyObjectManagerTests, UnreachableCacheChecksKey) {
+    proxyObjectManager->SetUnreachableTtl(60000);
+    proxyObjectManager->SetJoinTimeout(0);
+    OnlineApplication app = CreateApplication(":unreachable.2", 1);
+
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app));
+    ASSERT_EQ((size_t)1, GetJoinAttempts());
+
+    ASSERT_EQ(ER_ALLJOYN_JOINSESSION_REPLY_FAILED, GetProxyObject(app));
+    ASSERT_EQ((size_t)1, GetJoinAttempts());
+
+    OnlineApplication other = CreateApplication(app.busName, 2);
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(other));
+    ASSERT_EQ((size_t)2, GetJoinAttempts());
+}
+
+/**
+ * @test Verify that an entry of the unreachable cache expires after its
+ *       time to live and that a time to live of zero clears the cache.
+ *       -# Set a short time to live and let a join time out.
+ *       -# Check that the application is not joined again right away.
+ *       -# Wait until the entry expired and check that it is joined again.
+ *       -# Set the time to live to zero and check that the application is
+ *          joined again right away.
+ **/
+TEST_F(ProxyObjectManagerTests, UnreachableCacheExpires) {
+    proxyObjectManager->SetUnreachableTtl(200);
+    proxyObjectManager->SetJoinTimeout(0);
+    OnlineApplication app = CreateApplication(":unreachable.2", 1);
+
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app));
+    ASSERT_EQ(ER_ALLJOYN_JOINSESSION_REPLY_FAILED, GetProxyObject(app));
+    ASSERT_EQ((size_t)1, GetJoinAttempts());
+
+    qcc::Sleep(400);
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app));
+    ASSERT_EQ((size_t)2, GetJoinAttempts());
+
+    proxyObjectManager->SetUnreachableTtl(0);
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app));
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app));
+    ASSERT_EQ((size_t)4, GetJoinAttempts());
+}
+
+/**
+ * @test Verify that joins are accounted per session type in the join
+ *       session statistics.
+ *       -# Get a proxy object for a running application and check that one
+ *          join is counted in the histogram of its session type only.
+ *       -# Let a join time out and check that it is counted as a timeout.
+ **/
+TEST_F(ProxyObjectManagerTests, JoinSessionStats) {
+    for (size_t i = 1; i < JOIN_HISTOGRAM_BUCKETS - 1; i++) {
+        ASSERT_LT(JoinSessionStats::bucketLimits[i - 1], JoinSessionStats::bucketLimits[i]);
+    }
+
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app = CreateApplication(testApp.GetBusName(), 1);
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+
+    JoinSessionStats stats = proxyObjectManager->GetJoinSessionStats(ProxyObjectManager::ECDHE_NULL);
+    ASSERT_EQ((size_t)1, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ((uint64_t)0, stats.failures);
+    ASSERT_EQ((uint64_t)0, stats.timeouts);
+    ASSERT_EQ((size_t)0, GetJoinAttempts(ProxyObjectManager::ECDHE_DSA));
+
+    proxyObjectManager->SetUnreachableTtl(0);
+    proxyObjectManager->SetJoinTimeout(0);
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(CreateApplication(":unreachable.2", 2)));
+    stats = proxyObjectManager->GetJoinSessionStats(ProxyObjectManager::ECDHE_DSA);
+    ASSERT_EQ((uint64_t)1, stats.timeouts);
+    ASSERT_EQ((size_t)1, GetJoinAttempts(ProxyObjectManager::ECDHE_DSA));
+    ASSERT_EQ(ER_OK, testApp.Stop());
+}
+
+/**
+ * @test Verify that stopping the manager ends a pending join and that no
+ *       joins are started afterwards.
+ *       -# Start a join with a long timeout on a separate thread.
+ *       -# Stop the manager and check that the join ends well before its
+ *          timeout.
+ *       -# Check that a new join fails without being attempted.
+ **/
+TEST_F(ProxyObjectManagerTests, StopCancelsJoins) {
+    proxyObjectManager->SetUnreachableTtl(0);
+    proxyObjectManager->SetJoinTimeout(60000);
+    JoinThread joinThread(proxyObjectManager, CreateApplication(":unreachable.2", 1));
+    uint64_t start = GetTimestamp64();
+    ASSERT_EQ(ER_OK, joinThread.Start());
+    proxyObjectManager->Stop();
+    ASSERT_EQ(ER_OK, joinThread.Join());
+    ASSERT_LT(GetTimestamp64() - start, (uint64_t)10000);
+    ASSERT_NE(ER_OK, joinThread.status);
+    ASSERT_NE(ER_TIMEOUT, joinThread.status);
+
+    size_t attempts = GetJoinAttempts();
+    ASSERT_EQ(ER_BUS_STOPPING, GetProxyObject(CreateApplication(":unreachable.3", 2)));
+    ASSERT_EQ(attempts, GetJoinAttempts());
+}
+
+/**
+ * @test Verify that a session is shared by the users of an application and
+ *       kept in the pool while it is idle.
+ *       -# Get two proxy objects for the same application at the same time.
+ *       -# Check that only one session was joined.
+ *       -# Release both and get a proxy object again.
+ *       -# Check that the pooled session was used.
+ **/
+TEST_F(ProxyObjectManagerTests, SessionPoolReuse) {
+    proxyObjectManager->SetSessionIdleTtl(60000);
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app = CreateApplication(testApp.GetBusName(), 1);
+    {
+        ProxyObjectManager::ManagedProxyObject first(app);
+        ASSERT_EQ(ER_OK, proxyObjectManager->GetProxyObject(first, ProxyObjectManager::ECDHE_NULL));
+        ProxyObjectManager::ManagedProxyObject second(app);
+        ASSERT_EQ(ER_OK, proxyObjectManager->GetProxyObject(second, ProxyObjectManager::ECDHE_NULL));
+        ASSERT_EQ((size_t)1, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+    }
+
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ((size_t)1, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ(ER_OK, testApp.Stop());
+}
+
+/**
+ * @test Verify that idle sessions leave the pool after their time to live
+ *       and that a time to live of zero disables the pool.
+ *       -# Set a short time to live and get a proxy object.
+ *       -# Wait until the idle session expired and check that the next proxy
+ *          object joins a new session.
+ *       -# Set the time to live to zero and check that every proxy object
+ *          joins a new session.
+ **/
+TEST_F(ProxyObjectManagerTests, SessionPoolExpiry) {
+    proxyObjectManager->SetSessionIdleTtl(200);
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app = CreateApplication(testApp.GetBusName(), 1);
+
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    qcc::Sleep(400);
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ((size_t)2, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+
+    proxyObjectManager->SetSessionIdleTtl(0);
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ((size_t)4, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ(ER_OK, testApp.Stop());
+}
+
+/**
+ * @test Verify that a session authenticated with a pre-shared key is never
+ *       reused.
+ *       -# Get a proxy object over an ECDHE_PSK session twice.
+ *       -# Check that a session was joined for each of them.
+ **/
+TEST_F(ProxyObjectManagerTests, SessionPoolDiscardsPskSessions) {
+    proxyObjectManager->SetSessionIdleTtl(60000);
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app = CreateApplication(testApp.GetBusName(), 1);
+
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_PSK));
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_PSK));
+    ASSERT_EQ((size_t)2, GetJoinAttempts(ProxyObjectManager::ECDHE_PSK));
+    ASSERT_EQ(ER_OK, testApp.Stop());
+}
+
+/**
+ * @test Verify that a pooled session that is lost is removed from the pool.
+ *       -# Get a proxy object so its session is pooled.
+ *       -# Stop the remote application.
+ *       -# Check that the next proxy object no longer uses the lost session
+ *          but tries to join a new one, which fails.
+ **/
+TEST_F(ProxyObjectManagerTests, SessionPoolSessionLost) {
+    proxyObjectManager->SetSessionIdleTtl(60000);
+    proxyObjectManager->SetUnreachableTtl(0);
+    TestApplication testApp;
+    ASSERT_EQ(ER_OK, testApp.Start());
+    OnlineApplication app = CreateApplication(testApp.GetBusName(), 1);
+    ASSERT_EQ(ER_OK, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+
+    ASSERT_EQ(ER_OK, testApp.Stop());
+    QStatus status = ER_OK;
+    for (int i = 0; (ER_OK == status) && (i < 100); i++) {
+        status = GetProxyObject(app, ProxyObjectManager::ECDHE_NULL);
+        if (ER_OK == status) {
+            qcc::Sleep(50);
+        }
+    }
+    ASSERT_NE(ER_OK, status);
+    JoinSessionStats stats = proxyObjectManager->GetJoinSessionStats(ProxyObjectManager::ECDHE_NULL);
+    ASSERT_EQ((size_t)2, GetJoinAttempts(ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ((uint64_t)1, stats.failures + stats.timeouts);
+}
+
+/**
+ * @test Verify that peer security is only reconfigured on the bus when the
+ *       mechanisms or the listener change.
+ *       -# Enable the same mechanisms twice and check that the second call
+ *          is skipped.
+ *       -# Enable other mechanisms and check that the bus is reconfigured.
+ *       -# Get proxy objects with the session type that matches the enabled
+ *          mechanisms and check that peer security is not reconfigured.
+ **/
+TEST_F(ProxyObjectManagerTests, SkipsUnchangedPeerSecurity) {
+    PeerSecurityStats stats = proxyObjectManager->GetPeerSecurityStats();
+    ASSERT_EQ((uint64_t)0, stats.enabled);
+    ASSERT_EQ((uint64_t)0, stats.skipped);
+
+    ASSERT_EQ(ER_OK, proxyObjectManager->EnablePeerSecurity(ECDHE_KEYX, &proxyObjectManager->listener));
+    ASSERT_EQ(ER_OK, proxyObjectManager->EnablePeerSecurity(ECDHE_KEYX, &proxyObjectManager->listener));
+    stats = proxyObjectManager->GetPeerSecurityStats();
+    ASSERT_EQ((uint64_t)1, stats.enabled);
+    ASSERT_EQ((uint64_t)1, stats.skipped);
+
+    ASSERT_EQ(ER_OK, proxyObjectManager->EnablePeerSecurity(KEYX_ECDHE_NULL, &proxyObjectManager->listener));
+    stats = proxyObjectManager->GetPeerSecurityStats();
+    ASSERT_EQ((uint64_t)2, stats.enabled);
+    ASSERT_EQ((uint64_t)1, stats.skipped);
+
+    proxyObjectManager->SetUnreachableTtl(0);
+    proxyObjectManager->SetJoinTimeout(0);
+    OnlineApplication app = CreateApplication(":unreachable.2", 1);
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    ASSERT_EQ(ER_TIMEOUT, GetProxyObject(app, ProxyObjectManager::ECDHE_NULL));
+    stats = proxyObjectManager->GetPeerSecurityStats();
+    ASSERT_EQ((uint64_t)2, stats.enabled);
+    ASSERT_EQ((uint64_t)3, stats.skipped);
+}
+}
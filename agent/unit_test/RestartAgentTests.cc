@@ -14,7 +14,10 @@
  *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  ******************************************************************************/
 
+#include <atomic>
+
 #include "TestUtil.h"
+#include "AgentStorageWrapper.h"
 
 using namespace ajn;
 using namespace ajn::securitymgr;
@@ -22,6 +25,21 @@ using namespace ajn::securitymgr;
 /** @file RestartAgentTests.cc */
 
 namespace secmgr_tests {
+class LookupCountingStorageWrapper :
+    public AgentStorageWrapper {
+  public:
+    LookupCountingStorageWrapper(shared_ptr<AgentCAStorage>& _ca) :
+        AgentStorageWrapper(_ca), lookups(0) { }
+
+    QStatus GetManagedApplication(Application& app) const
+    {
+        lookups++;
+        return ca->GetManagedApplication(app);
+    }
+
+    mutable atomic<size_t> lookups;
+};
+
 class RestartAgentTests :
     public SecurityAgentTest {
   private:
@@ -32,6 +50,18 @@ class RestartAgentTests :
     RestartAgentTests()
     {
     }
+
+    shared_ptr<AgentCAStorage>& GetAgentCAStorage()
+    {
+        // Wrap once; a restarted agent reuses the same wrapper.
+        if (nullptr == wrappedCA) {
+            wrappedCA = shared_ptr<LookupCountingStorageWrapper>(new LookupCountingStorageWrapper(ca));
+            ca = wrappedCA;
+        }
+        return ca;
+    }
+
+    shared_ptr<LookupCountingStorageWrapper> wrappedCA;
 };
 
 /**
@@ -82,4 +112,42 @@ TEST_F(RestartAgentTests, SuccessfulAgentRestart) {
 
     apps.clear();
 }
+
+/**
+ * @test Verify that a restarted security agent reports the sync state of the
+ *       applications it finds from the managed applications it loaded from
+ *       storage.
+ *       -# Start two applications and claim one of them.
+ *       -# Delete the security agent and create a new one on the same storage.
+ *       -# Verify that the claimed application is reported as SYNC_OK.
+ *       -# Verify that the other application is reported as SYNC_UNMANAGED.
+ *       -# Verify that storage was not queried per application during
+ *          discovery.
+ **/
+TEST_F(RestartAgentTests, PreloadedSyncStates) {
+    TestApplication claimedApp("Claimed-Testapp");
+    TestApplication claimableApp("Claimable-Testapp");
+    IdentityInfo identity;
+    ASSERT_EQ(ER_OK, storage->StoreIdentity(identity));
+
+    OnlineApplication claimed;
+    ASSERT_EQ(ER_OK, claimedApp.Start());
+    ASSERT_EQ(ER_OK, GetPublicKey(claimedApp, claimed));
+    ASSERT_TRUE(WaitForState(claimed, PermissionConfigurator::CLAIMABLE));
+    ASSERT_EQ(ER_OK, secMgr->Claim(claimed, identity));
+    ASSERT_TRUE(WaitForState(claimed, PermissionConfigurator::CLAIMED, SYNC_OK));
+
+    OnlineApplication claimable;
+    ASSERT_EQ(ER_OK, claimableApp.Start());
+    ASSERT_EQ(ER_OK, GetPublicKey(claimableApp, claimable));
+    ASSERT_TRUE(WaitForState(claimable, PermissionConfigurator::CLAIMABLE));
+
+    RemoveSecAgent();
+    wrappedCA->lookups = 0;
+    InitSecAgent();
+    ASSERT_TRUE(WaitForState(claimed, PermissionConfigurator::CLAIMED, SYNC_OK));
+    ASSERT_TRUE(WaitForState(claimable, PermissionConfigurator::CLAIMABLE, SYNC_UNMANAGED));
+    ASSERT_EQ((size_t)0, wrappedCA->lookups);
+    RemoveSecAgent();
+}
 }
@@ -0,0 +1,104 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include "SyncRetryScheduler.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn::securitymgr;
+
+/** @file SyncRetrySchedulerTests.cc */
+
+namespace secmgr_tests {
+/**
+ * @test Verify that the backoff doubles per attempt up to the maximum delay
+ *       and is jittered over the second half of the delay.
+ *       -# Compute many backoffs for each attempt.
+ *       -# Check that they stay within the second half of the expected delay.
+ *       -# Check that they are spread over that half rather than fixed.
+ **/
+TEST(SyncRetrySchedulerTest, Backoff) {
+    SyncRetryConfig config;
+    config.initialDelay = 1000;
+    config.maxDelay = 6000;
+    const uint64_t expected[] = { 1000, 1000, 2000, 4000, 6000, 6000 };
+
+    for (uint32_t attempts = 0; attempts < sizeof(expected) / sizeof(expected[0]); attempts++) {
+        uint64_t delay = expected[attempts];
+        uint64_t lowest = delay;
+        uint64_t highest = 0;
+        for (int i = 0; i < 1000; i++) {
+            uint64_t backoff = SyncRetryScheduler::GetBackoff(config, attempts);
+            ASSERT_GE(backoff, delay / 2);
+            ASSERT_LE(backoff, delay);
+            lowest = (backoff < lowest) ? backoff : lowest;
+            highest = (backoff > highest) ? backoff : highest;
+        }
+        // The jitter covers most of the second half of the delay.
+        ASSERT_LT(lowest, delay / 2 + delay / 8);
+        ASSERT_GT(highest, delay - delay / 8);
+    }
+
+    config.initialDelay = 0;
+    ASSERT_LE(SyncRetryScheduler::GetBackoff(config, 1), (uint64_t)1);
+}
+
+/**
+ * @test Verify that the retry budget allows a burst and is then earned back
+ *       one retry per interval, up to its maximum.
+ *       -# Take the whole budget at once and check that the next retry has
+ *          to wait for one interval.
+ *       -# Check that one retry is earned back per interval.
+ *       -# Wait for several intervals and check that the budget does not
+ *          grow beyond its maximum.
+ **/
+TEST(SyncRetrySchedulerTest, Budget) {
+    uint64_t now = 100000;
+    SyncRetryBudget budget(3, 1000, now);
+
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ((uint64_t)0, budget.Take(now));
+    }
+    ASSERT_EQ((uint64_t)1000, budget.Take(now));
+    ASSERT_EQ((uint64_t)600, budget.Take(now + 400));
+
+    ASSERT_EQ((uint64_t)0, budget.Take(now + 1000));
+    ASSERT_EQ((uint64_t)1000, budget.Take(now + 1000));
+    ASSERT_EQ((uint64_t)0, budget.Take(now + 2500));
+    ASSERT_EQ((uint64_t)500, budget.Take(now + 2500));
+
+    now += 60000;
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ((uint64_t)0, budget.Take(now));
+    }
+    ASSERT_NE((uint64_t)0, budget.Take(now));
+}
+
+/**
+ * @test Verify that a budget of zero still lets retries through, one at a
+ *       time.
+ *       -# Create a budget of zero retries.
+ *       -# Check that a single retry can be taken.
+ **/
+TEST(SyncRetrySchedulerTest, EmptyBudget) {
+    SyncRetryBudget budget(0, 0, 0);
+    ASSERT_EQ((uint64_t)0, budget.Take(0));
+    ASSERT_NE((uint64_t)0, budget.Take(0));
+    ASSERT_EQ((uint64_t)0, budget.Take(1));
+}
+}
@@ -0,0 +1,399 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+
+#include "TaskQueue.h"
+
+using namespace std;
+using namespace qcc;
+using namespace ajn::securitymgr;
+
+/** @file TaskQueueTests.cc */
+
+namespace secmgr_tests {
+typedef chrono::steady_clock Clock;
+
+struct TestTask {
+    TestTask(size_t _id, size_t _key = 0) :
+        id(_id), key(_key), enqueued(Clock::now()) { }
+
+    size_t id;
+    size_t key;
+    Clock::time_point enqueued;
+};
+
+static size_t PriorityByKey(TestTask* task)
+{
+    return task->key;
+}
+
+static bool CoalesceSameKey(TestTask* queued, TestTask* incoming)
+{
+    if (queued->key != incoming->key) {
+        return false;
+    }
+    queued->id = incoming->id;
+    return true;
+}
+
+class TestTaskHandler {
+  public:
+    TestTaskHandler() :
+        handlingTime(0), blocked(false) { }
+
+    void HandleTask(TestTask* task)
+    {
+        Clock::time_point now = Clock::now();
+        while (blocked) {
+            qcc::Sleep(1);
+        }
+        if (handlingTime > 0) {
+            qcc::Sleep(handlingTime);
+        }
+        lock.Lock(__FILE__, __LINE__);
+        handled.push_back(task->id);
+        latencies.push_back(chrono::duration_cast<chrono::microseconds>(now - task->enqueued).count());
+        lock.Unlock(__FILE__, __LINE__);
+    }
+
+    bool WaitForTasks(size_t count, uint32_t timeout = 5000)
+    {
+        for (uint32_t waited = 0; waited < timeout; waited += 5) {
+            lock.Lock(__FILE__, __LINE__);
+            size_t done = handled.size();
+            lock.Unlock(__FILE__, __LINE__);
+            if (done >= count) {
+                return true;
+            }
+            qcc::Sleep(5);
+        }
+        return false;
+    }
+
+    uint32_t handlingTime;
+    volatile bool blocked; // Holds the worker in HandleTask while set.
+    Mutex lock;
+    vector<size_t> handled;
+    vector<long long> latencies;
+};
+
+class TaskQueueTests :
+    public::testing::Test {
+};
+
+/**
+ * @test Verify that a single worker handles all tasks in order, also after
+ *       it exited because it was idle.
+ *       -# Add a burst of tasks and check they are handled in order.
+ *       -# Wait longer than the idle timeout of the worker.
+ *       -# Add another burst of tasks and check they are handled in order.
+ **/
+TEST_F(TaskQueueTests, InOrderAcrossIdleTimeout) {
+    TestTaskHandler handler;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler, 1, 50);
+
+    for (size_t i = 0; i < 100; i++) {
+        queue.AddTask(new TestTask(i));
+    }
+    ASSERT_TRUE(handler.WaitForTasks(100));
+
+    qcc::Sleep(200);
+
+    for (size_t i = 100; i < 200; i++) {
+        queue.AddTask(new TestTask(i));
+    }
+    ASSERT_TRUE(handler.WaitForTasks(200));
+    queue.Stop();
+
+    for (size_t i = 0; i < handler.handled.size(); i++) {
+        ASSERT_EQ(i, handler.handled[i]);
+    }
+}
+
+/**
+ * @test Verify that a queue is only idle when no task is queued or handled.
+ *       -# Check that a new queue is idle.
+ *       -# Add tasks while the worker is blocked and check that the queue
+ *          is not idle.
+ *       -# Unblock the worker and check that the queue becomes idle, both
+ *          while its worker waits and after the worker exited.
+ **/
+TEST_F(TaskQueueTests, Idle) {
+    TestTaskHandler handler;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler, 1, 50);
+    ASSERT_TRUE(queue.IsIdle());
+
+    handler.blocked = true;
+    ASSERT_EQ(ER_OK, queue.AddTask(new TestTask(0)));
+    ASSERT_EQ(ER_OK, queue.AddTask(new TestTask(1)));
+    ASSERT_FALSE(queue.IsIdle());
+
+    handler.blocked = false;
+    ASSERT_TRUE(handler.WaitForTasks(2));
+    bool idle = false;
+    for (int i = 0; !idle && (i < 100); i++) {
+        idle = queue.IsIdle();
+        if (!idle) {
+            qcc::Sleep(5);
+        }
+    }
+    ASSERT_TRUE(idle);
+
+    qcc::Sleep(200);
+    ASSERT_TRUE(queue.IsIdle());
+    queue.Stop();
+}
+
+/**
+ * @test Verify that multiple workers handle tasks concurrently and that no
+ *       task is added after the queue is stopped.
+ *       -# Add tasks that each take 50ms to a queue with 4 workers.
+ *       -# Check that they are all handled well within the time a single
+ *          worker would need.
+ *       -# Stop the queue, add a task and check that it is refused and not
+ *          handled.
+ **/
+TEST_F(TaskQueueTests, MultipleWorkers) {
+    TestTaskHandler handler;
+    handler.handlingTime = 50;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler, 4);
+
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < 8; i++) {
+        ASSERT_EQ(ER_OK, queue.AddTask(new TestTask(i)));
+    }
+    ASSERT_TRUE(handler.WaitForTasks(8));
+    long long elapsed = chrono::duration_cast<chrono::milliseconds>(Clock::now() - start).count();
+    ASSERT_LT(elapsed, 8 * 50);
+
+    queue.Stop();
+    ASSERT_EQ(ER_BUS_STOPPING, queue.AddTask(new TestTask(8)));
+    qcc::Sleep(100);
+    ASSERT_EQ((size_t)8, handler.handled.size());
+}
+
+/**
+ * @test Verify that a full queue drops its oldest tasks when configured so.
+ *       -# Block the worker on a first task and fill a queue of capacity 4
+ *          with 10 more tasks.
+ *       -# Check the statistics report 6 dropped tasks and a depth of 4.
+ *       -# Unblock the worker and check only the newest 4 tasks are handled
+ *          after the first one.
+ **/
+TEST_F(TaskQueueTests, BoundedDropOldest) {
+    TestTaskHandler handler;
+    handler.blocked = true;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+    queue.SetCapacity(4, TASKQUEUE_DROP_OLDEST);
+
+    queue.AddTask(new TestTask(0));
+    qcc::Sleep(50);
+    for (size_t i = 1; i <= 10; i++) {
+        queue.AddTask(new TestTask(i));
+    }
+    TaskQueueStats stats = queue.GetStats();
+    ASSERT_EQ((size_t)4, stats.depth);
+    ASSERT_EQ((size_t)4, stats.highWaterMark);
+    ASSERT_EQ((uint64_t)11, stats.added);
+    ASSERT_EQ((uint64_t)6, stats.dropped);
+
+    handler.blocked = false;
+    ASSERT_TRUE(handler.WaitForTasks(5));
+    queue.Stop();
+    ASSERT_EQ((size_t)5, handler.handled.size());
+    ASSERT_EQ((size_t)0, handler.handled[0]);
+    for (size_t i = 1; i < 5; i++) {
+        ASSERT_EQ(i + 6, handler.handled[i]);
+    }
+    ASSERT_EQ((size_t)0, queue.GetStats().depth);
+}
+
+/**
+ * @test Verify that a full queue merges tasks about the same subject.
+ *       -# Block the worker and fill a queue of capacity 2 with tasks for
+ *          two keys.
+ *       -# Add more tasks for both keys and check they are coalesced into
+ *          the queued ones, keeping the latest id.
+ *       -# Add a task for a third key and check the oldest task is dropped.
+ **/
+TEST_F(TaskQueueTests, BoundedCoalesce) {
+    TestTaskHandler handler;
+    handler.blocked = true;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+    queue.SetCapacity(2, TASKQUEUE_COALESCE, CoalesceSameKey);
+
+    queue.AddTask(new TestTask(0, 0));
+    qcc::Sleep(50);
+    queue.AddTask(new TestTask(1, 1));
+    queue.AddTask(new TestTask(2, 2));
+    queue.AddTask(new TestTask(3, 1));
+    queue.AddTask(new TestTask(4, 2));
+    TaskQueueStats stats = queue.GetStats();
+    ASSERT_EQ((size_t)2, stats.depth);
+    ASSERT_EQ((uint64_t)2, stats.coalesced);
+    ASSERT_EQ((uint64_t)0, stats.dropped);
+
+    queue.AddTask(new TestTask(5, 3));
+    ASSERT_EQ((uint64_t)1, queue.GetStats().dropped);
+
+    handler.blocked = false;
+    ASSERT_TRUE(handler.WaitForTasks(3));
+    queue.Stop();
+    ASSERT_EQ((size_t)3, handler.handled.size());
+    ASSERT_EQ((size_t)0, handler.handled[0]);
+    ASSERT_EQ((size_t)4, handler.handled[1]);
+    ASSERT_EQ((size_t)5, handler.handled[2]);
+}
+
+/**
+ * @test Verify that a full queue blocks the producer until there is room.
+ *       -# Block the worker and fill a queue of capacity 1.
+ *       -# Add a task from another thread and check it does not return.
+ *       -# Unblock the worker and check all tasks are handled in order.
+ **/
+TEST_F(TaskQueueTests, BoundedBlock) {
+    TestTaskHandler handler;
+    handler.blocked = true;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+    queue.SetCapacity(1, TASKQUEUE_BLOCK);
+
+    queue.AddTask(new TestTask(0));
+    qcc::Sleep(50);
+    queue.AddTask(new TestTask(1));
+    volatile bool added = false;
+    thread producer([&queue, &added]() {
+                        queue.AddTask(new TestTask(2));
+                        added = true;
+                    });
+    qcc::Sleep(100);
+    ASSERT_FALSE(added);
+
+    handler.blocked = false;
+    producer.join();
+    ASSERT_TRUE(handler.WaitForTasks(3));
+    queue.Stop();
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(i, handler.handled[i]);
+    }
+    ASSERT_EQ((uint64_t)0, queue.GetStats().dropped);
+}
+
+/**
+ * @test Verify that tasks are handled by priority, in order within a
+ *       priority, and that the per priority statistics are reported.
+ *       -# Block the worker and queue tasks of priority 2, 1 and 0.
+ *       -# Check the priorities cannot be changed while tasks are queued.
+ *       -# Unblock the worker and check the priority 0 tasks are handled
+ *          first, then those of priority 1 and finally those of priority 2.
+ *       -# Check the statistics of every priority level.
+ **/
+TEST_F(TaskQueueTests, Priorities) {
+    TestTaskHandler handler;
+    handler.blocked = true;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+    ASSERT_EQ(ER_OK, queue.SetPriorities(3, PriorityByKey, 60000));
+
+    queue.AddTask(new TestTask(0, 0));
+    qcc::Sleep(50);
+    for (size_t i = 1; i <= 9; i++) {
+        queue.AddTask(new TestTask(i, 2 - ((i - 1) / 3)));
+    }
+    ASSERT_EQ(ER_FAIL, queue.SetPriorities(2, PriorityByKey));
+    TaskQueueStats stats = queue.GetStats();
+    ASSERT_EQ((size_t)9, stats.depth);
+    ASSERT_EQ((size_t)3, stats.priorities.size());
+    ASSERT_EQ((size_t)3, stats.priorities[1].depth);
+
+    handler.blocked = false;
+    ASSERT_TRUE(handler.WaitForTasks(10));
+    queue.Stop();
+    size_t expected[] = { 0, 7, 8, 9, 4, 5, 6, 1, 2, 3 };
+    for (size_t i = 0; i < 10; i++) {
+        ASSERT_EQ(expected[i], handler.handled[i]);
+    }
+    stats = queue.GetStats();
+    ASSERT_EQ((uint64_t)4, stats.priorities[0].handled);
+    ASSERT_EQ((uint64_t)3, stats.priorities[1].handled);
+    ASSERT_EQ((uint64_t)3, stats.priorities[2].handled);
+    ASSERT_EQ((uint64_t)0, stats.aged);
+}
+
+/**
+ * @test Verify that low priority tasks are not starved by a steady stream
+ *       of high priority tasks.
+ *       -# Queue a low priority task and keep adding high priority tasks
+ *          faster than they can be handled.
+ *       -# Check the low priority task is handled long before the high
+ *          priority tasks run out.
+ **/
+TEST_F(TaskQueueTests, PriorityAging) {
+    TestTaskHandler handler;
+    handler.handlingTime = 10;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+    ASSERT_EQ(ER_OK, queue.SetPriorities(2, PriorityByKey, 50));
+
+    queue.AddTask(new TestTask(0, 0));
+    queue.AddTask(new TestTask(1000, 1));
+    for (size_t i = 1; i < 40; i++) {
+        queue.AddTask(new TestTask(i, 0));
+        qcc::Sleep(5);
+    }
+    ASSERT_TRUE(handler.WaitForTasks(41));
+    queue.Stop();
+
+    size_t position = find(handler.handled.begin(), handler.handled.end(), (size_t)1000) - handler.handled.begin();
+    ASSERT_LT(position, (size_t)20);
+    ASSERT_EQ((uint64_t)1, queue.GetStats().aged);
+}
+
+/**
+ * @test Micro-benchmark of the latency between enqueueing a task and the
+ *       start of its handling, for bursts separated by short pauses.
+ *       -# Add bursts of tasks with pauses in between.
+ *       -# Report the median, 99th percentile and maximum latency.
+ **/
+TEST_F(TaskQueueTests, DispatchLatencyBenchmark) {
+    TestTaskHandler handler;
+    TaskQueue<TestTask*, TestTaskHandler> queue(&handler);
+
+    const size_t bursts = 50;
+    const size_t burstSize = 20;
+    for (size_t b = 0; b < bursts; b++) {
+        for (size_t i = 0; i < burstSize; i++) {
+            queue.AddTask(new TestTask(b * burstSize + i));
+        }
+        ASSERT_TRUE(handler.WaitForTasks((b + 1) * burstSize));
+        qcc::Sleep(2);
+    }
+    queue.Stop();
+
+    vector<long long> latencies = handler.latencies;
+    sort(latencies.begin(), latencies.end());
+    cout << "Enqueue to dispatch latency (us) over " << latencies.size() << " tasks: median "
+         << latencies[latencies.size() / 2] << ", p99 " << latencies[(latencies.size() * 99) / 100]
+         << ", max " << latencies.back() << endl;
+}
+}
@@ -0,0 +1,54 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWALCONFIG_H_
+#define ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWALCONFIG_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace ajn {
+namespace securitymgr {
+/**
+ * @brief Settings of the background certificate renewal.
+ */
+struct CertificateRenewalConfig {
+    /**
+     * Certificates expiring within this period (in seconds) are renewed.
+     * Must be smaller than the certificate validity period.
+     */
+    uint64_t renewBefore;
+
+    /**
+     * Time between two renewal runs (in milliseconds).
+     */
+    uint32_t checkInterval;
+
+    /**
+     * The maximum number of certificates renewed per run. Remaining
+     * certificates are picked up by the next run.
+     */
+    size_t maxCertificatesPerRun;
+
+    CertificateRenewalConfig() :
+        renewBefore(3600 * 24 * 7), checkInterval(3600 * 1000), maxCertificatesPerRun(100)
+    {
+    }
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWALCONFIG_H_ */
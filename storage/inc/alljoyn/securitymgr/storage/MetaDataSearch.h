@@ -0,0 +1,46 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_STORAGE_METADATASEARCH_H_
+#define ALLJOYN_SECMGR_STORAGE_METADATASEARCH_H_
+
+#include <alljoyn/securitymgr/Application.h>
+
+#include "ApplicationMetaData.h"
+
+namespace ajn {
+namespace securitymgr {
+/**
+ * @brief How search text is matched against the application name, the device
+ *        name and the user defined name of an application. Matching is case
+ *        insensitive.
+ */
+enum MetaDataSearchType {
+    METADATA_SEARCH_PREFIX = 0,   ///< One of the names starts with the search text.
+    METADATA_SEARCH_SUBSTRING = 1 ///< One of the names contains the search text.
+};
+
+/**
+ * @brief An application matching a metadata search, together with its metadata.
+ */
+struct MetaDataSearchResult {
+    Application app;
+    ApplicationMetaData metaData;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_STORAGE_METADATASEARCH_H_ */
@@ -32,6 +32,8 @@
 #include <alljoyn/securitymgr/AgentCAStorage.h>
 
 #include "ApplicationMetaData.h"
+#include "CertificateRenewalConfig.h"
+#include "MetaDataSearch.h"
 
 namespace ajn {
 namespace securitymgr {
@@ -142,6 +144,32 @@ class UIStorage {
     virtual QStatus GetAppMetaData(const Application& app,
                                    ApplicationMetaData& appMetaData) const = 0;
 
+    /**
+     * @brief Search managed applications by their meta data.
+     *
+     * Results are returned in pages, in a stable order. Pass a pageToken of 0
+     * to retrieve the first page and pass the returned pageToken to retrieve
+     * the next one.
+     *
+     * @param[in] text            The text to search for.
+     * @param[in] type            Whether to match a prefix or any substring.
+     * @param[in] pageSize        The maximum number of results to return.
+     * @param[in,out] pageToken   In, the position to continue from. Out, the
+     *                            position of the next page or 0 if there are
+     *                            no more results.
+     * @param[in,out] results     The matching applications and their meta data.
+     *
+     * @return ER_OK              On success.
+     * @return ER_BAD_ARG_1       If the search text is empty.
+     * @return ER_BAD_ARG_3       If the page size is zero.
+     * @return others             On failure.
+     */
+    virtual QStatus SearchAppMetaData(const string& text,
+                                      const MetaDataSearchType type,
+                                      const size_t pageSize,
+                                      uint64_t& pageToken,
+                                      vector<MetaDataSearchResult>& results) const = 0;
+
     /**
      * @brief Resets a previously managed application. If the application is online, it will be
      *        reset immediately. If it is off-line, it will be reset when it comes back online.
@@ -308,6 +336,38 @@ class UIStorage {
      */
     virtual QStatus GetAdminGroup(GroupInfo& groupInfo) const = 0;
 
+    /**
+     * @brief Set the validity period of newly generated and renewed certificates.
+     *
+     * While certificate renewal runs, no certificates are renewed as long as
+     * the validity period is not larger than its renewBefore period.
+     *
+     * @param[in] validity        The validity period in seconds.
+     */
+    virtual void SetCertificateValidity(uint64_t validity) = 0;
+
+    /**
+     * @brief Start renewing certificates in the background before they expire.
+     *
+     * Expiring identity and membership certificates are re-issued in batches.
+     * Affected applications get pending changes, so a security agent will
+     * push the renewed certificates to them. Starting an already started
+     * renewal updates its configuration.
+     *
+     * @param[in] config          The renewal settings.
+     *
+     * @return ER_OK              On success.
+     * @return ER_BAD_ARG_1       If renewBefore is not smaller than the certificate
+     *                            validity period or maxCertificatesPerRun is zero.
+     * @return others             On failure.
+     */
+    virtual QStatus StartCertificateRenewal(const CertificateRenewalConfig& config) = 0;
+
+    /**
+     * @brief Stop the background certificate renewal.
+     */
+    virtual void StopCertificateRenewal() = 0;
+
     /**
      * @brief Reset the storage and delete the database.
      */
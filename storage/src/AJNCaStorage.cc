@@ -189,12 +189,49 @@ QStatus AJNCaStorage::SignCertifcate(CertificateX509& certificate) const
     return status;
 }
 
+QStatus AJNCaStorage::RenewCertificates(vector<StoredCertificate>& certificates) const
+{
+    if (certificates.empty()) {
+        return ER_OK;
+    }
+
+    KeyInfoNISTP256 caInfo;
+    QStatus status = GetCaPublicKeyInfo(caInfo);
+    if (ER_OK != status) {
+        QCC_LogError(status, ("Failed to get public key"));
+        return status;
+    }
+    ECCPrivateKey epk;
+    status = ca->GetDSAPrivateKey(epk);
+    if (status != ER_OK) {
+        QCC_LogError(status, ("Failed to load key"));
+        return status;
+    }
+
+    uint64_t validity = GetCertificateValidity();
+    vector<StoredCertificate>::iterator it;
+    for (it = certificates.begin(); it != certificates.end(); ++it) {
+        CertificateX509& cert = *(it->certificate);
+        if (ER_OK != (status = sql->GetNewSerialNumber(cert))) {
+            QCC_LogError(status, ("Failed to get a new serial number"));
+            break;
+        }
+        CertificateUtil::SetValityPeriod(validity, cert);
+        cert.SetIssuerCN(caInfo.GetKeyId(), caInfo.GetKeyIdLen());
+        if (ER_OK != (status = cert.SignAndGenerateAuthorityKeyId(&epk, caInfo.GetPublicKey()))) {
+            QCC_LogError(status, ("Failed to sign certificate"));
+            break;
+        }
+    }
+    return status;
+}
+
 QStatus AJNCaStorage::GenerateIdentityCertificate(const Application& app,
                                                   const IdentityInfo& idInfo,
                                                   const Manifest& mf,
                                                   IdentityCertificate& idCertificate)
 {
-    QStatus status = CertificateUtil::ToIdentityCertificate(app, idInfo, 3600 * 24 * 10 * 365, idCertificate);
+    QStatus status = CertificateUtil::ToIdentityCertificate(app, idInfo, GetCertificateValidity(), idCertificate);
     if (status != ER_OK) {
         return status;
     }
@@ -207,7 +244,7 @@ QStatus AJNCaStorage::GenerateIdentityCertificate(const Application& app,
 QStatus AJNCaStorage::GenerateMembershipCertificate(const Application& app,
                                                     const GroupInfo& groupInfo, MembershipCertificate& memberShip)
 {
-    QStatus status = CertificateUtil::ToMembershipCertificate(app, groupInfo, 3600 * 24 * 10 * 365, memberShip);
+    QStatus status = CertificateUtil::ToMembershipCertificate(app, groupInfo, GetCertificateValidity(), memberShip);
     if (status != ER_OK) {
         return status;
     }
@@ -29,6 +29,9 @@
 #include "SQLStorage.h"
 #include "AJNCa.h"
 
+/* Validity period of generated certificates in seconds (10 years). */
+#define DEFAULT_CERTIFICATE_VALIDITY (3600ULL * 24 * 10 * 365)
+
 using namespace qcc;
 using namespace std;
 
@@ -56,7 +59,8 @@ class StorageListenerHandler {
 class AJNCaStorage :
     public AgentCAStorage {
   public:
-    AJNCaStorage() : ca(nullptr), sql(nullptr), handler(nullptr)
+    AJNCaStorage() : ca(nullptr), sql(nullptr), handler(nullptr),
+        certificateValidity(DEFAULT_CERTIFICATE_VALIDITY)
     {
     };
 
@@ -131,8 +135,87 @@ class AJNCaStorage :
     virtual QStatus GetPolicy(const Application& app,
                               PermissionPolicy& policy) const;
 
+    virtual QStatus StoreSyncDigest(const Application& app,
+                                    const uint8_t* digest)
+    {
+        return sql->StoreSyncDigest(app, digest, Crypto_SHA256::DIGEST_SIZE);
+    }
+
+    virtual QStatus GetSyncDigest(const Application& app,
+                                  uint8_t* digest) const
+    {
+        return sql->GetSyncDigest(app, digest, Crypto_SHA256::DIGEST_SIZE);
+    }
+
+    virtual QStatus GetSyncBundle(const Application& app,
+                                  SyncBundle& bundle) const
+    {
+        return sql->GetSyncBundle(app, bundle);
+    }
+
+    virtual QStatus StoreSyncRetry(const SyncRetry& retry)
+    {
+        return sql->StoreSyncRetry(retry);
+    }
+
+    virtual QStatus RemoveSyncRetry(const Application& app)
+    {
+        return sql->RemoveSyncRetry(app);
+    }
+
+    virtual QStatus GetSyncRetries(vector<SyncRetry>& retries) const
+    {
+        return sql->GetSyncRetries(retries);
+    }
+
+    virtual QStatus StoreManifestApproval(const ManifestApproval& approval)
+    {
+        return sql->StoreManifestApproval(approval);
+    }
+
+    virtual QStatus GetManifestApproval(ManifestApproval& approval) const
+    {
+        return sql->GetManifestApproval(approval);
+    }
+
+    virtual QStatus RemoveManifestApproval(const uint8_t* digest)
+    {
+        return sql->RemoveManifestApproval(digest);
+    }
+
+    virtual QStatus GetManagedApplications(vector<Application>& apps) const
+    {
+        return sql->GetManagedApplications(apps);
+    }
+
     QStatus GetAdminGroup(GroupInfo& adminGroup) const;
 
+    void SetCertificateValidity(uint64_t validity)
+    {
+        validityLock.Lock(__FILE__, __LINE__);
+        certificateValidity = validity;
+        validityLock.Unlock(__FILE__, __LINE__);
+    }
+
+    uint64_t GetCertificateValidity() const
+    {
+        validityLock.Lock(__FILE__, __LINE__);
+        uint64_t validity = certificateValidity;
+        validityLock.Unlock(__FILE__, __LINE__);
+        return validity;
+    }
+
+    /**
+     * @brief Re-issue a batch of certificates with a new serial number and
+     *        validity period. The CA key is loaded only once for the batch.
+     *
+     * @param[in,out] certificates  The certificates to renew; they are signed in place.
+     *
+     * @return ER_OK  On success.
+     * @return others On failure.
+     */
+    QStatus RenewCertificates(vector<StoredCertificate>& certificates) const;
+
   private:
     QStatus SignCertifcate(CertificateX509& certificate) const;
 
@@ -140,6 +223,8 @@ class AJNCaStorage :
     shared_ptr<SQLStorage> sql;
     shared_ptr<StorageListenerHandler> handler;
     Mutex pendingLock;
+    mutable Mutex validityLock; // Set by the UI, read by the certificate renewal.
+    uint64_t certificateValidity;
 
     struct CachedData {
         IdentityCertificate cert;
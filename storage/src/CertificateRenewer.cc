@@ -0,0 +1,69 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#include "CertificateRenewer.h"
+#include "UIStorageImpl.h"
+
+#include <qcc/Debug.h>
+
+#define QCC_MODULE "SECMGR_STORAGE"
+
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+void CertificateRenewer::SetConfig(const CertificateRenewalConfig& _config)
+{
+    lock.Lock(__FILE__, __LINE__);
+    config = _config;
+    cond.Signal();
+    lock.Unlock(__FILE__, __LINE__);
+}
+
+void CertificateRenewer::Terminate()
+{
+    lock.Lock(__FILE__, __LINE__);
+    stopped = true;
+    cond.Signal();
+    lock.Unlock(__FILE__, __LINE__);
+}
+
+ThreadReturn STDCALL CertificateRenewer::Run(void* arg)
+{
+    QCC_UNUSED(arg);
+
+    lock.Lock(__FILE__, __LINE__);
+    while (!stopped) {
+        CertificateRenewalConfig current = config;
+        lock.Unlock(__FILE__, __LINE__);
+
+        QStatus status = storage->RenewExpiringCertificates(current.renewBefore, current.maxCertificatesPerRun);
+        if (ER_OK != status) {
+            QCC_LogError(status, ("Failed to renew expiring certificates"));
+        }
+
+        lock.Lock(__FILE__, __LINE__);
+        if (!stopped) {
+            cond.TimedWait(lock, current.checkInterval);
+        }
+    }
+    lock.Unlock(__FILE__, __LINE__);
+
+    return nullptr;
+}
+}
+}
+#undef QCC_MODULE
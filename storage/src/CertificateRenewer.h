@@ -0,0 +1,69 @@
+/******************************************************************************
+ * Copyright AllSeen Alliance. All rights reserved.
+ *
+ *    Permission to use, copy, modify, and/or distribute this software for any
+ *    purpose with or without fee is hereby granted, provided that the above
+ *    copyright notice and this permission notice appear in all copies.
+ *
+ *    THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ *    WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ *    MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ *    ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ *    WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ *    ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ *    OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ ******************************************************************************/
+
+#ifndef ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWER_H_
+#define ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWER_H_
+
+#include <qcc/Condition.h>
+#include <qcc/Mutex.h>
+#include <qcc/Thread.h>
+
+#include <alljoyn/securitymgr/storage/CertificateRenewalConfig.h>
+
+using namespace qcc;
+
+namespace ajn {
+namespace securitymgr {
+class UIStorageImpl;
+
+/**
+ * @brief Thread that periodically asks storage to renew the certificates
+ *        that are about to expire.
+ */
+class CertificateRenewer :
+    public Thread {
+  public:
+    CertificateRenewer(UIStorageImpl* _storage,
+                       const CertificateRenewalConfig& _config) :
+        Thread("CertificateRenewer"), storage(_storage), config(_config), stopped(false)
+    {
+    }
+
+    /**
+     * @brief Change the configuration; it is used from the next run onwards.
+     */
+    void SetConfig(const CertificateRenewalConfig& _config);
+
+    /**
+     * @brief Make the thread exit as soon as the current run is done.
+     *        The caller should still Join the thread.
+     */
+    void Terminate();
+
+  protected:
+    virtual ThreadReturn STDCALL Run(void* arg);
+
+  private:
+    UIStorageImpl* storage;
+    CertificateRenewalConfig config;
+    bool stopped;
+    Mutex lock;
+    Condition cond;
+};
+}
+}
+
+#endif /* ALLJOYN_SECMGR_STORAGE_CERTIFICATERENEWER_H_ */
@@ -20,6 +20,8 @@
 #include <qcc/GUID.h>
 #include <qcc/CertificateECC.h>
 
+#include <string.h>
+
 #include "alljoyn/securitymgr/Util.h"
 
 #define QCC_MODULE "SECMGR_STORAGE"
@@ -32,6 +34,66 @@ namespace securitymgr {
 #define LOGSQLERROR(a) { QCC_LogError((a), ((string("SQL Error: ") + (sqlite3_errmsg(nativeStorageDB))).c_str())); \
 }
 
+/*
+ * SQL function BUMP_POLICY_VERSION(POLICY): returns the serialized policy
+ * with its version incremented, or NULL if there is no policy. Lets a single
+ * UPDATE make the agent push the policies of many applications again.
+ */
+static void BumpPolicyVersion(sqlite3_context* context, int argc, sqlite3_value** argv)
+{
+    QCC_UNUSED(argc);
+
+    if (SQLITE_NULL == sqlite3_value_type(argv[0])) {
+        sqlite3_result_null(context);
+        return;
+    }
+
+    PermissionPolicy policy;
+    const uint8_t* blob = (const uint8_t*)sqlite3_value_blob(argv[0]);
+    QStatus status = Util::GetPolicy(blob, (size_t)sqlite3_value_bytes(argv[0]), policy);
+    if (ER_OK != status) {
+        sqlite3_result_error(context, "Failed to decode policy", -1);
+        return;
+    }
+    policy.SetVersion(policy.GetVersion() + 1);
+
+    uint8_t* byteArray = nullptr;
+    size_t size = 0;
+    status = Util::GetPolicyByteArray(policy, &byteArray, &size);
+    if (ER_OK != status) {
+        sqlite3_result_error(context, "Failed to encode policy", -1);
+        return;
+    }
+    sqlite3_result_blob(context, byteArray, (int)size, SQLITE_TRANSIENT);
+    delete[] byteArray;
+}
+
+/*
+ * Computes the smallest string that sorts after every string starting with
+ * prefix under COLLATE NOCASE; prefix must not hold upper case ASCII letters.
+ * Returns false if there is no such string.
+ */
+static bool NoCasePrefixUpperBound(const string& prefix, string& upper)
+{
+    upper = prefix;
+    while (!upper.empty()) {
+        unsigned char last = (unsigned char)upper[upper.size() - 1];
+        if (0xFF != last) {
+            last++;
+            // NOCASE compares an upper case letter as its lower case one,
+            // which would widen the range up to that letter. No folded
+            // string has a character between '@' and '[' though.
+            if ((last >= 'A') && (last <= 'Z')) {
+                last = 'Z' + 1;
+            }
+            upper[upper.size() - 1] = (char)last;
+            return true;
+        }
+        upper.erase(upper.size() - 1);
+    }
+    return false;
+}
+
 QStatus SQLStorage::StoreApplication(const Application& app, const bool update, const bool updatePolicy)
 {
     storageMutex.Lock(__FILE__, __LINE__);
@@ -156,7 +218,628 @@ QStatus SQLStorage::RemoveApplication(const Application& app)
         sqlRetCode = sqlite3_bind_blob(statement, 1,
                                        publicKeyInfo, keyInfoExportSize,
                                        SQLITE_TRANSIENT);
-
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    funcStatus = StepAndFinalizeSqlStmt(statement);
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::SetAppMetaData(const Application& app, const ApplicationMetaData& appMetaData)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    QStatus funcStatus = ER_FAIL;
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement;
+    string sqlStmtText;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    Application tmp = app;
+    if (ER_OK != (funcStatus = GetManagedApplication(tmp))) {
+        QCC_LogError(funcStatus, ("Trying to update meta data for a non-existing application !"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    sqlStmtText = "UPDATE ";
+    sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
+    sqlStmtText.append(" SET APP_NAME = ?, DEV_NAME = ?, USER_DEF_NAME = ? WHERE APPLICATION_PUBKEY = ?");
+
+    funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+
+    if (ER_OK != funcStatus) {
+        QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+    do {
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_bind_blob(statement, 4,
+                                       publicKeyInfo, keyInfoExportSize,
+                                       SQLITE_TRANSIENT);
+
+        sqlRetCode |= sqlite3_bind_text(statement, 1,
+                                        appMetaData.appName.c_str(), -1, SQLITE_TRANSIENT);
+        sqlRetCode |= sqlite3_bind_text(statement, 2,
+                                        appMetaData.deviceName.c_str(), -1, SQLITE_TRANSIENT);
+        sqlRetCode |= sqlite3_bind_text(statement, 3,
+                                        appMetaData.userDefinedName.c_str(), -1, SQLITE_TRANSIENT);
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    funcStatus = StepAndFinalizeSqlStmt(statement);
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetAppMetaData(const Application& app, ApplicationMetaData& appMetaData) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    string sqlStmtText = "";
+    QStatus funcStatus = ER_FAIL;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    Application tmp = app;
+    if (ER_OK != (funcStatus = GetManagedApplication(tmp))) {
+        QCC_LogError(funcStatus, ("Trying to get meta data for a non-existing application !"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    do {
+        sqlStmtText = "SELECT APP_NAME, DEV_NAME, USER_DEF_NAME FROM ";
+        sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
+        sqlStmtText.append(" WHERE APPLICATION_PUBKEY = ?");
+
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+
+        if (ER_OK != funcStatus) {
+            QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+            break;
+        }
+        sqlRetCode = sqlite3_bind_blob(statement, 1, publicKeyInfo, keyInfoExportSize, SQLITE_TRANSIENT);
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+        sqlRetCode = sqlite3_step(statement);
+        if (SQLITE_ROW == sqlRetCode) {
+            const char* appName = (const char*)sqlite3_column_text(statement, 0);
+            appMetaData.appName.assign(appName == nullptr ? "" : appName);
+            const char* deviceName = (const char*)sqlite3_column_text(statement, 1);
+            appMetaData.deviceName.assign(deviceName == nullptr ? "" : deviceName);
+            const char* userDefinedName = (const char*)sqlite3_column_text(statement, 2);
+            appMetaData.userDefinedName.assign(userDefinedName == nullptr ? "" : userDefinedName);
+        } else if (SQLITE_DONE == sqlRetCode) {
+            QCC_DbgHLPrintf(("No meta data was found !"));
+            funcStatus = ER_END_OF_DATA;
+            break;
+        } else {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::SearchAppMetaData(const string& text,
+                                      const MetaDataSearchType type,
+                                      const size_t pageSize,
+                                      uint64_t& pageToken,
+                                      vector<MetaDataSearchResult>& results) const
+{
+    if (text.empty()) {
+        return ER_BAD_ARG_1;
+    }
+    if (0 == pageSize) {
+        return ER_BAD_ARG_3;
+    }
+
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
+    vector<string> params;
+
+    string sqlStmtText = "SELECT ROWID, LENGTH(APPLICATION_PUBKEY), APPLICATION_PUBKEY, SYNC_STATE, "
+                         "APP_NAME, DEV_NAME, USER_DEF_NAME FROM " CLAIMED_APPS_TABLE_NAME " WHERE ROWID IN (";
+
+    if (METADATA_SEARCH_PREFIX == type) {
+        // Range scans on the NOCASE indexes; NOCASE only folds ASCII letters.
+        string lower = text;
+        for (size_t i = 0; i < lower.size(); i++) {
+            if ((lower[i] >= 'A') && (lower[i] <= 'Z')) {
+                lower[i] = lower[i] - 'A' + 'a';
+            }
+        }
+        string upper;
+        bool bounded = NoCasePrefixUpperBound(lower, upper);
+        params.push_back(lower);
+        if (bounded) {
+            params.push_back(upper);
+        }
+        const char* columns[] = { "APP_NAME", "DEV_NAME", "USER_DEF_NAME" };
+        for (size_t i = 0; i < sizeof(columns) / sizeof(columns[0]); i++) {
+            if (i > 0) {
+                sqlStmtText += " UNION ALL ";
+            }
+            sqlStmtText += "SELECT ROWID FROM " CLAIMED_APPS_TABLE_NAME " WHERE ";
+            sqlStmtText += columns[i];
+            sqlStmtText += " >= ?1 COLLATE NOCASE";
+            if (bounded) {
+                sqlStmtText += " AND ";
+                sqlStmtText += columns[i];
+                sqlStmtText += " < ?2 COLLATE NOCASE";
+            }
+        }
+    } else if (metaDataSearchIndexed && (text.size() >= 3)) {
+        // The trigram tokenizer needs at least 3 characters to use the index.
+        string phrase = "\"";
+        for (size_t i = 0; i < text.size(); i++) {
+            phrase += text[i];
+            if ('"' == text[i]) {
+                phrase += '"';
+            }
+        }
+        phrase += "\"";
+        params.push_back(phrase);
+        sqlStmtText += "SELECT ROWID FROM " METADATA_SEARCH_TABLE_NAME " WHERE " METADATA_SEARCH_TABLE_NAME " MATCH ?1";
+    } else {
+        string pattern = "%";
+        for (size_t i = 0; i < text.size(); i++) {
+            if (('%' == text[i]) || ('_' == text[i]) || ('\\' == text[i])) {
+                pattern += '\\';
+            }
+            pattern += text[i];
+        }
+        pattern += "%";
+        params.push_back(pattern);
+        sqlStmtText += "SELECT ROWID FROM " CLAIMED_APPS_TABLE_NAME
+                       " WHERE APP_NAME LIKE ?1 ESCAPE '\\' OR DEV_NAME LIKE ?1 ESCAPE '\\'"
+                       " OR USER_DEF_NAME LIKE ?1 ESCAPE '\\'";
+    }
+    sqlStmtText += ") AND ROWID > ?3 ORDER BY ROWID LIMIT ?4";
+
+    do {
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        for (size_t i = 0; i < params.size(); i++) {
+            sqlRetCode |= sqlite3_bind_text(statement, (int)(i + 1), params[i].c_str(), -1, SQLITE_TRANSIENT);
+        }
+        sqlRetCode |= sqlite3_bind_int64(statement, 3, (sqlite3_int64)pageToken);
+        sqlRetCode |= sqlite3_bind_int64(statement, 4, (sqlite3_int64)pageSize);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        size_t found = 0;
+        uint64_t lastRowId = 0;
+        while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
+            MetaDataSearchResult result;
+            lastRowId = (uint64_t)sqlite3_column_int64(statement, 0);
+            size_t keySize = (size_t)sqlite3_column_int(statement, 1);
+            funcStatus = result.app.keyInfo.Import((const uint8_t*)sqlite3_column_blob(statement, 2), keySize);
+            if (ER_OK != funcStatus) {
+                QCC_LogError(funcStatus, ("Failed to import public key info"));
+                break;
+            }
+            result.app.syncState = static_cast<ApplicationSyncState>(sqlite3_column_int(statement, 3));
+            const char* appName = (const char*)sqlite3_column_text(statement, 4);
+            result.metaData.appName.assign(appName == nullptr ? "" : appName);
+            const char* deviceName = (const char*)sqlite3_column_text(statement, 5);
+            result.metaData.deviceName.assign(deviceName == nullptr ? "" : deviceName);
+            const char* userDefinedName = (const char*)sqlite3_column_text(statement, 6);
+            result.metaData.userDefinedName.assign(userDefinedName == nullptr ? "" : userDefinedName);
+            results.push_back(result);
+            found++;
+        }
+
+        if ((ER_OK == funcStatus) && (SQLITE_DONE != sqlRetCode)) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+        pageToken = (found == pageSize) ? lastRowId : 0;
+    } while (0);
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+
+    storageMutex.Unlock(__FILE__, __LINE__);
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetManagedApplications(vector<Application>& apps) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    string sqlStmtText = "";
+    QStatus funcStatus = ER_OK;
+
+    sqlStmtText = "SELECT LENGTH(APPLICATION_PUBKEY), * FROM ";
+    sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
+
+    /* prepare the sql query */
+    sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(), -1,
+                                    &statement, nullptr);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    /* iterate over all the rows in the query */
+    while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
+        Application app;
+        size_t pubKeyInfoImportSize = (size_t)sqlite3_column_int(statement, 0);
+        funcStatus = app.keyInfo.Import((const uint8_t*)sqlite3_column_blob(statement, 1), pubKeyInfoImportSize);
+
+        if (ER_OK != funcStatus) {
+            QCC_LogError(funcStatus, ("Failed to import keyInfo"));
+            break;
+        }
+
+        app.syncState = static_cast<ApplicationSyncState>(sqlite3_column_int(statement, 7));
+        apps.push_back(app);
+    }
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetManifest(const Application& app,
+                                Manifest& manifest) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+    sqlite3_stmt* statement = nullptr;
+    const uint8_t* byteArray = nullptr;
+    size_t size = 0;
+    QStatus funcStatus = GetPolicyOrManifest(app, "MANIFEST", &statement, &byteArray, &size);
+
+    if (ER_OK == funcStatus) {
+        funcStatus = manifest.SetFromByteArray(byteArray, size);
+    }
+
+    if (ER_OK != funcStatus) {
+        QCC_LogError(funcStatus, ("Failed to get manifest"));
+    }
+
+    int sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetPolicy(const Application& app, PermissionPolicy& policy) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+    sqlite3_stmt* statement = nullptr;
+    const uint8_t* byteArray = nullptr;
+    size_t size = 0;
+
+    QStatus funcStatus = GetPolicyOrManifest(app, "POLICY", &statement, &byteArray, &size);
+    if (ER_OK == funcStatus) {
+        funcStatus  = Util::GetPolicy(byteArray, size, policy);         // Util reports error on de-serialization issues
+    } else {
+        QCC_DbgHLPrintf(("Failed to get policy"));
+    }
+
+    int sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::StoreSyncDigest(const Application& app,
+                                    const uint8_t* digest,
+                                    const size_t size)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_FAIL;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    if (app.keyInfo.empty()) {
+        QCC_LogError(funcStatus, ("Empty key info!"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    if ((nullptr == digest) || (0 == size)) {
+        QCC_LogError(funcStatus, ("Empty digest!"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+    if (ER_OK != funcStatus) {
+        QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    do {
+        const char* sqlStmtText =
+            "INSERT OR REPLACE INTO " SYNC_DIGESTS_TABLE_NAME " (APPLICATION_PUBKEY, DIGEST) VALUES (?, ?)";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       publicKeyInfo, keyInfoExportSize,
+                                       SQLITE_TRANSIENT);
+        sqlRetCode |= sqlite3_bind_blob(statement, 2, digest, size, SQLITE_TRANSIENT);
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    funcStatus = StepAndFinalizeSqlStmt(statement);
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetSyncDigest(const Application& app,
+                                  uint8_t* digest,
+                                  const size_t size) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_FAIL;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    if (app.keyInfo.empty()) {
+        QCC_LogError(funcStatus, ("Empty key info!"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    do {
+        const char* sqlStmtText =
+            "SELECT DIGEST, LENGTH(DIGEST) FROM " SYNC_DIGESTS_TABLE_NAME " WHERE APPLICATION_PUBKEY = ?";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+        if (ER_OK != funcStatus) {
+            QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+            break;
+        }
+        sqlRetCode = sqlite3_bind_blob(statement, 1, publicKeyInfo,
+                                       keyInfoExportSize, SQLITE_TRANSIENT);
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_step(statement);
+        if (SQLITE_ROW == sqlRetCode) {
+            if ((size_t)sqlite3_column_int(statement, 1) != size) {
+                funcStatus = ER_FAIL;
+                QCC_LogError(funcStatus, ("Unexpected sync digest size"));
+                break;
+            }
+            memcpy(digest, sqlite3_column_blob(statement, 0), size);
+        } else if (SQLITE_DONE == sqlRetCode) {
+            QCC_DbgHLPrintf(("No sync digest was found !"));
+            funcStatus = ER_END_OF_DATA;
+            break;
+        } else {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::StoreSyncRetry(const SyncRetry& retry)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_FAIL;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    if (retry.app.keyInfo.empty()) {
+        QCC_LogError(funcStatus, ("Empty key info!"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    funcStatus = ExportKeyInfo(retry.app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+    if (ER_OK != funcStatus) {
+        QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    do {
+        const char* sqlStmtText =
+            "INSERT OR REPLACE INTO " SYNC_RETRIES_TABLE_NAME
+            " (APPLICATION_PUBKEY, ATTEMPTS, NEXT_ATTEMPT) VALUES (?, ?, ?)";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       publicKeyInfo, keyInfoExportSize,
+                                       SQLITE_TRANSIENT);
+        sqlRetCode |= sqlite3_bind_int(statement, 2, retry.attempts);
+        sqlRetCode |= sqlite3_bind_int64(statement, 3, (sqlite3_int64)retry.nextAttempt);
+
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    funcStatus = StepAndFinalizeSqlStmt(statement);
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::RemoveSyncRetry(const Application& app)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_FAIL;
+    size_t keyInfoExportSize;
+    uint8_t* publicKeyInfo = nullptr;
+
+    if (app.keyInfo.empty()) {
+        QCC_LogError(funcStatus, ("Empty key info!"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+    if (ER_OK != funcStatus) {
+        QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    do {
+        const char* sqlStmtText =
+            "DELETE FROM " SYNC_RETRIES_TABLE_NAME " WHERE APPLICATION_PUBKEY = ?";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       publicKeyInfo, keyInfoExportSize,
+                                       SQLITE_TRANSIENT);
         if (SQLITE_OK != sqlRetCode) {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
@@ -172,54 +855,77 @@ QStatus SQLStorage::RemoveApplication(const Application& app)
     return funcStatus;
 }
 
-QStatus SQLStorage::SetAppMetaData(const Application& app, const ApplicationMetaData& appMetaData)
+QStatus SQLStorage::GetSyncRetries(vector<SyncRetry>& retries) const
 {
     storageMutex.Lock(__FILE__, __LINE__);
 
-    QStatus funcStatus = ER_FAIL;
     int sqlRetCode = SQLITE_OK;
-    sqlite3_stmt* statement;
-    string sqlStmtText;
-    size_t keyInfoExportSize;
-    uint8_t* publicKeyInfo = nullptr;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
 
-    Application tmp = app;
-    if (ER_OK != (funcStatus = GetManagedApplication(tmp))) {
-        QCC_LogError(funcStatus, ("Trying to update meta data for a non-existing application !"));
+    const char* sqlStmtText =
+        "SELECT LENGTH(APPLICATION_PUBKEY), APPLICATION_PUBKEY, ATTEMPTS, NEXT_ATTEMPT FROM "
+        SYNC_RETRIES_TABLE_NAME " ORDER BY NEXT_ATTEMPT";
+
+    sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                    &statement, nullptr);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
         storageMutex.Unlock(__FILE__, __LINE__);
         return funcStatus;
     }
 
-    sqlStmtText = "UPDATE ";
-    sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
-    sqlStmtText.append(" SET APP_NAME = ?, DEV_NAME = ?, USER_DEF_NAME = ? WHERE APPLICATION_PUBKEY = ?");
-
-    funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
+    while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
+        SyncRetry retry;
+        size_t pubKeyInfoImportSize = (size_t)sqlite3_column_int(statement, 0);
+        funcStatus = retry.app.keyInfo.Import((const uint8_t*)sqlite3_column_blob(statement, 1),
+                                              pubKeyInfoImportSize);
+        if (ER_OK != funcStatus) {
+            QCC_LogError(funcStatus, ("Failed to import keyInfo"));
+            break;
+        }
+        retry.attempts = (uint32_t)sqlite3_column_int(statement, 2);
+        retry.nextAttempt = (uint64_t)sqlite3_column_int64(statement, 3);
+        retries.push_back(retry);
+    }
 
-    if (ER_OK != funcStatus) {
-        QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
-        storageMutex.Unlock(__FILE__, __LINE__);
-        return funcStatus;
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
     }
+
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::StoreManifestApproval(const ManifestApproval& approval)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_FAIL;
+
     do {
-        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
-                                        -1, &statement, nullptr);
+        const char* sqlStmtText =
+            "INSERT OR REPLACE INTO " MANIFEST_APPROVALS_TABLE_NAME
+            " (DIGEST, APPROVED, CLAIM_TYPE) VALUES (?, ?, ?)";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
         if (SQLITE_OK != sqlRetCode) {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
             break;
         }
 
-        sqlRetCode = sqlite3_bind_blob(statement, 4,
-                                       publicKeyInfo, keyInfoExportSize,
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       approval.digest, Crypto_SHA256::DIGEST_SIZE,
                                        SQLITE_TRANSIENT);
-
-        sqlRetCode |= sqlite3_bind_text(statement, 1,
-                                        appMetaData.appName.c_str(), -1, SQLITE_TRANSIENT);
-        sqlRetCode |= sqlite3_bind_text(statement, 2,
-                                        appMetaData.deviceName.c_str(), -1, SQLITE_TRANSIENT);
-        sqlRetCode |= sqlite3_bind_text(statement, 3,
-                                        appMetaData.userDefinedName.c_str(), -1, SQLITE_TRANSIENT);
+        sqlRetCode |= sqlite3_bind_int(statement, 2, approval.approved ? 1 : 0);
+        sqlRetCode |= sqlite3_bind_int(statement, 3, approval.claimType);
 
         if (SQLITE_OK != sqlRetCode) {
             funcStatus = ER_FAIL;
@@ -229,73 +935,49 @@ QStatus SQLStorage::SetAppMetaData(const Application& app, const ApplicationMeta
     } while (0);
 
     funcStatus = StepAndFinalizeSqlStmt(statement);
-    delete[]publicKeyInfo;
-    publicKeyInfo = nullptr;
     storageMutex.Unlock(__FILE__, __LINE__);
 
     return funcStatus;
 }
 
-QStatus SQLStorage::GetAppMetaData(const Application& app, ApplicationMetaData& appMetaData) const
+QStatus SQLStorage::GetManifestApproval(ManifestApproval& approval) const
 {
     storageMutex.Lock(__FILE__, __LINE__);
 
     int sqlRetCode = SQLITE_OK;
     sqlite3_stmt* statement = nullptr;
-    string sqlStmtText = "";
-    QStatus funcStatus = ER_FAIL;
-    size_t keyInfoExportSize;
-    uint8_t* publicKeyInfo = nullptr;
-
-    Application tmp = app;
-    if (ER_OK != (funcStatus = GetManagedApplication(tmp))) {
-        QCC_LogError(funcStatus, ("Trying to get meta data for a non-existing application !"));
-        storageMutex.Unlock(__FILE__, __LINE__);
-        return funcStatus;
-    }
+    QStatus funcStatus = ER_OK;
 
     do {
-        sqlStmtText = "SELECT APP_NAME, DEV_NAME, USER_DEF_NAME FROM ";
-        sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
-        sqlStmtText.append(" WHERE APPLICATION_PUBKEY = ?");
-
-        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
-                                        -1, &statement, nullptr);
+        const char* sqlStmtText =
+            "SELECT APPROVED, CLAIM_TYPE FROM " MANIFEST_APPROVALS_TABLE_NAME " WHERE DIGEST = ?";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
         if (SQLITE_OK != sqlRetCode) {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
             break;
         }
 
-        funcStatus = ExportKeyInfo(app.keyInfo, &publicKeyInfo, keyInfoExportSize);
-
-        if (ER_OK != funcStatus) {
-            QCC_LogError(funcStatus, ("Failed to export public keyInfo"));
-            break;
-        }
-        sqlRetCode = sqlite3_bind_blob(statement, 1, publicKeyInfo, keyInfoExportSize, SQLITE_TRANSIENT);
-
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       approval.digest, Crypto_SHA256::DIGEST_SIZE,
+                                       SQLITE_TRANSIENT);
         if (SQLITE_OK != sqlRetCode) {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
             break;
         }
+
         sqlRetCode = sqlite3_step(statement);
         if (SQLITE_ROW == sqlRetCode) {
-            const char* appName = (const char*)sqlite3_column_text(statement, 0);
-            appMetaData.appName.assign(appName == nullptr ? "" : appName);
-            const char* deviceName = (const char*)sqlite3_column_text(statement, 1);
-            appMetaData.deviceName.assign(deviceName == nullptr ? "" : deviceName);
-            const char* userDefinedName = (const char*)sqlite3_column_text(statement, 2);
-            appMetaData.userDefinedName.assign(userDefinedName == nullptr ? "" : userDefinedName);
+            approval.approved = (sqlite3_column_int(statement, 0) != 0);
+            approval.claimType = (PermissionConfigurator::ClaimCapabilities)sqlite3_column_int(statement, 1);
         } else if (SQLITE_DONE == sqlRetCode) {
-            QCC_DbgHLPrintf(("No meta data was found !"));
+            QCC_DbgPrintf(("No approval was found for the manifest"));
             funcStatus = ER_END_OF_DATA;
-            break;
         } else {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
-            break;
         }
     } while (0);
 
@@ -304,101 +986,105 @@ QStatus SQLStorage::GetAppMetaData(const Application& app, ApplicationMetaData&
         funcStatus = ER_FAIL;
         LOGSQLERROR(funcStatus);
     }
-    delete[]publicKeyInfo;
-    publicKeyInfo = nullptr;
     storageMutex.Unlock(__FILE__, __LINE__);
 
     return funcStatus;
 }
 
-QStatus SQLStorage::GetManagedApplications(vector<Application>& apps) const
+QStatus SQLStorage::RemoveManifestApproval(const uint8_t* digest)
 {
     storageMutex.Lock(__FILE__, __LINE__);
 
     int sqlRetCode = SQLITE_OK;
     sqlite3_stmt* statement = nullptr;
-    string sqlStmtText = "";
-    QStatus funcStatus = ER_OK;
-
-    sqlStmtText = "SELECT LENGTH(APPLICATION_PUBKEY), * FROM ";
-    sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
-
-    /* prepare the sql query */
-    sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(), -1,
-                                    &statement, nullptr);
-    if (SQLITE_OK != sqlRetCode) {
-        funcStatus = ER_FAIL;
-        LOGSQLERROR(funcStatus);
-        storageMutex.Unlock(__FILE__, __LINE__);
-        return funcStatus;
-    }
-
-    /* iterate over all the rows in the query */
-    while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
-        Application app;
-        size_t pubKeyInfoImportSize = (size_t)sqlite3_column_int(statement, 0);
-        funcStatus = app.keyInfo.Import((const uint8_t*)sqlite3_column_blob(statement, 1), pubKeyInfoImportSize);
+    QStatus funcStatus = ER_FAIL;
 
-        if (ER_OK != funcStatus) {
-            QCC_LogError(funcStatus, ("Failed to import keyInfo"));
+    do {
+        const char* sqlStmtText =
+            "DELETE FROM " MANIFEST_APPROVALS_TABLE_NAME " WHERE DIGEST = ?";
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText, -1,
+                                        &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
             break;
         }
 
-        app.syncState = static_cast<ApplicationSyncState>(sqlite3_column_int(statement, 7));
-        apps.push_back(app);
-    }
-
-    sqlRetCode = sqlite3_finalize(statement);
-    if (SQLITE_OK != sqlRetCode) {
-        funcStatus = ER_FAIL;
-        LOGSQLERROR(funcStatus);
-    }
+        sqlRetCode = sqlite3_bind_blob(statement, 1,
+                                       digest, Crypto_SHA256::DIGEST_SIZE,
+                                       SQLITE_TRANSIENT);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
 
+    funcStatus = StepAndFinalizeSqlStmt(statement);
     storageMutex.Unlock(__FILE__, __LINE__);
 
     return funcStatus;
 }
 
-QStatus SQLStorage::GetManifest(const Application& app,
-                                Manifest& manifest) const
+QStatus SQLStorage::GetSyncBundle(const Application& app,
+                                  SyncBundle& bundle)
 {
     storageMutex.Lock(__FILE__, __LINE__);
-    uint8_t* byteArray = nullptr;
-    size_t size = 0;
-    QStatus funcStatus = GetPolicyOrManifest(app, "MANIFEST", &byteArray, &size);
-
-    if (ER_OK == funcStatus) {
-        funcStatus = manifest.SetFromByteArray(byteArray, size);
-    }
 
+    QStatus funcStatus = BeginTransaction();
     if (ER_OK != funcStatus) {
-        QCC_LogError(funcStatus, ("Failed to get manifest"));
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
     }
 
-    delete byteArray;
-    byteArray = nullptr;
-    storageMutex.Unlock(__FILE__, __LINE__);
+    do {
+        Application managedApp(app);
+        if (ER_OK != (funcStatus = GetManagedApplication(managedApp))) {
+            break;
+        }
+        bundle.syncState = managedApp.syncState;
 
-    return funcStatus;
-}
+        MembershipCertificate query;
+        query.SetSubjectPublicKey(app.keyInfo.GetPublicKey());
+        MembershipCertificateChain memberships;
+        if (ER_OK != (funcStatus = GetMembershipCertificates(app, query, memberships))) {
+            break;
+        }
+        for (size_t i = 0; i < memberships.size(); i++) {
+            bundle.memberships.push_back(MembershipCertificateChain(1, memberships[i]));
+        }
 
-QStatus SQLStorage::GetPolicy(const Application& app, PermissionPolicy& policy) const
-{
-    storageMutex.Lock(__FILE__, __LINE__);
-    uint8_t* byteArray = nullptr;
-    size_t size = 0;
+        // We only support one id certificate now.
+        IdentityCertificate idCert;
+        if (ER_OK != (funcStatus = GetCertificate(app, idCert))) {
+            break;
+        }
+        bundle.identityCertificates.push_back(idCert);
+
+        if (ER_OK != (funcStatus = GetManifest(app, bundle.manifest))) {
+            break;
+        }
+
+        funcStatus = GetPolicy(app, bundle.policy);
+        if ((ER_OK != funcStatus) && (ER_END_OF_DATA != funcStatus)) {
+            break;
+        }
+        bundle.hasPolicy = (ER_OK == funcStatus);
+
+        funcStatus = GetSyncDigest(app, bundle.syncDigest, sizeof(bundle.syncDigest));
+        if ((ER_OK != funcStatus) && (ER_END_OF_DATA != funcStatus)) {
+            break;
+        }
+        bundle.hasSyncDigest = (ER_OK == funcStatus);
+        funcStatus = ER_OK;
+    } while (0);
 
-    QStatus funcStatus = GetPolicyOrManifest(app, "POLICY", &byteArray, &size);
+    QStatus commitStatus = CommitTransaction();
     if (ER_OK == funcStatus) {
-        funcStatus  = Util::GetPolicy(byteArray, size, policy);         // Util reports error on de-serialization issues
-    } else {
-        QCC_DbgHLPrintf(("Failed to get policy"));
+        funcStatus = commitStatus;
     }
 
-    delete byteArray;
-    byteArray = nullptr;
     storageMutex.Unlock(__FILE__, __LINE__);
-
     return funcStatus;
 }
 
@@ -677,7 +1363,7 @@ QStatus SQLStorage::StoreCertificate(const Application& app, CertificateX509& ce
             sqlStmtText.append(IDENTITY_CERTS_TABLE_NAME);
             sqlStmtText.append(" (SUBJECT_KEYINFO, ISSUER"
                                ", DER"
-                               ", GUID) VALUES (?, ?, ?, ?)");
+                               ", GUID, VALID_TO) VALUES (?, ?, ?, ?, ?)");
         }
         break;
 
@@ -685,7 +1371,7 @@ QStatus SQLStorage::StoreCertificate(const Application& app, CertificateX509& ce
             sqlStmtText.append(MEMBERSHIP_CERTS_TABLE_NAME);
             sqlStmtText.append(" (SUBJECT_KEYINFO, ISSUER"
                                ", DER"
-                               ", GUID) VALUES (?, ?, ?, ?)");
+                               ", GUID, VALID_TO) VALUES (?, ?, ?, ?, ?)");
         }
         break;
 
@@ -843,7 +1529,87 @@ QStatus SQLStorage::GetCertificate(const Application& app, CertificateX509& cert
         } else {
             funcStatus = ER_FAIL;
             LOGSQLERROR(funcStatus);
-            break;
+            break;
+        }
+    } while (0);
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+    storageMutex.Unlock(__FILE__, __LINE__);
+
+    return funcStatus;
+}
+
+QStatus SQLStorage::GetExpiringCertificates(uint64_t expiresBefore,
+                                            size_t maxCertificates,
+                                            vector<StoredCertificate>& certificates) const
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
+
+    /* Both range scans are served by the VALID_TO indexes. */
+    string sqlStmtText =
+        "SELECT 0, SUBJECT_KEYINFO, LENGTH(SUBJECT_KEYINFO), DER, LENGTH(DER), VALID_TO FROM "
+        IDENTITY_CERTS_TABLE_NAME " WHERE VALID_TO < ?1 "
+        "UNION ALL "
+        "SELECT 1, SUBJECT_KEYINFO, LENGTH(SUBJECT_KEYINFO), DER, LENGTH(DER), VALID_TO FROM "
+        MEMBERSHIP_CERTS_TABLE_NAME " WHERE VALID_TO < ?1 "
+        "ORDER BY VALID_TO LIMIT ?2";
+
+    do {
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        sqlRetCode = sqlite3_bind_int64(statement, 1, (sqlite3_int64)expiresBefore);
+        sqlRetCode |= sqlite3_bind_int64(statement, 2, (sqlite3_int64)maxCertificates);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
+            StoredCertificate stored;
+            if (0 == sqlite3_column_int(statement, 0)) {
+                stored.certificate = make_shared<IdentityCertificate>();
+            } else {
+                stored.certificate = make_shared<MembershipCertificate>();
+            }
+
+            size_t keySize = (size_t)sqlite3_column_int(statement, 2);
+            funcStatus = stored.app.keyInfo.Import((const uint8_t*)sqlite3_column_blob(statement, 1), keySize);
+            if (ER_OK != funcStatus) {
+                QCC_LogError(funcStatus, ("Failed to import public key info"));
+                break;
+            }
+
+            size_t derSize = (size_t)sqlite3_column_int(statement, 4);
+            qcc::String der((const char*)sqlite3_column_blob(statement, 3), derSize);
+            funcStatus = stored.certificate->DecodeCertificateDER(der);
+            if (ER_OK != funcStatus) {
+                QCC_LogError(funcStatus, ("Failed to load certificate!"));
+                break;
+            }
+
+            certificates.push_back(stored);
+        }
+
+        if ((ER_OK == funcStatus) && (SQLITE_DONE != sqlRetCode)) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
         }
     } while (0);
 
@@ -852,10 +1618,36 @@ QStatus SQLStorage::GetCertificate(const Application& app, CertificateX509& cert
         funcStatus = ER_FAIL;
         LOGSQLERROR(funcStatus);
     }
-    delete[]publicKeyInfo;
-    publicKeyInfo = nullptr;
+
     storageMutex.Unlock(__FILE__, __LINE__);
+    return funcStatus;
+}
+
+QStatus SQLStorage::StoreCertificates(vector<StoredCertificate>& certificates)
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    // A batch is stored completely or not at all.
+    QStatus funcStatus = BeginRollbackableTransaction();
+    if (ER_OK != funcStatus) {
+        storageMutex.Unlock(__FILE__, __LINE__);
+        return funcStatus;
+    }
+
+    vector<StoredCertificate>::iterator it;
+    for (it = certificates.begin(); it != certificates.end(); ++it) {
+        if (ER_OK != (funcStatus = StoreCertificate(it->app, *(it->certificate), true))) {
+            QCC_LogError(funcStatus, ("Failed to store renewed certificate"));
+            break;
+        }
+    }
+
+    QStatus endStatus = EndRollbackableTransaction(ER_OK == funcStatus);
+    if (ER_OK == funcStatus) {
+        funcStatus = endStatus;
+    }
 
+    storageMutex.Unlock(__FILE__, __LINE__);
     return funcStatus;
 }
 
@@ -1253,6 +2045,9 @@ QStatus SQLStorage::BindCertForStorage(const Application& app, CertificateX509&
                 return ER_FAIL;
             }
         }
+
+        sqlRetCode |= sqlite3_bind_int64(*statement, ++column,
+                                         (sqlite3_int64)cert.GetValidity()->validTo);
     } while (0);
 
     if (SQLITE_OK != sqlRetCode) {
@@ -1357,12 +2152,23 @@ QStatus SQLStorage::Init()
             break;
         }
 
+        sqlRetCode = sqlite3_create_function(nativeStorageDB, "BUMP_POLICY_VERSION", 1, SQLITE_UTF8,
+                                             nullptr, BumpPolicyVersion, nullptr, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
         sqlStmtText = CLAIMED_APPLICATIONS_TABLE_SCHEMA;
         sqlStmtText.append(IDENTITY_CERTS_TABLE_SCHEMA);
         sqlStmtText.append(MEMBERSHIP_CERTS_TABLE_SCHEMA);
         sqlStmtText.append(GROUPS_TABLE_SCHEMA);
         sqlStmtText.append(IDENTITY_TABLE_SCHEMA);
         sqlStmtText.append(SERIALNUMBER_TABLE_SCHEMA);
+        sqlStmtText.append(SYNC_DIGESTS_TABLE_SCHEMA);
+        sqlStmtText.append(SYNC_RETRIES_TABLE_SCHEMA);
+        sqlStmtText.append(MANIFEST_APPROVALS_TABLE_SCHEMA);
         sqlStmtText.append(DEFAULT_PRAGMAS);
 
         sqlRetCode = sqlite3_exec(nativeStorageDB, sqlStmtText.c_str(), nullptr, 0,
@@ -1373,6 +2179,15 @@ QStatus SQLStorage::Init()
             LOGSQLERROR(funcStatus);
             break;
         }
+
+        if (ER_OK != (funcStatus = UpgradeSchema())) {
+            QCC_LogError(funcStatus, ("Failed to upgrade storage schema"));
+            break;
+        }
+        if (ER_OK != (funcStatus = InitMetaDataSearch())) {
+            QCC_LogError(funcStatus, ("Failed to create meta data search indexes"));
+            break;
+        }
         funcStatus = InitSerialNumber();
     } while (0);
 
@@ -1563,12 +2378,24 @@ QStatus SQLStorage::RemoveInfo(InfoType type,
         return funcStatus;
     }
 
+    // The sync states and the removal must be stored together or not at all.
+    if (ER_OK != (funcStatus = BeginRollbackableTransaction())) {
+        delete[] authority;
+        return funcStatus;
+    }
+
     if (ER_OK != GetApplicationsPerGuid(type, guid, appsToSync)) {
         QCC_DbgHLPrintf(("No affected managed application(s) was/were found..."));
+    } else if (ER_OK != (funcStatus = UpdateSyncStatesPerGuid(type, guid, appsToSync))) {
+        QCC_LogError(funcStatus, ("Failed to update the sync state of affected applications"));
+        EndRollbackableTransaction(false);
+        appsToSync.clear();
+        delete[] authority;
+        return funcStatus;
     }
 
     int sqlRetCode = SQLITE_OK;
-    sqlite3_stmt* statement;
+    sqlite3_stmt* statement = nullptr;
 
     string sqlStmtText = "DELETE FROM ";
     sqlStmtText.append(type == INFO_GROUP ? GROUPS_TABLE_NAME : IDENTITY_TABLE_NAME);
@@ -1598,12 +2425,86 @@ QStatus SQLStorage::RemoveInfo(InfoType type,
     funcStatus = StepAndFinalizeSqlStmt(statement);
     delete[] authority;
     authority = nullptr;
+
+    QStatus endStatus = EndRollbackableTransaction(ER_OK == funcStatus);
+    if (ER_OK == funcStatus) {
+        funcStatus = endStatus;
+    }
+    if (ER_OK != funcStatus) {
+        appsToSync.clear();
+    }
+    return funcStatus;
+}
+
+QStatus SQLStorage::UpdateSyncStatesPerGuid(const InfoType type,
+                                            const GUID128& guid,
+                                            vector<Application>& apps)
+{
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
+    string sqlStmtText = "UPDATE ";
+    sqlStmtText.append(CLAIMED_APPS_TABLE_NAME);
+
+    // Apps that lose a membership are to be updated; apps that lose their identity are to be reset.
+    if (INFO_GROUP == type) {
+        // A new policy version makes the agent push the policy again.
+        sqlStmtText.append(" SET SYNC_STATE = ?, POLICY = BUMP_POLICY_VERSION(POLICY) "
+                           "WHERE SYNC_STATE = ? AND APPLICATION_PUBKEY IN "
+                           "(SELECT SUBJECT_KEYINFO FROM " MEMBERSHIP_CERTS_TABLE_NAME " WHERE GUID = ?)");
+    } else {
+        sqlStmtText.append(" SET SYNC_STATE = ? WHERE APPLICATION_PUBKEY IN "
+                           "(SELECT SUBJECT_KEYINFO FROM " IDENTITY_CERTS_TABLE_NAME " WHERE GUID = ?)");
+    }
+
+    do {
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            return funcStatus;
+        }
+
+        int column = 1;
+        if (INFO_GROUP == type) {
+            sqlRetCode = sqlite3_bind_int(statement, column++, static_cast<int>(SYNC_PENDING));
+            sqlRetCode |= sqlite3_bind_int(statement, column++, static_cast<int>(SYNC_OK));
+        } else {
+            sqlRetCode = sqlite3_bind_int(statement, column++, static_cast<int>(SYNC_WILL_RESET));
+        }
+        sqlRetCode |= sqlite3_bind_text(statement, column, guid.ToString().c_str(),
+                                        -1, SQLITE_TRANSIENT);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+    } while (0);
+
+    if (ER_OK != funcStatus) {
+        sqlite3_finalize(statement);
+        return funcStatus;
+    }
+    if (ER_OK != (funcStatus = StepAndFinalizeSqlStmt(statement))) {
+        return funcStatus;
+    }
+
+    vector<Application>::iterator it;
+    for (it = apps.begin(); it != apps.end(); ++it) {
+        if (INFO_IDENTITY == type) {
+            it->syncState = SYNC_WILL_RESET;
+        } else if (SYNC_OK == it->syncState) {
+            it->syncState = SYNC_PENDING;
+        }
+    }
     return funcStatus;
 }
 
 QStatus SQLStorage::GetPolicyOrManifest(const Application& app,
                                         const char* type,
-                                        uint8_t** byteArray,
+                                        sqlite3_stmt** statementOut,
+                                        const uint8_t** byteArray,
                                         size_t* size) const
 {
     int sqlRetCode = SQLITE_OK;
@@ -1613,6 +2514,7 @@ QStatus SQLStorage::GetPolicyOrManifest(const Application& app,
     size_t keyInfoExportSize;
     uint8_t* publicKeyInfo = nullptr;
 
+    *statementOut = nullptr;
     *size = 0;
     *byteArray = nullptr;
 
@@ -1661,8 +2563,7 @@ QStatus SQLStorage::GetPolicyOrManifest(const Application& app,
         if (SQLITE_ROW == sqlRetCode) {
             *size = sqlite3_column_int(statement, 1);
             if (*size > 0) {
-                *byteArray = new uint8_t[*size];
-                memcpy(*byteArray, (const uint8_t*)sqlite3_column_blob(statement, 0), *size);
+                *byteArray = (const uint8_t*)sqlite3_column_blob(statement, 0);
             } else {
                 funcStatus = ER_END_OF_DATA;
                 QCC_DbgHLPrintf(("Application has no %s !", type));
@@ -1679,13 +2580,22 @@ QStatus SQLStorage::GetPolicyOrManifest(const Application& app,
         }
     } while (0);
 
+    delete[]publicKeyInfo;
+    publicKeyInfo = nullptr;
+
+    if (ER_OK == funcStatus) {
+        // The column memory stays valid until the caller finalizes the statement.
+        *statementOut = statement;
+        return funcStatus;
+    }
+
+    *size = 0;
+    *byteArray = nullptr;
     sqlRetCode = sqlite3_finalize(statement);
     if (SQLITE_OK != sqlRetCode) {
         funcStatus = ER_FAIL;
         LOGSQLERROR(funcStatus);
     }
-    delete[]publicKeyInfo;
-    publicKeyInfo = nullptr;
     return funcStatus;
 }
 
@@ -1801,6 +2711,259 @@ QStatus SQLStorage::InitSerialNumber()
     return funcStatus;
 }
 
+QStatus SQLStorage::UpgradeSchema()
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    QStatus funcStatus = ER_OK;
+    const char* tables[] = { IDENTITY_CERTS_TABLE_NAME, MEMBERSHIP_CERTS_TABLE_NAME };
+    CertificateX509::CertificateType types[] = { CertificateX509::IDENTITY_CERTIFICATE,
+                                                 CertificateX509::MEMBERSHIP_CERTIFICATE };
+
+    for (size_t i = 0; (ER_OK == funcStatus) && (i < (sizeof(tables) / sizeof(tables[0]))); i++) {
+        bool found = false;
+        if (ER_OK != (funcStatus = HasColumn(tables[i], "VALID_TO", found)) || found) {
+            continue;
+        }
+
+        QCC_DbgHLPrintf(("Adding VALID_TO column to %s", tables[i]));
+        string sqlStmtText = "ALTER TABLE ";
+        sqlStmtText.append(tables[i]);
+        sqlStmtText.append(" ADD COLUMN VALID_TO INTEGER");
+        if (SQLITE_OK != sqlite3_exec(nativeStorageDB, sqlStmtText.c_str(), nullptr, 0, nullptr)) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+        funcStatus = BackfillValidTo(tables[i], types[i]);
+    }
+
+    if (ER_OK == funcStatus) {
+        if (SQLITE_OK != sqlite3_exec(nativeStorageDB, CERTS_VALID_TO_INDEXES, nullptr, 0, nullptr)) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+        }
+    }
+
+    storageMutex.Unlock(__FILE__, __LINE__);
+    return funcStatus;
+}
+
+QStatus SQLStorage::InitMetaDataSearch()
+{
+    storageMutex.Lock(__FILE__, __LINE__);
+
+    QStatus funcStatus = ER_OK;
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    bool exists = false;
+
+    do {
+        if (SQLITE_OK != sqlite3_exec(nativeStorageDB, METADATA_PREFIX_INDEXES, nullptr, 0, nullptr)) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+
+        // The index is only complete if its triggers were never dropped.
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB,
+                                        "SELECT COUNT(*) FROM sqlite_master WHERE NAME IN " METADATA_SEARCH_OBJECTS,
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+        exists = (SQLITE_ROW == sqlite3_step(statement)) &&
+                 (METADATA_SEARCH_OBJECT_COUNT == sqlite3_column_int(statement, 0));
+        sqlite3_finalize(statement);
+
+        if (ER_OK != (funcStatus = BeginTransaction())) {
+            break;
+        }
+        if (SQLITE_OK != sqlite3_exec(nativeStorageDB, METADATA_SEARCH_PROBE, nullptr, 0, nullptr)) {
+            // Not fatal: substring searches fall back to a table scan. The
+            // triggers of an index created by an earlier SQLite with FTS5
+            // would make every change of the applications fail now.
+            QCC_DbgHLPrintf(("Full text search is not available: %s", sqlite3_errmsg(nativeStorageDB)));
+            if (SQLITE_OK != sqlite3_exec(nativeStorageDB, METADATA_SEARCH_DROP_TRIGGERS, nullptr, 0, nullptr)) {
+                funcStatus = ER_FAIL;
+                LOGSQLERROR(funcStatus);
+            }
+        } else if (SQLITE_OK != sqlite3_exec(nativeStorageDB, METADATA_SEARCH_TABLE_SCHEMA, nullptr, 0, nullptr)) {
+            LOGSQLERROR(ER_FAIL);
+        } else if (exists ||
+                   (SQLITE_OK == sqlite3_exec(nativeStorageDB, METADATA_SEARCH_REBUILD, nullptr, 0, nullptr))) {
+            metaDataSearchIndexed = true;
+        } else {
+            LOGSQLERROR(ER_FAIL);
+        }
+        QStatus commitStatus = CommitTransaction();
+        if (ER_OK == funcStatus) {
+            funcStatus = commitStatus;
+        }
+    } while (0);
+
+    storageMutex.Unlock(__FILE__, __LINE__);
+    return funcStatus;
+}
+
+QStatus SQLStorage::HasColumn(const char* table,
+                              const char* column,
+                              bool& found) const
+{
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
+    string sqlStmtText = "PRAGMA table_info(";
+    sqlStmtText.append(table);
+    sqlStmtText.append(")");
+
+    found = false;
+    sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                    -1, &statement, nullptr);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+        return funcStatus;
+    }
+
+    while (!found && (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement)))) {
+        const char* name = (const char*)sqlite3_column_text(statement, 1);
+        found = (nullptr != name) && (strcmp(name, column) == 0);
+    }
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+    }
+    return funcStatus;
+}
+
+QStatus SQLStorage::BackfillValidTo(const char* table,
+                                    CertificateX509::CertificateType type)
+{
+    int sqlRetCode = SQLITE_OK;
+    sqlite3_stmt* statement = nullptr;
+    QStatus funcStatus = ER_OK;
+    vector<pair<sqlite3_int64, uint64_t> > validities;
+
+    string sqlStmtText = "SELECT ROWID, DER, LENGTH(DER) FROM ";
+    sqlStmtText.append(table);
+
+    sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                    -1, &statement, nullptr);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+        return funcStatus;
+    }
+
+    while (SQLITE_ROW == (sqlRetCode = sqlite3_step(statement))) {
+        CertificateX509 cert(type);
+        size_t derSize = (size_t)sqlite3_column_int(statement, 2);
+        qcc::String der((const char*)sqlite3_column_blob(statement, 1), derSize);
+        if (ER_OK != cert.DecodeCertificateDER(der)) {
+            QCC_LogError(ER_FAIL, ("Skipping undecodable certificate in %s", table));
+            continue;
+        }
+        validities.push_back(make_pair(sqlite3_column_int64(statement, 0), cert.GetValidity()->validTo));
+    }
+
+    sqlRetCode = sqlite3_finalize(statement);
+    if (SQLITE_OK != sqlRetCode) {
+        funcStatus = ER_FAIL;
+        LOGSQLERROR(funcStatus);
+        return funcStatus;
+    }
+
+    if (validities.empty()) {
+        return funcStatus;
+    }
+
+    if (ER_OK != (funcStatus = BeginTransaction())) {
+        return funcStatus;
+    }
+
+    sqlStmtText = "UPDATE ";
+    sqlStmtText.append(table);
+    sqlStmtText.append(" SET VALID_TO = ? WHERE ROWID = ?");
+
+    vector<pair<sqlite3_int64, uint64_t> >::const_iterator it;
+    for (it = validities.begin(); (ER_OK == funcStatus) && (it != validities.end()); ++it) {
+        statement = nullptr;
+        sqlRetCode = sqlite3_prepare_v2(nativeStorageDB, sqlStmtText.c_str(),
+                                        -1, &statement, nullptr);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            break;
+        }
+        sqlRetCode = sqlite3_bind_int64(statement, 1, (sqlite3_int64)it->second);
+        sqlRetCode |= sqlite3_bind_int64(statement, 2, it->first);
+        if (SQLITE_OK != sqlRetCode) {
+            funcStatus = ER_FAIL;
+            LOGSQLERROR(funcStatus);
+            sqlite3_finalize(statement);
+            break;
+        }
+        funcStatus = StepAndFinalizeSqlStmt(statement);
+    }
+
+    QStatus commitStatus = CommitTransaction();
+    return (ER_OK == funcStatus) ? commitStatus : funcStatus;
+}
+
+QStatus SQLStorage::BeginTransaction() const
+{
+    if (SQLITE_OK != sqlite3_exec(nativeStorageDB, "BEGIN TRANSACTION;", nullptr, 0, nullptr)) {
+        LOGSQLERROR(ER_FAIL);
+        return ER_FAIL;
+    }
+    return ER_OK;
+}
+
+QStatus SQLStorage::CommitTransaction() const
+{
+    if (SQLITE_OK != sqlite3_exec(nativeStorageDB, "COMMIT TRANSACTION;", nullptr, 0, nullptr)) {
+        LOGSQLERROR(ER_FAIL);
+        return ER_FAIL;
+    }
+    return ER_OK;
+}
+
+QStatus SQLStorage::BeginRollbackableTransaction() const
+{
+    if (SQLITE_OK != sqlite3_exec(nativeStorageDB, "PRAGMA journal_mode = MEMORY;", nullptr, 0, nullptr)) {
+        LOGSQLERROR(ER_FAIL);
+        return ER_FAIL;
+    }
+    QStatus funcStatus = BeginTransaction();
+    if (ER_OK != funcStatus) {
+        sqlite3_exec(nativeStorageDB, "PRAGMA journal_mode = OFF;", nullptr, 0, nullptr);
+    }
+    return funcStatus;
+}
+
+QStatus SQLStorage::EndRollbackableTransaction(bool commit) const
+{
+    QStatus funcStatus = ER_OK;
+    if (commit) {
+        funcStatus = CommitTransaction();
+    }
+    if (!commit || (ER_OK != funcStatus)) {
+        if (SQLITE_OK != sqlite3_exec(nativeStorageDB, "ROLLBACK TRANSACTION;", nullptr, 0, nullptr)) {
+            LOGSQLERROR(ER_FAIL);
+            funcStatus = ER_FAIL;
+        }
+    }
+    if (SQLITE_OK != sqlite3_exec(nativeStorageDB, "PRAGMA journal_mode = OFF;", nullptr, 0, nullptr)) {
+        LOGSQLERROR(ER_FAIL);
+    }
+    return funcStatus;
+}
+
 QStatus SQLStorage::PrepareMembershipCertificateQuery(const Application& app,
                                                       const MembershipCertificate& certificate,
                                                       sqlite3_stmt** statement) const
@@ -24,6 +24,7 @@
 #endif
 
 #include <iostream>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -33,11 +34,13 @@
 
 #include <alljoyn/Status.h>
 
+#include <alljoyn/securitymgr/AgentCAStorage.h>
 #include <alljoyn/securitymgr/Application.h>
 #include <alljoyn/securitymgr/GroupInfo.h>
 #include <alljoyn/securitymgr/IdentityInfo.h>
 #include <alljoyn/securitymgr/Manifest.h>
 #include <alljoyn/securitymgr/storage/ApplicationMetaData.h>
+#include <alljoyn/securitymgr/storage/MetaDataSearch.h>
 #include "SQLStorageConfig.h"
 
 /**
@@ -61,6 +64,14 @@ enum InfoType {
     INFO_IDENTITY
 };
 
+/**
+ * A certificate as persisted for a managed application.
+ * */
+struct StoredCertificate {
+    Application app;
+    shared_ptr<CertificateX509> certificate;
+};
+
 class SQLStorage {
   private:
 
@@ -68,9 +79,12 @@ class SQLStorage {
     sqlite3* nativeStorageDB;
     SQLStorageConfig storageConfig;
     mutable Mutex storageMutex;
+    bool metaDataSearchIndexed; // True if substring searches can use the full text index.
 
     QStatus Init();
 
+    QStatus InitMetaDataSearch();
+
     static QStatus ExportKeyInfo(const KeyInfoNISTP256& keyInfo,
                                  uint8_t** byteArray,
                                  size_t& byteArraySize);
@@ -102,15 +116,42 @@ class SQLStorage {
 
     QStatus InitSerialNumber();
 
+    QStatus UpgradeSchema();
+
+    QStatus HasColumn(const char* table,
+                      const char* column,
+                      bool& found) const;
+
+    QStatus BackfillValidTo(const char* table,
+                            CertificateX509::CertificateType type);
+
+    QStatus BeginTransaction() const;
+
+    QStatus CommitTransaction() const;
+
+    /*
+     * The journal is turned off, so a plain transaction cannot be rolled
+     * back. A rollbackable transaction keeps a journal in memory while it
+     * runs; it is committed or rolled back by EndRollbackableTransaction.
+     */
+    QStatus BeginRollbackableTransaction() const;
+
+    QStatus EndRollbackableTransaction(bool commit) const;
+
     string GetStoragePath() const;
 
     QStatus PrepareMembershipCertificateQuery(const Application& app,
                                               const MembershipCertificate& certificate,
                                               sqlite3_stmt** statement) const;
 
+    /*
+     * On success, byteArray points into the column memory of the returned
+     * statement and is only valid until the caller finalizes it.
+     */
     QStatus GetPolicyOrManifest(const Application& app,
                                 const char* type,
-                                uint8_t** byteArray,
+                                sqlite3_stmt** statement,
+                                const uint8_t** byteArray,
                                 size_t* size) const;
 
     QStatus StorePolicyOrManifest(const Application& app,
@@ -122,10 +163,14 @@ class SQLStorage {
                                    const GUID128& guid,
                                    vector<Application>& apps);
 
+    QStatus UpdateSyncStatesPerGuid(const InfoType type,
+                                    const GUID128& guid,
+                                    vector<Application>& apps);
+
   public:
 
     SQLStorage(const SQLStorageConfig& _storageConfig) :
-        status(ER_OK), storageConfig(_storageConfig)
+        status(ER_OK), storageConfig(_storageConfig), metaDataSearchIndexed(false)
     {
         status = Init();
     }
@@ -145,6 +190,12 @@ class SQLStorage {
     QStatus GetAppMetaData(const Application& app,
                            ApplicationMetaData& appMetaData) const;
 
+    QStatus SearchAppMetaData(const string& text,
+                              const MetaDataSearchType type,
+                              const size_t pageSize,
+                              uint64_t& pageToken,
+                              vector<MetaDataSearchResult>& results) const;
+
     QStatus RemoveApplication(const Application& app);
 
     QStatus GetManagedApplications(vector<Application>& apps) const;
@@ -165,6 +216,33 @@ class SQLStorage {
 
     QStatus RemovePolicy(const Application& app);
 
+    QStatus StoreSyncDigest(const Application& app,
+                            const uint8_t* digest,
+                            const size_t size);
+
+    QStatus GetSyncDigest(const Application& app,
+                          uint8_t* digest,
+                          const size_t size) const;
+
+    QStatus StoreSyncRetry(const SyncRetry& retry);
+
+    QStatus RemoveSyncRetry(const Application& app);
+
+    QStatus GetSyncRetries(vector<SyncRetry>& retries) const;
+
+    QStatus StoreManifestApproval(const ManifestApproval& approval);
+
+    QStatus GetManifestApproval(ManifestApproval& approval) const;
+
+    QStatus RemoveManifestApproval(const uint8_t* digest);
+
+    /**
+     * @brief Read the complete desired state of an application within a
+     *        single transaction.
+     */
+    QStatus GetSyncBundle(const Application& app,
+                          SyncBundle& bundle);
+
     QStatus StoreCertificate(const Application& app,
                              CertificateX509& certificate,
                              bool update = false);
@@ -179,6 +257,24 @@ class SQLStorage {
                                       const MembershipCertificate& certificate,
                                       MembershipCertificateChain& certificates) const;
 
+    /**
+     * @brief Retrieve the identity and membership certificates that expire
+     *        before a given time, ordered by expiry.
+     *
+     * @param[in] expiresBefore     Epoch time in seconds.
+     * @param[in] maxCertificates   The maximum number of certificates to return.
+     * @param[in,out] certificates  The certificates that will expire.
+     */
+    QStatus GetExpiringCertificates(uint64_t expiresBefore,
+                                    size_t maxCertificates,
+                                    vector<StoredCertificate>& certificates) const;
+
+    /**
+     * @brief Replace a set of previously stored certificates in a single
+     *        transaction. Nothing is stored if one of them fails.
+     */
+    QStatus StoreCertificates(vector<StoredCertificate>& certificates);
+
     QStatus StoreGroup(const GroupInfo& groupInfo);
 
     QStatus RemoveGroup(const GroupInfo& groupInfo,
@@ -23,6 +23,10 @@
 #define IDENTITY_CERTS_TABLE_NAME "IDENTITY_CERTS"
 #define MEMBERSHIP_CERTS_TABLE_NAME "MEMBERSHIP_CERTS"
 #define SERIALNUMBER_TABLE_NAME "SERIALNUMBER"
+#define SYNC_DIGESTS_TABLE_NAME "SYNC_DIGESTS"
+#define METADATA_SEARCH_TABLE_NAME "APP_METADATA_SEARCH"
+#define SYNC_RETRIES_TABLE_NAME "SYNC_RETRIES"
+#define MANIFEST_APPROVALS_TABLE_NAME "MANIFEST_APPROVALS"
 
 #define GROUPS_TABLE_SCHEMA \
     "CREATE TABLE IF NOT EXISTS " GROUPS_TABLE_NAME \
@@ -62,6 +66,7 @@
         ISSUER BLOB NOT NULL,\
         DER BLOB NOT NULL,\
         GUID TEXT NOT NULL,\
+        VALID_TO INTEGER,\
         PRIMARY KEY(SUBJECT_KEYINFO),\
         FOREIGN KEY(SUBJECT_KEYINFO) REFERENCES " CLAIMED_APPS_TABLE_NAME \
     " (APPLICATION_PUBKEY) ON DELETE CASCADE,\
@@ -74,6 +79,7 @@
         ISSUER BLOB NOT NULL,\
         DER BLOB NOT NULL,\
         GUID TEXT NOT NULL,\
+        VALID_TO INTEGER,\
         PRIMARY KEY(SUBJECT_KEYINFO, GUID),\
         FOREIGN KEY(SUBJECT_KEYINFO) REFERENCES " CLAIMED_APPS_TABLE_NAME \
     " (APPLICATION_PUBKEY) ON DELETE CASCADE\
@@ -85,6 +91,93 @@
         VALUE INT\
 ); "
 
+#define SYNC_DIGESTS_TABLE_SCHEMA \
+    "CREATE TABLE IF NOT EXISTS " SYNC_DIGESTS_TABLE_NAME \
+    " (\
+        APPLICATION_PUBKEY BLOB NOT NULL,\
+        DIGEST BLOB NOT NULL,\
+        PRIMARY KEY(APPLICATION_PUBKEY),\
+        FOREIGN KEY(APPLICATION_PUBKEY) REFERENCES " CLAIMED_APPS_TABLE_NAME \
+    " (APPLICATION_PUBKEY) ON DELETE CASCADE ); "
+
+#define SYNC_RETRIES_TABLE_SCHEMA \
+    "CREATE TABLE IF NOT EXISTS " SYNC_RETRIES_TABLE_NAME \
+    " (\
+        APPLICATION_PUBKEY BLOB NOT NULL,\
+        ATTEMPTS INTEGER NOT NULL,\
+        NEXT_ATTEMPT INTEGER NOT NULL,\
+        PRIMARY KEY(APPLICATION_PUBKEY),\
+        FOREIGN KEY(APPLICATION_PUBKEY) REFERENCES " CLAIMED_APPS_TABLE_NAME \
+    " (APPLICATION_PUBKEY) ON DELETE CASCADE ); "
+
+#define MANIFEST_APPROVALS_TABLE_SCHEMA \
+    "CREATE TABLE IF NOT EXISTS " MANIFEST_APPROVALS_TABLE_NAME \
+    " (\
+        DIGEST BLOB NOT NULL,\
+        APPROVED INTEGER NOT NULL,\
+        CLAIM_TYPE INTEGER NOT NULL,\
+        PRIMARY KEY(DIGEST)\
+); "
+
+/* Created after upgrading older databases, as these lack the VALID_TO column. */
+#define CERTS_VALID_TO_INDEXES \
+    "CREATE INDEX IF NOT EXISTS IDENTITY_CERTS_VALID_TO ON " IDENTITY_CERTS_TABLE_NAME " (VALID_TO);\
+    CREATE INDEX IF NOT EXISTS MEMBERSHIP_CERTS_VALID_TO ON " MEMBERSHIP_CERTS_TABLE_NAME " (VALID_TO); "
+
+/* Case insensitive indexes to serve prefix searches on application metadata. */
+#define METADATA_PREFIX_INDEXES \
+    "CREATE INDEX IF NOT EXISTS CLAIMED_APPLICATIONS_APP_NAME ON " CLAIMED_APPS_TABLE_NAME " (APP_NAME COLLATE NOCASE);\
+    CREATE INDEX IF NOT EXISTS CLAIMED_APPLICATIONS_DEV_NAME ON " CLAIMED_APPS_TABLE_NAME " (DEV_NAME COLLATE NOCASE);\
+    CREATE INDEX IF NOT EXISTS CLAIMED_APPLICATIONS_USER_DEF_NAME ON " CLAIMED_APPS_TABLE_NAME " (USER_DEF_NAME COLLATE NOCASE); "
+
+/*
+ * Trigram full text index to serve substring searches on application metadata.
+ * It is optional, as it requires SQLite to be built with FTS5 (3.34.0 or later).
+ */
+#define METADATA_SEARCH_TABLE_SCHEMA \
+    "CREATE VIRTUAL TABLE IF NOT EXISTS " METADATA_SEARCH_TABLE_NAME " USING fts5(\
+        APP_NAME, DEV_NAME, USER_DEF_NAME,\
+        content = '" CLAIMED_APPS_TABLE_NAME "', content_rowid = 'ROWID', tokenize = 'trigram');\
+    CREATE TRIGGER IF NOT EXISTS APP_METADATA_SEARCH_INSERT AFTER INSERT ON " CLAIMED_APPS_TABLE_NAME " BEGIN\
+        INSERT INTO " METADATA_SEARCH_TABLE_NAME " (ROWID, APP_NAME, DEV_NAME, USER_DEF_NAME)\
+        VALUES (new.ROWID, new.APP_NAME, new.DEV_NAME, new.USER_DEF_NAME);\
+    END;\
+    CREATE TRIGGER IF NOT EXISTS APP_METADATA_SEARCH_DELETE AFTER DELETE ON " CLAIMED_APPS_TABLE_NAME " BEGIN\
+        INSERT INTO " METADATA_SEARCH_TABLE_NAME " (" METADATA_SEARCH_TABLE_NAME ", ROWID, APP_NAME, DEV_NAME, USER_DEF_NAME)\
+        VALUES ('delete', old.ROWID, old.APP_NAME, old.DEV_NAME, old.USER_DEF_NAME);\
+    END;\
+    CREATE TRIGGER IF NOT EXISTS APP_METADATA_SEARCH_UPDATE AFTER UPDATE OF APP_NAME, DEV_NAME, USER_DEF_NAME ON " \
+    CLAIMED_APPS_TABLE_NAME " BEGIN\
+        INSERT INTO " METADATA_SEARCH_TABLE_NAME " (" METADATA_SEARCH_TABLE_NAME ", ROWID, APP_NAME, DEV_NAME, USER_DEF_NAME)\
+        VALUES ('delete', old.ROWID, old.APP_NAME, old.DEV_NAME, old.USER_DEF_NAME);\
+        INSERT INTO " METADATA_SEARCH_TABLE_NAME " (ROWID, APP_NAME, DEV_NAME, USER_DEF_NAME)\
+        VALUES (new.ROWID, new.APP_NAME, new.DEV_NAME, new.USER_DEF_NAME);\
+    END; "
+
+/* Fails if SQLite lacks FTS5 or its trigram tokenizer. */
+#define METADATA_SEARCH_PROBE \
+    "CREATE VIRTUAL TABLE temp.METADATA_SEARCH_PROBE USING fts5(PROBE, tokenize = 'trigram');\
+    DROP TABLE temp.METADATA_SEARCH_PROBE; "
+
+/* The objects of METADATA_SEARCH_TABLE_SCHEMA. */
+#define METADATA_SEARCH_OBJECTS \
+    "('" METADATA_SEARCH_TABLE_NAME "', 'APP_METADATA_SEARCH_INSERT', 'APP_METADATA_SEARCH_DELETE',\
+    'APP_METADATA_SEARCH_UPDATE')"
+#define METADATA_SEARCH_OBJECT_COUNT 4
+
+/*
+ * Keeps the applications writable when the metadata search table exists but
+ * FTS5 is not available. The table is left; it is rebuilt once FTS5 is back.
+ */
+#define METADATA_SEARCH_DROP_TRIGGERS \
+    "DROP TRIGGER IF EXISTS APP_METADATA_SEARCH_INSERT;\
+    DROP TRIGGER IF EXISTS APP_METADATA_SEARCH_DELETE;\
+    DROP TRIGGER IF EXISTS APP_METADATA_SEARCH_UPDATE; "
+
+/* Populates the metadata search index from scratch. */
+#define METADATA_SEARCH_REBUILD \
+    "INSERT INTO " METADATA_SEARCH_TABLE_NAME " (" METADATA_SEARCH_TABLE_NAME ") VALUES ('rebuild'); "
+
 #define DEFAULT_PRAGMAS \
     "PRAGMA encoding = \"UTF-8\";\
     PRAGMA foreign_keys = ON;\
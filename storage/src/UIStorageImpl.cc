@@ -16,6 +16,10 @@
 
 #include "UIStorageImpl.h"
 
+#include <set>
+
+#include <qcc/time.h>
+
 #include <alljoyn/PermissionPolicyUtil.h>
 #define QCC_MODULE "SECMGR_STORAGE"
 
@@ -24,6 +28,11 @@ using namespace std;
 
 namespace ajn {
 namespace securitymgr {
+UIStorageImpl::~UIStorageImpl()
+{
+    StopCertificateRenewal();
+}
+
 QStatus UIStorageImpl::ResetApplication(Application& app)
 {
     updateLock.Lock();
@@ -72,13 +81,29 @@ QStatus UIStorageImpl::RemoveGroup(const GroupInfo& groupInfo)
             return status;
         }
     }
+    // Storage moves all affected applications to their new sync state at once.
+    updateLock.Lock();
     status = storage->RemoveGroup(tmpGroupInfo, appsToSync);
+    if (ER_OK == status && !appsToSync.empty()) {
+        updateCounter++;
+    }
+    updateLock.Unlock();
 
     if (ER_OK != status || appsToSync.empty()) {
         return status;
     }
 
-    return ApplicationsUpdated(appsToSync);
+    vector<Application> pendingApps;
+    vector<Application>::iterator appItr = appsToSync.begin();
+    for (; appItr != appsToSync.end(); appItr++) {
+        if ((SYNC_PENDING == appItr->syncState) || (SYNC_WILL_RESET == appItr->syncState)) {
+            pendingApps.push_back(*appItr);
+        }
+    }
+    if (!pendingApps.empty()) {
+        NotifyListeners(pendingApps, PENDING_CHANGES);
+    }
+    return status;
 }
 
 QStatus UIStorageImpl::GetGroup(GroupInfo& groupInfo) const
@@ -112,18 +137,19 @@ QStatus UIStorageImpl::RemoveIdentity(const IdentityInfo& idInfo)
             return status;
         }
     }
+    // Storage marks all affected applications to be reset at once.
+    updateLock.Lock();
     status = storage->RemoveIdentity(tmpInfo, appsToSync);
+    if (ER_OK == status && !appsToSync.empty()) {
+        updateCounter++;
+    }
+    updateLock.Unlock();
+
     if (ER_OK != status || appsToSync.empty()) {
         return status;
     }
 
-    vector<Application>::iterator appItr = appsToSync.begin();
-    for (; appItr != appsToSync.end(); appItr++) {
-        status = ResetApplication(*appItr);
-        if (ER_OK != status) {
-            return status;
-        }
-    }
+    NotifyListeners(appsToSync, PENDING_CHANGES);
     return status;
 }
 
@@ -150,8 +176,18 @@ QStatus UIStorageImpl::GetAppMetaData(const Application& app, ApplicationMetaDat
     return storage->GetAppMetaData(app, appMetaData);
 }
 
+QStatus UIStorageImpl::SearchAppMetaData(const string& text,
+                                         const MetaDataSearchType type,
+                                         const size_t pageSize,
+                                         uint64_t& pageToken,
+                                         vector<MetaDataSearchResult>& results) const
+{
+    return storage->SearchAppMetaData(text, type, pageSize, pageToken, results);
+}
+
 void UIStorageImpl::Reset()
 {
+    StopCertificateRenewal();
     storage->Reset();
     NotifyListeners(STORAGE_RESET);
 }
@@ -325,15 +361,16 @@ QStatus UIStorageImpl::InstallMembership(const Application& app, const GroupInfo
         return status;
     }
     MembershipCertificate certificate;
+    // Serialized with the renewal of certificates.
+    updateLock.Lock();
     status = ca->GenerateMembershipCertificate(storedApp, storedGroup, certificate);
-    if (ER_OK != status) {
-        return status;
+    if (ER_OK == status) {
+        status = storage->StoreCertificate(app, certificate);
     }
-    status = storage->StoreCertificate(app, certificate);
+    updateLock.Unlock();
     if (ER_OK != status) {
         return status;
     }
-
     return ApplicationUpdated(storedApp);
 }
 
@@ -348,11 +385,13 @@ QStatus UIStorageImpl::RemoveMembership(const Application& app, const GroupInfo&
     MembershipCertificate cert;
     cert.SetGuild(storedGroup.guid);
     cert.SetSubjectPublicKey(storedApp.keyInfo.GetPublicKey());
+    // Serialized with the renewal of certificates.
+    updateLock.Lock();
     status = storage->GetCertificate(app, cert);
-    if (ER_OK != status) {
-        return status;
+    if (ER_OK == status) {
+        status = storage->RemoveCertificate(app, cert);
     }
-    status = storage->RemoveCertificate(app, cert);
+    updateLock.Unlock();
     if (ER_OK != status) {
         return status;
     }
@@ -420,23 +459,29 @@ QStatus UIStorageImpl::UpdateIdentity(Application& app,
     }
 
     IdentityCertificate cert;
+    // Serialized with the renewal of certificates.
+    updateLock.Lock();
     status = ca->GenerateIdentityCertificate(app, identityInfo, manifest, cert);
     if (ER_OK != status) {
+        updateLock.Unlock();
         return status;
     }
 
     status = storage->StoreCertificate(app, cert, true);
     if (ER_OK != status) {
         QCC_LogError(status, ("StoreCertificate failed"));
+        updateLock.Unlock();
         return status;
     } else {
         status = storage->StoreManifest(app, manifest);
         if (ER_OK != status) {
             QCC_LogError(status, ("StoreManifest failed"));
+            updateLock.Unlock();
             return status;
         }
     }
 
+    updateLock.Unlock();
     return ApplicationUpdated(app);
 }
 
@@ -469,16 +514,90 @@ QStatus UIStorageImpl::ApplicationUpdated(Application& app, bool policyUpdateNee
     return status;
 }
 
-QStatus UIStorageImpl::ApplicationsUpdated(vector<Application>& appsToSync)
+void UIStorageImpl::SetCertificateValidity(uint64_t validity)
+{
+    ca->SetCertificateValidity(validity);
+}
+
+QStatus UIStorageImpl::StartCertificateRenewal(const CertificateRenewalConfig& config)
 {
+    if ((config.renewBefore >= ca->GetCertificateValidity()) || (config.maxCertificatesPerRun == 0)) {
+        QCC_LogError(ER_BAD_ARG_1, ("Invalid certificate renewal configuration"));
+        return ER_BAD_ARG_1;
+    }
+
     QStatus status = ER_OK;
-    vector<Application>::iterator appItr = appsToSync.begin();
-    for (; appItr != appsToSync.end(); appItr++) {
-        if (ER_OK != (status = ApplicationUpdated(*appItr))) {
-            return status;
+    renewalLock.Lock();
+    if (renewer != nullptr) {
+        renewer->SetConfig(config);
+    } else {
+        renewer = new CertificateRenewer(this, config);
+        if (ER_OK != (status = renewer->Start())) {
+            QCC_LogError(status, ("Failed to start certificate renewal"));
+            delete renewer;
+            renewer = nullptr;
         }
     }
+    renewalLock.Unlock();
+    return status;
+}
+
+void UIStorageImpl::StopCertificateRenewal()
+{
+    renewalLock.Lock();
+    if (renewer != nullptr) {
+        renewer->Terminate();
+        renewer->Join();
+        delete renewer;
+        renewer = nullptr;
+    }
+    renewalLock.Unlock();
+}
 
+QStatus UIStorageImpl::RenewExpiringCertificates(uint64_t renewBefore, size_t maxCertificates)
+{
+    // The validity may have been lowered after the renewal was started;
+    // renewed certificates would then expire within renewBefore again.
+    if (renewBefore >= ca->GetCertificateValidity()) {
+        QCC_LogError(ER_BAD_ARG_1, ("Certificate validity is not larger than the renewal period"));
+        return ER_BAD_ARG_1;
+    }
+
+    vector<StoredCertificate> certificates;
+    uint64_t expiresBefore = (GetEpochTimestamp() / 1000) + renewBefore;
+
+    // Certificates must not change between reading and writing them back,
+    // or a newer certificate would be overwritten by a renewed older one.
+    updateLock.Lock();
+    QStatus status = storage->GetExpiringCertificates(expiresBefore, maxCertificates, certificates);
+    if ((ER_OK != status) || certificates.empty()) {
+        updateLock.Unlock();
+        return status;
+    }
+
+    QCC_DbgPrintf(("Renewing %u certificates", (unsigned int)certificates.size()));
+    if (ER_OK != (status = ca->RenewCertificates(certificates))) {
+        updateLock.Unlock();
+        return status;
+    }
+    status = storage->StoreCertificates(certificates);
+    updateLock.Unlock();
+    if (ER_OK != status) {
+        return status;
+    }
+
+    set<Application> renewed;
+    vector<StoredCertificate>::iterator it;
+    for (it = certificates.begin(); it != certificates.end(); ++it) {
+        if (renewed.insert(it->app).second) {
+            Application app = it->app;
+            QStatus appStatus = ApplicationUpdated(app, false);
+            if (ER_OK != appStatus) {
+                QCC_LogError(appStatus, ("Failed to mark application for update"));
+                status = appStatus;
+            }
+        }
+    }
     return status;
 }
 
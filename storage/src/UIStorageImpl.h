@@ -27,6 +27,7 @@
 #include <alljoyn/securitymgr/IdentityInfo.h>
 
 #include "AJNCaStorage.h"
+#include "CertificateRenewer.h"
 #include "SQLStorage.h"
 
 using namespace qcc;
@@ -47,10 +48,12 @@ class UIStorageImpl :
   public:
 
     UIStorageImpl(shared_ptr<AJNCaStorage>& _ca, shared_ptr<SQLStorage>& localStorage) : ca(_ca),
-        storage(localStorage), updateCounter(0)
+        storage(localStorage), updateCounter(0), renewer(nullptr)
     {
     }
 
+    ~UIStorageImpl();
+
     QStatus ResetApplication(Application& app);
 
     QStatus RemoveApplication(Application& app);
@@ -81,6 +84,12 @@ class UIStorageImpl :
     QStatus GetAppMetaData(const Application& app,
                            ApplicationMetaData& appMetaData) const;
 
+    QStatus SearchAppMetaData(const string& text,
+                              const MetaDataSearchType type,
+                              const size_t pageSize,
+                              uint64_t& pageToken,
+                              vector<MetaDataSearchResult>& results) const;
+
     void Reset();
 
     void RegisterStorageListener(StorageListener* listener);
@@ -126,6 +135,27 @@ class UIStorageImpl :
         return ER_OK;
     }
 
+    virtual void SetCertificateValidity(uint64_t validity);
+
+    virtual QStatus StartCertificateRenewal(const CertificateRenewalConfig& config);
+
+    virtual void StopCertificateRenewal();
+
+    /**
+     * @brief Renew a batch of certificates that expire within a given period
+     *        and mark the affected applications as having pending changes.
+     *
+     * @param[in] renewBefore       Period in seconds from now.
+     * @param[in] maxCertificates   The maximum number of certificates to renew.
+     *
+     * @return ER_OK         On success.
+     * @return ER_BAD_ARG_1  If renewBefore is not smaller than the certificate
+     *                       validity period; nothing is renewed.
+     * @return others        On failure.
+     */
+    QStatus RenewExpiringCertificates(uint64_t renewBefore,
+                                      size_t maxCertificates);
+
   private:
 
     QStatus GetStoredGroupAndAppInfo(Application& app,
@@ -134,8 +164,6 @@ class UIStorageImpl :
     QStatus ApplicationUpdated(Application& app,
                                bool policyUpdateNeeded = true);
 
-    QStatus ApplicationsUpdated(vector<Application>& app);
-
     void NotifyListeners(const StorageEvent event);
 
     void NotifyListeners(const Application& app,
@@ -150,6 +178,8 @@ class UIStorageImpl :
     shared_ptr<AJNCaStorage> ca;
     shared_ptr<SQLStorage> storage;
     uint64_t updateCounter;
+    Mutex renewalLock;
+    CertificateRenewer* renewer;
 };
 }
 }